@@ -0,0 +1,425 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "batchrenderer.h"
+
+#include <SFML/Graphics/Image.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+/*!
+ * \brief Constructor.
+ *
+ * Creates an empty list of views. Load views via loadViewsFromFile().
+ */
+BatchRenderer::BatchRenderer() :
+    views()
+{
+}
+
+//Public
+
+/*!
+ * \brief Load the list of views to render from a "view file".
+ *
+ * A "view file" is a text file with one view per line of the following format:
+ *
+ * OUTPUT_FILE + " " + WIDTH + " " + HEIGHT + " " + PHI + " " + THETA + " " + FOV
+ *
+ * OUTPUT_FILE is the file name of the rendered picture (must not contain spaces; the picture format is deduced from
+ * the extension, e.g. ".png") and WIDTH and HEIGHT are its size. PHI and THETA are the horizontal and vertical view
+ * angle offsets in degrees (see Projector::updateView()). FOV is one of "zoom=" + ZOOM_LEVEL (see Projector::updateView(),
+ * including the special values 0 and -1), "hfov=" + HORIZONTAL_FOV or "vfov=" + VERTICAL_FOV (both in degrees).
+ *
+ * Empty lines and lines starting with "#" are ignored.
+ *
+ * Previously loaded views are replaced if successful.
+ *
+ * \param pFileName File name of the "view file".
+ * \return If successful.
+ */
+bool BatchRenderer::loadViewsFromFile(const std::string& pFileName)
+{
+    //Information to be read from file
+    std::vector<View> tViews;
+
+    std::size_t lineNumber = 0;
+
+    try
+    {
+        std::ifstream file;
+        file.exceptions(std::ios_base::badbit);
+        file.open(pFileName, std::ios_base::in);
+
+        if (!file.is_open())
+            throw std::ios_base::failure("Could not open file.");
+
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+
+            std::istringstream lineStream(line);
+
+            View view;
+            std::string substrFOV;
+
+            if (!(lineStream>>view.outputFileName) || view.outputFileName.find('#') == 0)
+                continue;
+
+            int w = 0, h = 0;
+
+            if (!(lineStream>>w>>h>>view.phi>>view.theta>>substrFOV) || w <= 0 || h <= 0)
+                throw std::runtime_error("Invalid view in line " + std::to_string(lineNumber) + "!");
+
+            view.size = {static_cast<unsigned int>(w), static_cast<unsigned int>(h)};
+
+            if (!parseFOV(substrFOV, view.fovType, view.fov))
+                throw std::runtime_error("Invalid field of view in line " + std::to_string(lineNumber) + "!");
+
+            tViews.push_back(std::move(view));
+        }
+    }
+    catch (const std::ios_base::failure& exc)
+    {
+        std::cerr<<"ERROR: Could not open view file \"" + pFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not parse view file \"" + pFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    views = std::move(tViews);
+
+    return true;
+}
+
+/*!
+ * \brief Get the list of views to render.
+ *
+ * \return Loaded views (see loadViewsFromFile()).
+ */
+const std::vector<BatchRenderer::View>& BatchRenderer::getViews() const
+{
+    return views;
+}
+
+//
+
+/*!
+ * \brief Render all views of a panorama scene to picture files.
+ *
+ * Creates a Projector for the picture \p pFileName, \p pSceneMetaData and \p pProjectorOptions (see Projector()) and renders
+ * all loaded views (see loadViewsFromFile()) to their picture files. The views are distributed over \p pNumThreads threads
+ * (or one thread per CPU core if 0), which all render through one shared PanoramaScene (see Projector::createScene() and
+ * renderView()), such that neither the panorama sphere nor any per-thread Projector state is duplicated. Only views too large
+ * to be rendered at once (see isPosterView()) are rendered with the Projector itself, one at a time (see renderViewWithProjector()).
+ *
+ * The shared scene needs the panorama sphere pyramid, which must hence be enabled via \p pProjectorOptions
+ * (ProjectorOptions::useSphereCache or ProjectorOptions::releasePicture). Otherwise (e.g. with only ProjectorOptions::tileCacheLimit
+ * set) all views are rendered one by one with the Projector and a warning is printed.
+ *
+ * Views that fail to render are reported and skipped.
+ *
+ * \param pFileName Panorama picture to load.
+ * \param pSceneMetaData Meta data for panorama scene from \p pFileName.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
+ * \param pNumThreads Number of threads to use (0 for number of CPU cores).
+ * \return If the scene could be loaded and all views were successfully rendered.
+ */
+bool BatchRenderer::run(const std::string& pFileName, const SceneMetaData& pSceneMetaData,
+                        const ProjectorOptions& pProjectorOptions, unsigned int pNumThreads) const
+{
+    std::unique_ptr<Projector> projector;
+
+    try
+    {
+        projector = std::make_unique<Projector>(pFileName, pSceneMetaData, pProjectorOptions);
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not load the panorama scene!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    const std::shared_ptr<const PanoramaScene> scene = projector->createScene();
+
+    if (pNumThreads == 0)
+        pNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    //No more threads than views needed; additional threads only possible with a shared scene
+    std::size_t numThreads = std::max<std::size_t>(std::min<std::size_t>(pNumThreads, views.size()), 1);
+
+    if (!scene)
+    {
+        if (numThreads > 1)
+            std::cerr<<"WARNING: Rendering the views one by one, since the panorama sphere pyramid is not available "
+                       "(requires \"--cache\" or \"--release-picture\")."<<std::endl;
+
+        numThreads = 1;
+    }
+
+    std::atomic<std::size_t> nextView(0);
+    std::atomic<std::size_t> numFailed(0);
+
+    std::mutex errorMutex;
+    std::mutex projectorMutex;
+
+    //Let every thread take the next view from the list until all are done
+    auto renderViews = [this, &scene, &projector, &nextView, &numFailed, &errorMutex, &projectorMutex]() -> void
+    {
+        for (std::size_t i = nextView++; i < views.size(); i = nextView++)
+        {
+            std::string errorString;
+
+            try
+            {
+                bool saved = false;
+
+                if (scene && !isPosterView(views[i]))
+                    saved = renderView(*scene, views[i]);
+                else
+                {
+                    const std::lock_guard<std::mutex> lock(projectorMutex);
+                    saved = renderViewWithProjector(*projector, views[i]);
+                }
+
+                if (!saved)
+                    errorString = "Could not save the picture.";
+            }
+            catch (const std::exception& exc)
+            {
+                errorString = exc.what();
+            }
+
+            if (errorString != "")
+            {
+                ++numFailed;
+
+                std::lock_guard<std::mutex> lock(errorMutex);
+
+                std::cerr<<"ERROR: Could not render view " + std::to_string(i+1) + " to \"" + views[i].outputFileName + "\"!"<<std::endl;
+                std::cerr<<errorString<<std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (std::size_t i = 1; i < numThreads; ++i)
+        threads.emplace_back(renderViews);
+
+    renderViews();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::cout<<"Rendered "<<(views.size() - numFailed)<<" of "<<views.size()<<" views using "<<numThreads<<" thread(s).\n";
+
+    return numFailed == 0;
+}
+
+//
+
+/*!
+ * \brief Parse a field of view entry of a "view file".
+ *
+ * Parses \p pString of the form "zoom=" + ZOOM_LEVEL, "hfov=" + HORIZONTAL_FOV or "vfov=" + VERTICAL_FOV
+ * (see loadViewsFromFile()). The value must be a finite number without trailing characters, and a field of view
+ * must lie between 0 and 180 degrees (exclusive). Also used for the path files of FlyThroughRenderer and the
+ * requests of RenderService.
+ *
+ * \param pString Field of view entry.
+ * \param pFOVType Target for the meaning of the value (unchanged if parsing fails).
+ * \param pFOV Target for the zoom level or field of view (unchanged if parsing fails).
+ * \return If \p pString is a valid field of view entry.
+ */
+bool BatchRenderer::parseFOV(const std::string& pString, FOVType& pFOVType, float& pFOV)
+{
+    FOVType fovType = FOVType::Zoom;
+
+    //Determine meaning of the FOV value
+    if (pString.find("zoom=") == 0)
+        fovType = FOVType::Zoom;
+    else if (pString.find("hfov=") == 0)
+        fovType = FOVType::Horizontal;
+    else if (pString.find("vfov=") == 0)
+        fovType = FOVType::Vertical;
+    else
+        return false;
+
+    float fov = 0;
+
+    try
+    {
+        std::size_t numChars = 0;
+        fov = std::stof(pString.substr(5), &numChars);
+
+        if (numChars != pString.size() - 5)
+            return false;
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+
+    if (!std::isfinite(fov) || (fovType != FOVType::Zoom && (fov <= 0 || fov >= 180)))
+        return false;
+
+    pFOVType = fovType;
+    pFOV = fov;
+
+    return true;
+}
+
+//Private
+
+/*!
+ * \brief Render a single view and save it to its picture file.
+ *
+ * Renders the perspective of \p pView into a buffer of the view size (see PanoramaScene::render()) and saves it to
+ * View::outputFileName. The zoom level for a field of view is calculated for the view size (see
+ * PanoramaScene::getRequiredZoomFromHFOV() and PanoramaScene::getRequiredZoomFromVFOV()).
+ * Since \p pScene is immutable, the result does not depend on previously rendered views (nor on the thread).
+ *
+ * Note that the perspective is adjusted as necessary to avoid margins (see PanoramaScene::fitView()).
+ *
+ * \param pScene Panorama scene.
+ * \param pView View to render (not a poster view, see isPosterView()).
+ * \return If the picture file could be written.
+ */
+bool BatchRenderer::renderView(const PanoramaScene& pScene, const View& pView)
+{
+    const float degToRad = static_cast<float>(M_PI) / 180.f;
+
+    float zoom = pView.fov;
+
+    if (pView.fovType == FOVType::Horizontal)
+        zoom = pScene.getRequiredZoomFromHFOV(pView.fov * degToRad, pView.size);
+    else if (pView.fovType == FOVType::Vertical)
+        zoom = pScene.getRequiredZoomFromVFOV(pView.fov * degToRad);
+
+    std::vector<sf::Uint8> pixels(4 * static_cast<std::size_t>(pView.size.x) * pView.size.y);
+
+    if (!pScene.render(PanoramaScene::ViewState{zoom, pView.phi * degToRad, pView.theta * degToRad},
+                       PanoramaScene::OutputBuffer{pixels.data(), pView.size}))
+    {
+        return false;
+    }
+
+    sf::Image image;
+    image.create(pView.size.x, pView.size.y, pixels.data());
+
+    return image.saveToFile(pView.outputFileName);
+}
+
+/*!
+ * \brief Render a single view with a Projector and save it to its picture file.
+ *
+ * Sets display size and perspective of \p pProjector according to \p pView (see Projector::updateDisplaySize()
+ * and Projector::updateView()) and saves the resulting display projection to View::outputFileName.
+ *
+ * The panorama sphere resolution is always re-adjusted to the view (see Projector::updateDisplayFOV()), such that
+ * the result does not depend on previously rendered views.
+ *
+ * Note that the perspective is adjusted by the Projector as necessary to avoid margins.
+ *
+ * Poster views (see isPosterView()) are instead rendered in strips and streamed to a PNG file (see
+ * Projector::savePoster()), after setting up the perspective with a smaller display size of the same aspect ratio.
+ *
+ * \param pProjector Projector of the panorama scene.
+ * \param pView View to render.
+ * \return If the picture file could be written.
+ *
+ * \throws std::runtime_error Poster view (see above) to be saved in a format other than PNG.
+ */
+bool BatchRenderer::renderViewWithProjector(Projector& pProjector, const View& pView)
+{
+    const bool renderAsPoster = isPosterView(pView);
+
+    //Poster views are rendered in strips (see below), so only set up the perspective with a display size of the same aspect ratio
+    sf::Vector2u displaySize = pView.size;
+
+    if (renderAsPoster)
+    {
+        std::string extension = std::filesystem::path(pView.outputFileName).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char pChar) { return std::tolower(pChar); });
+
+        if (extension != ".png")
+            throw std::runtime_error("Views with more than " + std::to_string(maxDirectViewPixels) + " pixels must be saved as PNG.");
+
+        const float scale = static_cast<float>(posterDisplayWidth) / std::max(pView.size.x, pView.size.y);
+
+        displaySize.x = std::max(1u, static_cast<unsigned int>(pView.size.x * scale + 0.5f));
+        displaySize.y = std::max(1u, static_cast<unsigned int>(pView.size.y * scale + 0.5f));
+    }
+
+    pProjector.updateDisplaySize(displaySize, true);
+
+    float zoom = pView.fov;
+
+    if (pView.fovType == FOVType::Horizontal)
+        zoom = pProjector.getRequiredZoomFromHFOV(pView.fov * static_cast<float>(M_PI) / 180.f);
+    else if (pView.fovType == FOVType::Vertical)
+        zoom = pProjector.getRequiredZoomFromVFOV(pView.fov * static_cast<float>(M_PI) / 180.f);
+
+    pProjector.updateView(zoom, pView.phi * static_cast<float>(M_PI) / 180.f, pView.theta * static_cast<float>(M_PI) / 180.f, true);
+
+    if (renderAsPoster)
+        return pProjector.savePoster(pView.outputFileName, pView.size);
+
+    sf::Image image;
+    image.create(pView.size.x, pView.size.y, pProjector.getDisplayData().data());
+
+    return image.saveToFile(pView.outputFileName);
+}
+
+/*!
+ * \brief Check if a view is too large to be rendered at once.
+ *
+ * \param pView View to check.
+ * \return If \p pView has more than 'maxDirectViewPixels' pixels and must hence be rendered in strips (see renderViewWithProjector()).
+ */
+bool BatchRenderer::isPosterView(const View& pView)
+{
+    return static_cast<std::size_t>(pView.size.x) * pView.size.y > maxDirectViewPixels;
+}
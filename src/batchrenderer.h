@@ -0,0 +1,96 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_BATCHRENDERER_H
+#define SPNV_BATCHRENDERER_H
+
+#include "panoramascene.h"
+#include "projector.h"
+#include "scenemetadata.h"
+
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Render lists of panorama scene perspectives to picture files without a window.
+ *
+ * Loads a list of views (perspective, size and output file name) from a "view file" (see loadViewsFromFile())
+ * and renders each of them to a picture file (see run()). Independent views are rendered in parallel on several
+ * threads through a single shared, immutable PanoramaScene (see Projector::createScene()).
+ */
+class BatchRenderer
+{
+public:
+    /*!
+     * \brief Meaning of View::fov.
+     */
+    enum class FOVType : std::uint8_t
+    {
+        Zoom,           ///< Zoom level (see Projector::updateView()).
+        Horizontal,     ///< Horizontal field of view in degrees.
+        Vertical        ///< Vertical field of view in degrees.
+    };
+
+    /*!
+     * \brief A single perspective to be rendered.
+     */
+    struct View
+    {
+        std::string outputFileName; ///< File name of the rendered picture (format deduced from extension, e.g. PNG).
+        sf::Vector2u size;          ///< Size of the rendered picture.
+        float phi;                  ///< Horizontal view angle offset in degrees.
+        float theta;                ///< Vertical view angle offset in degrees.
+        FOVType fovType;            ///< Meaning of 'fov'.
+        float fov;                  ///< Zoom level or field of view.
+    };
+
+public:
+    BatchRenderer();                                            ///< Constructor.
+    //
+    bool loadViewsFromFile(const std::string& pFileName);       ///< Load the list of views to render from a "view file".
+    const std::vector<View>& getViews() const;                  ///< Get the list of views to render.
+    //
+    bool run(const std::string& pFileName, const SceneMetaData& pSceneMetaData,
+             const ProjectorOptions& pProjectorOptions = ProjectorOptions(),
+             unsigned int pNumThreads = 0) const;               ///< Render all views of a panorama scene to picture files.
+    //
+    static bool parseFOV(const std::string& pString, FOVType& pFOVType, float& pFOV);   ///< Parse a field of view entry of a "view file".
+
+private:
+    static bool renderView(const PanoramaScene& pScene, const View& pView);     ///< Render a single view and save it to its picture file.
+    static bool renderViewWithProjector(Projector& pProjector, const View& pView);  ///< \brief Render a single view with a Projector
+                                                                                    ///  and save it to its picture file.
+    static bool isPosterView(const View& pView);                                ///< Check if a view is too large to be rendered at once.
+
+private:
+    static constexpr std::size_t maxDirectViewPixels = 4096 * 4096; ///< Larger views are rendered in strips (see Projector::savePoster()).
+    static constexpr unsigned int posterDisplayWidth = 1024;        ///< Display size (longer side) to set up the perspective of larger views.
+
+private:
+    std::vector<View> views;    //Views to render
+};
+
+#endif // SPNV_BATCHRENDERER_H
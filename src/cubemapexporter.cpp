@@ -0,0 +1,199 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "cubemapexporter.h"
+
+#include "pngwriter.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+const std::array<std::string, 6> CubemapExporter::faceNames = {"front", "right", "back", "left", "up", "down"};
+
+/*!
+ * \brief Constructor.
+ *
+ * Calculates the angle maps of all faces for face size \p pFaceSize (see CubemapExporter).
+ *
+ * \param pFaceSize Width and height of every face.
+ *
+ * \throws std::invalid_argument Face size not positive.
+ */
+CubemapExporter::CubemapExporter(const int pFaceSize) :
+    faceSize(pFaceSize > 0 ? pFaceSize : throw std::invalid_argument("Invalid cube face size!")),
+    sideFaceMap(Projector::createRectilinearAngleMap({faceSize, faceSize}, M_PI / 2.)),
+    upFaceMap(createUpFaceAngleMap(faceSize))
+{
+}
+
+//Public
+
+/*!
+ * \brief Render and save the faces of a single scene.
+ *
+ * Creates a Projector for the scene (see Projector()) and renders all six faces (see Projector::renderAngleMap()) to
+ * "Scene::outputBaseName-cube-FACE.png" with FACE from 'faceNames'. The scene must cover the full 360 degrees
+ * horizontally. Parts outside of the vertical field of view of the scene (usually around the poles) are black.
+ *
+ * \param pScene Panorama scene to export.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
+ * \return If successful.
+ */
+bool CubemapExporter::exportScene(const Scene& pScene, const ProjectorOptions& pProjectorOptions) const
+{
+    try
+    {
+        Projector projector(pScene.picFileName, pScene.metaData, pProjectorOptions);
+
+        if (!projector.coversFullCircle())
+        {
+            std::cerr<<"ERROR: Panorama scene \"" + pScene.picFileName + "\" does not cover 360 degrees horizontally!"<<std::endl;
+            return false;
+        }
+
+        std::vector<sf::Uint8> faceData(4 * static_cast<std::size_t>(faceSize) * faceSize);
+
+        for (int face = 0; face < 6; ++face)
+        {
+            //Horizontal faces are rotated by multiples of 90 degrees, "down" face is the mirrored "up" face
+            if (face < 4)
+                projector.renderAngleMap(sideFaceMap, face * M_PI / 2., false, faceData.data());
+            else
+                projector.renderAngleMap(upFaceMap, 0, face == 5, faceData.data());
+
+            const std::string faceFileName = pScene.outputBaseName + "-cube-" + faceNames[face] + ".png";
+
+            PngWriter writer;
+
+            if (!writer.open(faceFileName, {static_cast<unsigned int>(faceSize), static_cast<unsigned int>(faceSize)}) ||
+                !writer.writeRows(faceData.data(), faceSize) || !writer.close())
+            {
+                std::cerr<<"ERROR: Could not save cube face \"" + faceFileName + "\"!"<<std::endl;
+                return false;
+            }
+        }
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not export the panorama scene \"" + pScene.picFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Export a batch of panorama scenes in parallel.
+ *
+ * Exports all scenes of \p pScenes (see exportScene()), distributed over \p pNumThreads threads (or one thread per CPU core
+ * if 0). Every thread loads its own scene, so the memory usage grows with the number of threads. Scenes that fail
+ * to export are reported and skipped. The achieved throughput is printed to stdout.
+ *
+ * \param pScenes Panorama scenes to export.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
+ * \param pNumThreads Number of threads to use (0 for number of CPU cores).
+ * \return If all scenes were successfully exported.
+ */
+bool CubemapExporter::run(const std::vector<Scene>& pScenes, const ProjectorOptions& pProjectorOptions, unsigned int pNumThreads) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    if (pNumThreads == 0)
+        pNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    pNumThreads = std::min<std::size_t>(pNumThreads, std::max<std::size_t>(pScenes.size(), 1));
+
+    std::atomic<std::size_t> nextScene(0);
+    std::atomic<std::size_t> numFailed(0);
+
+    //Let every thread take the next scene from the list until all are done
+    auto exportScenes = [this, &pScenes, &pProjectorOptions, &nextScene, &numFailed]() -> void
+    {
+        for (std::size_t i = nextScene++; i < pScenes.size(); i = nextScene++)
+            if (!exportScene(pScenes[i], pProjectorOptions))
+                ++numFailed;
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 1; t < pNumThreads; ++t)
+        threads.emplace_back(exportScenes);
+
+    exportScenes();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    const std::size_t numExported = pScenes.size() - numFailed;
+
+    std::cout<<"Exported cube maps of "<<numExported<<" of "<<pScenes.size()<<" scenes ("<<faceSize<<"x"<<faceSize<<" per face) in "
+             <<seconds<<" s using "<<pNumThreads<<" thread(s): "<<numExported / seconds<<" scenes/s.\n";
+
+    return numFailed == 0;
+}
+
+//Private
+
+/*!
+ * \brief Calculate the angle map of the "up" face.
+ *
+ * Every pixel corner of the face corresponds to the viewing direction (u, -1, v) with u, v in [-1, 1] from left to right
+ * and from top to bottom, given the "front" direction (0, 0, 1) and the "down" direction (0, 1, 0).
+ *
+ * \param pFaceSize Width and height of the face.
+ * \return Angles of all pixel corners of the face.
+ */
+Projector::AngleMap CubemapExporter::createUpFaceAngleMap(const int pFaceSize)
+{
+    Projector::AngleMap angleMap;
+
+    angleMap.size = {pFaceSize, pFaceSize};
+    angleMap.corners.resize(static_cast<std::size_t>(pFaceSize+1) * static_cast<std::size_t>(pFaceSize+1));
+
+    for (int y = 0; y <= pFaceSize; ++y)
+    {
+        for (int x = 0; x <= pFaceSize; ++x)
+        {
+            const float u = 2.f * x / pFaceSize - 1.f;
+            const float v = 2.f * y / pFaceSize - 1.f;
+
+            angleMap.corners[static_cast<std::size_t>(pFaceSize+1)*y + x] = {std::atan2(u, v), -std::atan2(1.f, std::hypot(u, v))};
+        }
+    }
+
+    //Same resolution as horizontal faces (smallest angles at the face corners)
+    angleMap.minPixelAngle = std::atan2(1.f, pFaceSize / 2.f - 1.f) - std::atan2(1.f, pFaceSize / 2.f);
+
+    return angleMap;
+}
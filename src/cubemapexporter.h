@@ -0,0 +1,79 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_CUBEMAPEXPORTER_H
+#define SPNV_CUBEMAPEXPORTER_H
+
+#include "projector.h"
+#include "scenemetadata.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Export full 360 degree panorama scenes as the six faces of a cube map.
+ *
+ * Renders the six square faces ("front", "right", "back", "left", "up" and "down") of a cube map for every panorama scene
+ * of a batch (see run()) and saves them as PNG files. The "front" face looks at the horizontal center of the picture.
+ * The "up" face has the "front" face at its bottom edge and the "down" face has it at its top edge.
+ *
+ * The face projections only depend on the face size and are hence calculated once as angle maps (see Projector::AngleMap)
+ * and reused for all faces and scenes: the four horizontal faces are rotated versions of the same rectilinear projection
+ * (see Projector::createRectilinearAngleMap()) and the "down" face is a mirrored version of the "up" face. For throughput
+ * on large batches, different scenes are processed in parallel, each by its own Projector (see Projector::renderAngleMap()).
+ */
+class CubemapExporter
+{
+public:
+    /*!
+     * \brief A panorama scene to be exported.
+     */
+    struct Scene
+    {
+        std::string picFileName;    ///< Panorama picture file name.
+        SceneMetaData metaData;     ///< Meta data for panorama scene from 'picFileName'.
+        std::string outputBaseName; ///< Face file names without the "-cube-FACE.png" suffix.
+    };
+
+public:
+    explicit CubemapExporter(int pFaceSize);                    ///< Constructor.
+    //
+    bool exportScene(const Scene& pScene, const ProjectorOptions& pProjectorOptions = ProjectorOptions()) const;  ///< \brief Render
+                                                                                                                    ///  and save the faces
+                                                                                                                    ///  of a single scene.
+    bool run(const std::vector<Scene>& pScenes, const ProjectorOptions& pProjectorOptions = ProjectorOptions(),
+             unsigned int pNumThreads = 0) const;               ///< Export a batch of panorama scenes in parallel.
+    //
+    static const std::array<std::string, 6> faceNames;          ///< Names of the cube faces (in file names).
+
+private:
+    static Projector::AngleMap createUpFaceAngleMap(int pFaceSize);     ///< Calculate the angle map of the "up" face.
+
+private:
+    const int faceSize;                     //Width and height of every face
+    //
+    const Projector::AngleMap sideFaceMap;  //Angle map of the "front" face (horizontally rotated for other horizontal faces)
+    const Projector::AngleMap upFaceMap;    //Angle map of the "up" face (vertically mirrored for "down" face)
+};
+
+#endif // SPNV_CUBEMAPEXPORTER_H
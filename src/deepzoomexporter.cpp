@@ -0,0 +1,332 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "deepzoomexporter.h"
+
+#include "spherepyramid.h"
+
+#include <SFML/Graphics/Image.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*!
+ * \brief Constructor.
+ *
+ * \param pTileSize Tile size without overlap.
+ * \param pOverlap Number of pixels each tile shares with each of its neighbors.
+ * \param pTileFormat File extension and picture format of the tiles (any format supported by sf::Image, e.g. "jpg" or "png").
+ *
+ * \throws std::invalid_argument Tile size not positive or overlap negative.
+ */
+DeepZoomExporter::DeepZoomExporter(const int pTileSize, const int pOverlap, std::string pTileFormat) :
+    tileSize(pTileSize),
+    overlap(pOverlap),
+    tileFormat(std::move(pTileFormat))
+{
+    if (tileSize <= 0 || overlap < 0)
+        throw std::invalid_argument("Invalid Deep Zoom tile size or overlap!");
+}
+
+//Public
+
+/*!
+ * \brief Export the panorama sphere of a scene as Deep Zoom image.
+ *
+ * Creates a Projector for the picture \p pFileName, \p pSceneMetaData and \p pProjectorOptions (see Projector()) and writes
+ * its full resolution panorama sphere as Deep Zoom image to "\p pOutputBaseName.dzi" and the tile directory "\p pOutputBaseName_files"
+ * (see DeepZoomExporter). The panorama sphere is taken from the Projector's panorama sphere pyramid (see Projector::getSpherePyramid()),
+ * so it is memory-mapped from the cache file with ProjectorOptions::useSphereCache and built in memory otherwise
+ * (ProjectorOptions::releasePicture is always set for this).
+ *
+ * Starting from the full resolution, the tiles of every level are written on \p pNumThreads threads (or one thread per CPU core
+ * if 0). Levels whose size matches a pyramid level are written directly from the pyramid. Only the levels below the smallest
+ * pyramid level are computed from the respective next higher level on the same threads, holding two of them in memory at a time.
+ *
+ * The descriptor file is written last and only if all tiles were written successfully.
+ * The number of tiles and pixels and the achieved throughput are printed to stdout.
+ *
+ * \param pFileName Panorama picture to load.
+ * \param pSceneMetaData Meta data for panorama scene from \p pFileName.
+ * \param pOutputBaseName File name of the descriptor file without ".dzi" extension.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
+ * \param pNumThreads Number of threads to use (0 for number of CPU cores).
+ * \return If the scene could be loaded and all files were successfully written.
+ */
+bool DeepZoomExporter::run(const std::string& pFileName, const SceneMetaData& pSceneMetaData, const std::string& pOutputBaseName,
+                           const ProjectorOptions& pProjectorOptions, unsigned int pNumThreads) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    //Full resolution panorama sphere is level 0 of the panorama sphere pyramid
+    std::shared_ptr<const SpherePyramid> pyramid;
+
+    try
+    {
+        ProjectorOptions options = pProjectorOptions;
+        options.releasePicture = true;
+
+        pyramid = Projector(pFileName, pSceneMetaData, options).getSpherePyramid();
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not load the panorama scene!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    if (!pyramid || pyramid->getNumLevels() == 0)
+    {
+        std::cerr<<"ERROR: Could not create the panorama sphere!"<<std::endl;
+        return false;
+    }
+
+    const auto loadedTime = std::chrono::steady_clock::now();
+
+    if (pNumThreads == 0)
+        pNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    //Level sizes from full resolution down to a single pixel (halved and rounded up from level to level)
+
+    const sf::Vector2i fullSize = pyramid->getLevelSize(0);
+
+    std::vector<sf::Vector2i> levelSizes = {fullSize};
+
+    while (levelSizes.back().x > 1 || levelSizes.back().y > 1)
+        levelSizes.push_back({(levelSizes.back().x + 1) / 2, (levelSizes.back().y + 1) / 2});
+
+    const int maxLevel = static_cast<int>(levelSizes.size()) - 1;
+
+    const std::string filesDirName = pOutputBaseName + "_files";
+
+    //Data of current level (taken from the pyramid as long as the sizes match) and of next lower level
+    const sf::Uint8* levelData = pyramid->getLevelData(0);
+    int pyramidLevel = 0;
+    std::vector<sf::Uint8> currentLevelData;
+    std::vector<sf::Uint8> nextLevelData;
+
+    std::size_t numTiles = 0;
+    std::size_t numPixels = 0;
+
+    for (int i = 0; i <= maxLevel; ++i)
+    {
+        const int level = maxLevel - i;
+        const sf::Vector2i levelSize = levelSizes[i];
+
+        const std::string levelDirName = filesDirName + "/" + std::to_string(level);
+
+        try
+        {
+            std::filesystem::create_directories(levelDirName);
+        }
+        catch (const std::exception& exc)
+        {
+            std::cerr<<"ERROR: Could not create directory \"" + levelDirName + "\"!"<<std::endl;
+            std::cerr<<exc.what()<<std::endl;
+            return false;
+        }
+
+        if (!writeLevelTiles(level, levelSize, levelData, levelDirName, pNumThreads))
+            return false;
+
+        numTiles += static_cast<std::size_t>((levelSize.x + tileSize - 1) / tileSize) * ((levelSize.y + tileSize - 1) / tileSize);
+        numPixels += static_cast<std::size_t>(levelSize.x) * levelSize.y;
+
+        if (level == 0)
+            break;
+
+        const sf::Vector2i nextSize = levelSizes[i+1];
+
+        //Take next lower level from the pyramid if available
+
+        if (pyramidLevel >= 0 && pyramidLevel + 1 < pyramid->getNumLevels() && pyramid->getLevelSize(pyramidLevel + 1) == nextSize)
+        {
+            ++pyramidLevel;
+            levelData = pyramid->getLevelData(pyramidLevel);
+            continue;
+        }
+
+        pyramidLevel = -1;
+
+        //Compute next lower level from current one, splitting its rows over the threads
+
+        nextLevelData.resize(4 * static_cast<std::size_t>(nextSize.x) * nextSize.y);
+
+        std::vector<std::thread> threads;
+
+        for (unsigned int t = 0; t < pNumThreads; ++t)
+        {
+            const int beginRow = static_cast<int>(static_cast<std::size_t>(nextSize.y) * t / pNumThreads);
+            const int endRow = static_cast<int>(static_cast<std::size_t>(nextSize.y) * (t+1) / pNumThreads);
+
+            if (beginRow < endRow)
+                threads.emplace_back(&SpherePyramid::downsampleBox2x2, levelSize, levelData, nextSize, nextLevelData.data(), beginRow, endRow);
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        currentLevelData.swap(nextLevelData);
+        levelData = currentLevelData.data();
+    }
+
+    if (!writeDescriptor(pOutputBaseName + ".dzi", fullSize))
+        return false;
+
+    const auto endTime = std::chrono::steady_clock::now();
+
+    const double loadSeconds = std::chrono::duration<double>(loadedTime - startTime).count();
+    const double exportSeconds = std::chrono::duration<double>(endTime - loadedTime).count();
+
+    std::cout<<"Loaded panorama sphere of "<<fullSize.x<<"x"<<fullSize.y<<" pixels in "<<loadSeconds<<" s.\n";
+    std::cout<<"Exported "<<numTiles<<" tiles ("<<numPixels / 1e6<<" MPixel) in "<<(maxLevel+1)<<" levels in "<<exportSeconds
+             <<" s using "<<pNumThreads<<" thread(s): "<<numPixels / 1e6 / exportSeconds<<" MPixel/s, "
+             <<numTiles / exportSeconds<<" tiles/s.\n";
+
+    return true;
+}
+
+//Private
+
+/*!
+ * \brief Write all tiles of a level in parallel.
+ *
+ * Splits the level into tiles of 'tileSize' x 'tileSize' pixels, each extended by 'overlap' pixels on every side that has
+ * a neighboring tile, and saves tile column "c" and row "r" to "\p pLevelDirName/c_r.FORMAT" (see DeepZoomExporter()).
+ * The tiles are distributed over \p pNumThreads threads.
+ *
+ * \param pLevel Deep Zoom level number (only used for error messages).
+ * \param pLevelSize Size of the level.
+ * \param pLevelData Data of the level ("rgba", see Projector::getDisplayData()).
+ * \param pLevelDirName Directory for the tiles of the level.
+ * \param pNumThreads Number of threads to use.
+ * \return If all tiles were successfully written.
+ */
+bool DeepZoomExporter::writeLevelTiles(const int pLevel, const sf::Vector2i pLevelSize, const sf::Uint8 *const pLevelData,
+                                       const std::string& pLevelDirName, const unsigned int pNumThreads) const
+{
+    const int numColumns = (pLevelSize.x + tileSize - 1) / tileSize;
+    const int numRows = (pLevelSize.y + tileSize - 1) / tileSize;
+
+    std::atomic<int> nextTile(0);
+    std::atomic<bool> failed(false);
+
+    std::mutex errorMutex;
+
+    //Let every thread take the next tile until all are done
+    auto writeTiles = [this, pLevel, pLevelSize, pLevelData, &pLevelDirName, numColumns, numRows,
+                       &nextTile, &failed, &errorMutex]() -> void
+    {
+        std::vector<sf::Uint8> tileData;
+
+        for (int i = nextTile++; i < numColumns * numRows && !failed; i = nextTile++)
+        {
+            const int column = i % numColumns;
+            const int row = i / numColumns;
+
+            //Tile region including overlap with neighboring tiles
+            const int left = std::max(column * tileSize - overlap, 0);
+            const int top = std::max(row * tileSize - overlap, 0);
+            const int right = std::min((column + 1) * tileSize + overlap, pLevelSize.x);
+            const int bottom = std::min((row + 1) * tileSize + overlap, pLevelSize.y);
+
+            const std::size_t tileRowLength = 4 * static_cast<std::size_t>(right - left);
+
+            tileData.resize(tileRowLength * (bottom - top));
+
+            for (int y = top; y < bottom; ++y)
+                std::copy_n(pLevelData + 4 * (static_cast<std::size_t>(pLevelSize.x) * y + left), tileRowLength,
+                            tileData.data() + tileRowLength * (y - top));
+
+            const std::string tileFileName = pLevelDirName + "/" + std::to_string(column) + "_" + std::to_string(row) + "." + tileFormat;
+
+            sf::Image tile;
+            tile.create(right - left, bottom - top, tileData.data());
+
+            if (!tile.saveToFile(tileFileName))
+            {
+                failed = true;
+
+                std::lock_guard<std::mutex> lock(errorMutex);
+                std::cerr<<"ERROR: Could not write tile \"" + tileFileName + "\" of level " + std::to_string(pLevel) + "!"<<std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 1; t < std::min<unsigned int>(pNumThreads, numColumns * numRows); ++t)
+        threads.emplace_back(writeTiles);
+
+    writeTiles();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return !failed;
+}
+
+/*!
+ * \brief Write the "DZI" XML descriptor file.
+ *
+ * \param pFileName File name of the descriptor file.
+ * \param pSize Size of the full resolution level.
+ * \return If successful.
+ */
+bool DeepZoomExporter::writeDescriptor(const std::string& pFileName, const sf::Vector2i pSize) const
+{
+    std::ofstream file(pFileName, std::ios_base::out | std::ios_base::trunc);
+
+    if (!file.is_open())
+    {
+        std::cerr<<"ERROR: Could not open file \"" + pFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    file<<"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    file<<"<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\""<<tileFormat<<"\" Overlap=\""<<overlap
+        <<"\" TileSize=\""<<tileSize<<"\">\n";
+    file<<"    <Size Width=\""<<pSize.x<<"\" Height=\""<<pSize.y<<"\"/>\n";
+    file<<"</Image>\n";
+
+    file.close();
+
+    if (file.fail())
+    {
+        std::cerr<<"ERROR: Could not write file \"" + pFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_DEEPZOOMEXPORTER_H
+#define SPNV_DEEPZOOMEXPORTER_H
+
+#include "projector.h"
+#include "scenemetadata.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <string>
+
+/*!
+ * \brief Export the full resolution panorama sphere as Deep Zoom ("DZI") tile pyramid for web viewers.
+ *
+ * Takes the full resolution panorama sphere of a scene from a Projector (see Projector::getSpherePyramid())
+ * and writes it as Deep Zoom image (see run()): a "BASENAME.dzi" XML descriptor and a directory "BASENAME_files"
+ * with one sub-directory per level, which contains the level's tiles as "COLUMN_ROW.FORMAT" picture files.
+ *
+ * The highest level is the full resolution sphere. As the panorama sphere pyramid is halved like the Deep Zoom levels,
+ * the lower levels down to the smallest pyramid level are written directly from the pyramid. Only the levels below
+ * are derived from the previous one by averaging blocks of 2x2 pixels (see SpherePyramid::downsampleBox2x2()),
+ * down to a single pixel.
+ * The tiles of every level are written in parallel.
+ */
+class DeepZoomExporter
+{
+public:
+    DeepZoomExporter(int pTileSize = 254, int pOverlap = 1, std::string pTileFormat = "jpg");    ///< Constructor.
+    //
+    bool run(const std::string& pFileName, const SceneMetaData& pSceneMetaData, const std::string& pOutputBaseName,
+             const ProjectorOptions& pProjectorOptions = ProjectorOptions(),
+             unsigned int pNumThreads = 0) const;               ///< Export the panorama sphere of a scene as Deep Zoom image.
+
+private:
+    bool writeLevelTiles(int pLevel, sf::Vector2i pLevelSize, const sf::Uint8* pLevelData, const std::string& pLevelDirName,
+                         unsigned int pNumThreads) const;       ///< Write all tiles of a level in parallel.
+    bool writeDescriptor(const std::string& pFileName, sf::Vector2i pSize) const;  ///< Write the "DZI" XML descriptor file.
+
+private:
+    const int tileSize;             //Tile size without overlap
+    const int overlap;              //Number of pixels shared with each neighboring tile
+    const std::string tileFormat;   //File extension and format of the tiles (e.g. "jpg" or "png")
+};
+
+#endif // SPNV_DEEPZOOMEXPORTER_H
@@ -0,0 +1,604 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "flythroughrenderer.h"
+
+#include "panoramascene.h"
+#include "pngwriter.h"
+#include "sharedframeoutput.h"
+
+#include <SFML/Config.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+/*!
+ * \brief A rendered frame waiting to be saved.
+ */
+struct Frame
+{
+    std::string fileName;               ///< Output file name.
+    std::vector<sf::Uint8> pixels;      ///< Frame pixels in "rgba" format (see Projector::getDisplayData()).
+};
+
+/*!
+ * \brief Bounded queue passing rendered frames from the rendering thread to the encoding threads.
+ *
+ * push() blocks while the queue is full, such that rendering cannot run arbitrarily far ahead of encoding.
+ * Pixel buffers of saved frames are handed back via returnBuffer() and reused via takeBuffer(), such that
+ * no new buffers need to be allocated once the pipeline is filled.
+ */
+class FrameQueue
+{
+public:
+    /*!
+     * \brief Constructor.
+     *
+     * \param pCapacity Maximum number of queued frames.
+     */
+    explicit FrameQueue(const std::size_t pCapacity) :
+        capacity(std::max<std::size_t>(pCapacity, 1)),
+        closed(false)
+    {
+    }
+
+    /*!
+     * \brief Append a frame, waiting as long as the queue is full.
+     *
+     * \param pFrame Frame to append.
+     */
+    void push(Frame&& pFrame)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return frames.size() < capacity; });
+
+        frames.push_back(std::move(pFrame));
+
+        lock.unlock();
+        notEmpty.notify_one();
+    }
+
+    /*!
+     * \brief Take the oldest frame, waiting as long as the queue is empty and not closed.
+     *
+     * \param pFrame Target for the frame.
+     * \return False if the queue is closed and empty.
+     */
+    bool pop(Frame& pFrame)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]() { return !frames.empty() || closed; });
+
+        if (frames.empty())
+            return false;
+
+        pFrame = std::move(frames.front());
+        frames.pop_front();
+
+        lock.unlock();
+        notFull.notify_one();
+
+        return true;
+    }
+
+    /*!
+     * \brief Signal that no more frames will be pushed.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+
+        notEmpty.notify_all();
+    }
+
+    /*!
+     * \brief Get a previously returned pixel buffer for reuse.
+     *
+     * \return Returned buffer or empty buffer if none available.
+     */
+    std::vector<sf::Uint8> takeBuffer()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (freeBuffers.empty())
+            return {};
+
+        std::vector<sf::Uint8> buffer = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+
+        return buffer;
+    }
+
+    /*!
+     * \brief Hand back the pixel buffer of a saved frame for reuse.
+     *
+     * \param pBuffer No longer needed buffer.
+     */
+    void returnBuffer(std::vector<sf::Uint8>&& pBuffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(std::move(pBuffer));
+    }
+
+private:
+    const std::size_t capacity;                         //Maximum number of queued frames
+    bool closed;                                        //No more frames will be pushed
+    //
+    std::deque<Frame> frames;                           //Queued frames
+    std::vector<std::vector<sf::Uint8>> freeBuffers;    //Pixel buffers of saved frames
+    //
+    std::mutex mutex;                                   //Protects all of the above
+    std::condition_variable notFull;                    //Signaled when a frame was taken
+    std::condition_variable notEmpty;                   //Signaled when a frame was appended or the queue closed
+};
+
+/*!
+ * \brief Save a rendered frame to its file.
+ *
+ * \param pFrame Frame to save.
+ * \param pFrameSize Size of the frame.
+ * \param pFormat File format.
+ * \return If successful.
+ */
+bool saveFrame(const Frame& pFrame, const sf::Vector2u pFrameSize, const FlyThroughRenderer::FrameFormat pFormat)
+{
+    if (pFormat == FlyThroughRenderer::FrameFormat::PNG)
+    {
+        PngWriter writer;
+
+        return writer.open(pFrame.fileName, pFrameSize) && writer.writeRows(pFrame.pixels.data(), pFrameSize.y) && writer.close();
+    }
+
+    std::ofstream file(pFrame.fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    file.write(reinterpret_cast<const char*>(pFrame.pixels.data()), pFrame.pixels.size());
+    file.close();
+
+    return !file.fail();
+}
+
+} // namespace
+
+/*!
+ * \brief Constructor.
+ *
+ * Creates an empty camera path. Load a path via loadPathFromFile().
+ */
+FlyThroughRenderer::FlyThroughRenderer() :
+    frameSize({0, 0}),
+    frameFormat(FrameFormat::PNG),
+    keyframes(),
+    frameOutputName()
+{
+}
+
+//Public
+
+/*!
+ * \brief Load frame size, frame format and camera path from a "path file".
+ *
+ * A "path file" is a text file whose first line has the format
+ *
+ * WIDTH + " " + HEIGHT + " " + FORMAT
+ *
+ * with the frame size and FORMAT being "png" or "raw" (see FrameFormat), followed by at least two keyframes
+ * with one keyframe per line of the following format:
+ *
+ * FRAME + " " + PHI + " " + THETA + " " + FOV
+ *
+ * FRAME is the (non-negative) frame number of the keyframe and PHI, THETA and FOV have the same meaning as
+ * for a "view file" (see BatchRenderer::loadViewsFromFile()), except that the special zoom values 0 and -1
+ * both just select the respective minimum zoom level. PHI is not wrapped, such that e.g. keyframes with
+ * PHI values 0 and 360 describe a full turn. The keyframes must be ordered by strictly increasing frame numbers.
+ *
+ * Empty lines and lines starting with "#" are ignored.
+ *
+ * Previously loaded settings are replaced if successful.
+ *
+ * \param pFileName File name of the "path file".
+ * \return If successful.
+ */
+bool FlyThroughRenderer::loadPathFromFile(const std::string& pFileName)
+{
+    //Information to be read from file
+    sf::Vector2u tFrameSize(0, 0);
+    FrameFormat tFrameFormat = FrameFormat::PNG;
+    std::vector<Keyframe> tKeyframes;
+
+    std::size_t lineNumber = 0;
+
+    try
+    {
+        std::ifstream file;
+        file.exceptions(std::ios_base::badbit);
+        file.open(pFileName, std::ios_base::in);
+
+        if (!file.is_open())
+            throw std::ios_base::failure("Could not open file.");
+
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+
+            std::istringstream lineStream(line);
+
+            std::string firstWord;
+
+            if (!(lineStream>>firstWord) || firstWord.find('#') == 0)
+                continue;
+
+            lineStream.seekg(0);
+
+            //First line contains frame size and format
+            if (tFrameSize.x == 0)
+            {
+                int w = 0, h = 0;
+                std::string format;
+
+                if (!(lineStream>>w>>h>>format) || w <= 0 || h <= 0 || (format != "png" && format != "raw"))
+                    throw std::runtime_error("Invalid frame size or format in line " + std::to_string(lineNumber) + "!");
+
+                tFrameSize = {static_cast<unsigned int>(w), static_cast<unsigned int>(h)};
+                tFrameFormat = (format == "png" ? FrameFormat::PNG : FrameFormat::Raw);
+
+                continue;
+            }
+
+            Keyframe keyframe;
+            std::string substrFOV;
+
+            if (!(lineStream>>keyframe.frame>>keyframe.phi>>keyframe.theta>>substrFOV) || keyframe.frame < 0 ||
+                (!tKeyframes.empty() && keyframe.frame <= tKeyframes.back().frame))
+            {
+                throw std::runtime_error("Invalid keyframe in line " + std::to_string(lineNumber) + "!");
+            }
+
+            if (!BatchRenderer::parseFOV(substrFOV, keyframe.fovType, keyframe.fov))
+                throw std::runtime_error("Invalid field of view in line " + std::to_string(lineNumber) + "!");
+
+            tKeyframes.push_back(keyframe);
+        }
+
+        if (tKeyframes.size() < 2)
+            throw std::runtime_error("At least two keyframes are required!");
+    }
+    catch (const std::ios_base::failure& exc)
+    {
+        std::cerr<<"ERROR: Could not open path file \"" + pFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not parse path file \"" + pFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    frameSize = tFrameSize;
+    frameFormat = tFrameFormat;
+    keyframes = std::move(tKeyframes);
+
+    return true;
+}
+
+/*!
+ * \brief Additionally hand every rendered frame to another process.
+ *
+ * Makes run() create a shared memory triple buffer named \p pName (see SharedFrameOutput) for the frame size of the
+ * camera path, to which every rendered frame is published with its perspective in addition to saving it. Since the
+ * frames are rendered as fast as possible, a consumer that is slower than the rendering only gets the latest ones.
+ *
+ * \param pName Name of the shared memory object.
+ */
+void FlyThroughRenderer::enableSharedFrameOutput(const std::string& pName)
+{
+    frameOutputName = pName;
+}
+
+//
+
+/*!
+ * \brief Render and save the fly-through frames of panorama scenes.
+ *
+ * For every scene of \p pScenes creates a Projector (see Projector()) and renders all frames from the first to the
+ * last keyframe (see loadPathFromFile()) to "Scene::outputBaseName-NNNNNN.png" (or ".rgba"), with NNNNNN being the
+ * zero-padded frame number. The perspective between keyframes is interpolated with cubic Hermite splines (view angles
+ * linearly and zoom level logarithmically at the keyframes). Note that the perspective is still adjusted by the
+ * Projector as necessary to avoid margins.
+ *
+ * Frames are rendered on the calling thread and saved by \p pNumEncodeThreads threads (or one thread less than
+ * the number of CPU cores if 0, but at least one) in parallel. At most two frames per encoding thread are
+ * queued, such that memory usage does not depend on the number of frames.
+ *
+ * If enabled (see enableSharedFrameOutput()), every frame is also published to the shared memory frame output. If the
+ * panorama sphere pyramid is available (see ProjectorOptions), the frame is then rendered through a PanoramaScene (see
+ * Projector::createScene()) directly into the back buffer of the shared memory (see SharedFrameOutput::getBackBuffer())
+ * instead of with Projector::updateView(). The perspective is the same in both cases (see PanoramaScene::fitView()).
+ *
+ * Scenes that fail to load and frames that fail to save are reported and skipped.
+ *
+ * \param pScenes Panorama scenes to render.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
+ * \param pNumEncodeThreads Number of threads for saving the frames (0 for automatic choice, see above).
+ * \return If all frames of all scenes were successfully rendered and saved
+ *         (and the shared memory frame output could be created, if enabled).
+ */
+bool FlyThroughRenderer::run(const std::vector<Scene>& pScenes, const ProjectorOptions& pProjectorOptions,
+                             unsigned int pNumEncodeThreads) const
+{
+    if (keyframes.size() < 2)
+    {
+        std::cerr<<"ERROR: No camera path loaded!"<<std::endl;
+        return false;
+    }
+
+    std::unique_ptr<SharedFrameOutput> frameOutput;
+
+    if (!frameOutputName.empty())
+    {
+        try
+        {
+            frameOutput = std::make_unique<SharedFrameOutput>(frameOutputName, frameSize);
+        }
+        catch (const std::exception& exc)
+        {
+            std::cerr<<"ERROR: Could not set up the shared memory frame output!"<<std::endl;
+            std::cerr<<exc.what()<<std::endl;
+            return false;
+        }
+
+        std::cout<<"Publishing frames to shared memory object \""<<frameOutput->getName()<<"\".\n";
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    if (pNumEncodeThreads == 0)
+        pNumEncodeThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+    FrameQueue queue(2 * static_cast<std::size_t>(pNumEncodeThreads));
+
+    std::atomic<std::size_t> numFailed(0);
+    std::size_t numFrames = 0;
+
+    std::mutex errorMutex;
+
+    //Let every encoding thread save the next queued frame until the queue is closed
+    auto encodeFrames = [this, &queue, &numFailed, &errorMutex]() -> void
+    {
+        Frame frame;
+
+        while (queue.pop(frame))
+        {
+            if (!saveFrame(frame, frameSize, frameFormat))
+            {
+                ++numFailed;
+
+                std::lock_guard<std::mutex> lock(errorMutex);
+                std::cerr<<"ERROR: Could not save frame \"" + frame.fileName + "\"!"<<std::endl;
+            }
+
+            queue.returnBuffer(std::move(frame.pixels));
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < pNumEncodeThreads; ++t)
+        threads.emplace_back(encodeFrames);
+
+    const char *const extension = (frameFormat == FrameFormat::PNG ? ".png" : ".rgba");
+
+    for (const Scene& scene : pScenes)
+    {
+        try
+        {
+            Projector projector(scene.picFileName, scene.metaData, pProjectorOptions);
+
+            projector.updateDisplaySize(frameSize, true);
+
+            //Render published frames directly into shared memory, if possible
+            const std::shared_ptr<const PanoramaScene> panoScene = (frameOutput ? projector.createScene() : nullptr);
+
+            //Zoom levels of the keyframes depend on display size and scene
+            std::vector<float> zooms;
+
+            for (const Keyframe& keyframe : keyframes)
+            {
+                if (keyframe.fovType == BatchRenderer::FOVType::Horizontal)
+                    zooms.push_back(projector.getRequiredZoomFromHFOV(keyframe.fov * static_cast<float>(M_PI) / 180.f));
+                else if (keyframe.fovType == BatchRenderer::FOVType::Vertical)
+                    zooms.push_back(projector.getRequiredZoomFromVFOV(keyframe.fov * static_cast<float>(M_PI) / 180.f));
+                else if (keyframe.fov > 0)
+                    zooms.push_back(keyframe.fov);
+                else
+                {
+                    projector.updateView(keyframe.fov, 0, 0);
+                    zooms.push_back(projector.getZoom());
+                }
+            }
+
+            for (int f = keyframes.front().frame; f <= keyframes.back().frame; ++f)
+            {
+                const CameraState camera = interpolatePath(keyframes, zooms, f);
+
+                Frame frame;
+
+                std::ostringstream fileName;
+                fileName<<scene.outputBaseName<<"-"<<std::setw(6)<<std::setfill('0')<<f<<extension;
+                frame.fileName = fileName.str();
+
+                frame.pixels = queue.takeBuffer();
+
+                SharedFrameOutput::FrameInfo info;
+
+                if (panoScene)
+                {
+                    const PanoramaScene::ViewState view = panoScene->fitView(PanoramaScene::ViewState{camera.zoom, camera.phi,
+                                                                                                      camera.theta}, frameSize);
+                    sf::Uint8 *const backBuffer = frameOutput->getBackBuffer();
+
+                    if (!panoScene->render(view, PanoramaScene::OutputBuffer{backBuffer, frameSize}))
+                        throw std::runtime_error("Could not render frame.");
+
+                    frame.pixels.assign(backBuffer, backBuffer + 4 * static_cast<std::size_t>(frameSize.x) * frameSize.y);
+
+                    info.zoom = view.zoom;
+                    info.offsetPhi = view.offsetPhi;
+                    info.offsetTheta = view.offsetTheta;
+                    info.renderTimeNs = SharedFrameOutput::getMonotonicTimeNs();
+
+                    frameOutput->publish(frameSize, info);
+                }
+                else
+                {
+                    //Adjust panorama sphere resolution only for the first frame and then only when needed, as usual
+                    projector.updateView(camera.zoom, camera.phi, camera.theta, f == keyframes.front().frame);
+
+                    const std::vector<sf::Uint8>& displayData = projector.getDisplayData();
+
+                    frame.pixels.assign(displayData.begin(), displayData.end());
+
+                    if (frameOutput)
+                    {
+                        info.zoom = projector.getZoom();
+                        info.offsetPhi = projector.getOffsetPhi();
+                        info.offsetTheta = projector.getOffsetTheta();
+                        info.renderTimeNs = SharedFrameOutput::getMonotonicTimeNs();
+
+                        frameOutput->publish(displayData.data(), frameSize, info);
+                    }
+                }
+
+                queue.push(std::move(frame));
+
+                ++numFrames;
+            }
+        }
+        catch (const std::exception& exc)
+        {
+            ++numFailed;
+
+            std::lock_guard<std::mutex> lock(errorMutex);
+
+            std::cerr<<"ERROR: Could not render the fly-through of panorama scene \"" + scene.picFileName + "\"!"<<std::endl;
+            std::cerr<<exc.what()<<std::endl;
+        }
+    }
+
+    queue.close();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout<<"Rendered "<<numFrames<<" frames of "<<pScenes.size()<<" scene(s) in "<<seconds<<" s using "
+             <<pNumEncodeThreads<<" encoding thread(s): "<<numFrames / seconds<<" frames/s.\n";
+
+    return numFailed == 0;
+}
+
+//Private
+
+/*!
+ * \brief Interpolate the camera perspective at a specific frame.
+ *
+ * Uses cubic Hermite interpolation between the two keyframes enclosing \p pFrame, with tangents from the
+ * neighboring keyframes (finite differences, scaled to the non-uniform keyframe spacing). The view angles
+ * are interpolated directly and the zoom level logarithmically (constant zoom speed between two keyframes).
+ *
+ * \param pKeyframes Keyframes with strictly increasing frame numbers (at least two).
+ * \param pZooms Zoom levels of \p pKeyframes.
+ * \param pFrame Frame number between first and last keyframe.
+ * \return Camera perspective at \p pFrame.
+ */
+FlyThroughRenderer::CameraState FlyThroughRenderer::interpolatePath(const std::vector<Keyframe>& pKeyframes,
+                                                                    const std::vector<float>& pZooms, const int pFrame)
+{
+    //Find segment [k, k+1] containing the frame
+    std::size_t k = 0;
+    while (k + 2 < pKeyframes.size() && pKeyframes[k+1].frame <= pFrame)
+        ++k;
+
+    const std::size_t kPrev = (k > 0 ? k - 1 : k);
+    const std::size_t kNext = std::min(k + 2, pKeyframes.size() - 1);
+
+    const float t0 = pKeyframes[kPrev].frame;
+    const float t1 = pKeyframes[k].frame;
+    const float t2 = pKeyframes[k+1].frame;
+    const float t3 = pKeyframes[kNext].frame;
+
+    const float s = (pFrame - t1) / (t2 - t1);
+
+    //Hermite basis functions
+    const float h00 = (1 + 2*s) * (1-s) * (1-s);
+    const float h10 = s * (1-s) * (1-s);
+    const float h01 = s * s * (3 - 2*s);
+    const float h11 = s * s * (s - 1);
+
+    auto interpolate = [&](const float p0, const float p1, const float p2, const float p3) -> float
+    {
+        const float m1 = (p2 - p0) / (t2 - t0) * (t2 - t1);
+        const float m2 = (p3 - p1) / (t3 - t1) * (t2 - t1);
+
+        return h00 * p1 + h10 * m1 + h01 * p2 + h11 * m2;
+    };
+
+    CameraState camera;
+
+    camera.phi = interpolate(pKeyframes[kPrev].phi, pKeyframes[k].phi, pKeyframes[k+1].phi, pKeyframes[kNext].phi);
+    camera.theta = interpolate(pKeyframes[kPrev].theta, pKeyframes[k].theta, pKeyframes[k+1].theta, pKeyframes[kNext].theta);
+    camera.zoom = std::exp(interpolate(std::log(pZooms[kPrev]), std::log(pZooms[k]), std::log(pZooms[k+1]), std::log(pZooms[kNext])));
+
+    //Convert to radians and keep horizontal angle within [0, 2*PI) (see Projector::updateView())
+    camera.phi = std::fmod(camera.phi, 360.f);
+    if (camera.phi < 0)
+        camera.phi += 360.f;
+
+    camera.phi *= static_cast<float>(M_PI) / 180.f;
+    camera.theta *= static_cast<float>(M_PI) / 180.f;
+
+    return camera;
+}
@@ -0,0 +1,117 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_FLYTHROUGHRENDERER_H
+#define SPNV_FLYTHROUGHRENDERER_H
+
+#include "batchrenderer.h"
+#include "projector.h"
+#include "scenemetadata.h"
+
+#include <SFML/System/Vector2.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Render camera fly-throughs of panorama scenes to numbered video frames without a window.
+ *
+ * Loads a camera path of keyframes (perspective at specific frame numbers) from a "path file" (see loadPathFromFile())
+ * and renders all frames in between for one or more panorama scenes (see run()), interpolating the perspective smoothly
+ * between the keyframes. The frames are saved as numbered PNG files or as raw "rgba" files (e.g. for piping into a video
+ * encoder).
+ *
+ * Rendering and encoding of frames are pipelined: frames are rendered one after another with Projector::updateView() and
+ * passed through a bounded queue to a pool of encoding threads, such that encoding of previous frames overlaps rendering
+ * of the next frames while the number of frames held in memory stays limited.
+ *
+ * The frames can additionally be published to another local process via shared memory (see enableSharedFrameOutput()),
+ * which makes this class a producer for SharedFrameOutput that does not need a window.
+ */
+class FlyThroughRenderer
+{
+public:
+    /*!
+     * \brief File format of the rendered frames.
+     */
+    enum class FrameFormat : std::uint8_t
+    {
+        PNG,    ///< Compressed PNG files (".png").
+        Raw     ///< Uncompressed "rgba" pixels without header, row by row (".rgba").
+    };
+
+    /*!
+     * \brief Camera perspective at a specific frame of the path.
+     */
+    struct Keyframe
+    {
+        int frame;                          ///< Frame number.
+        float phi;                          ///< Horizontal view angle offset in degrees.
+        float theta;                        ///< Vertical view angle offset in degrees.
+        BatchRenderer::FOVType fovType;     ///< Meaning of 'fov'.
+        float fov;                          ///< Zoom level or field of view.
+    };
+
+    /*!
+     * \brief A panorama scene to render the fly-through for.
+     */
+    struct Scene
+    {
+        std::string picFileName;    ///< Panorama picture file name.
+        SceneMetaData metaData;     ///< Meta data for panorama scene from 'picFileName'.
+        std::string outputBaseName; ///< Frame file names without the "-NNNNNN.EXT" suffix.
+    };
+
+public:
+    FlyThroughRenderer();                                       ///< Constructor.
+    //
+    bool loadPathFromFile(const std::string& pFileName);        ///< Load frame size, frame format and camera path from a "path file".
+    void enableSharedFrameOutput(const std::string& pName);     ///< Additionally hand every rendered frame to another process.
+    //
+    bool run(const std::vector<Scene>& pScenes, const ProjectorOptions& pProjectorOptions = ProjectorOptions(),
+             unsigned int pNumEncodeThreads = 0) const;         ///< Render and save the fly-through frames of panorama scenes.
+
+private:
+    /*!
+     * \brief Interpolated camera perspective in the units of Projector::updateView().
+     */
+    struct CameraState
+    {
+        float zoom;     //Zoom level
+        float phi;      //Horizontal view angle offset
+        float theta;    //Vertical view angle offset
+    };
+
+private:
+    static CameraState interpolatePath(const std::vector<Keyframe>& pKeyframes, const std::vector<float>& pZooms,
+                                       int pFrame);             ///< Interpolate the camera perspective at a specific frame.
+
+private:
+    sf::Vector2u frameSize;             //Size of the rendered frames
+    FrameFormat frameFormat;            //File format of the rendered frames
+    std::vector<Keyframe> keyframes;    //Camera path (sorted by frame number)
+    //
+    std::string frameOutputName;        //Name of the shared memory object for publishing the frames (empty if disabled)
+};
+
+#endif // SPNV_FLYTHROUGHRENDERER_H
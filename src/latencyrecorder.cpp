@@ -0,0 +1,191 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+#include "latencyrecorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+/*!
+ * \brief Constructor.
+ *
+ * Creates empty histograms for all interaction types.
+ */
+LatencyRecorder::LatencyRecorder() :
+    histograms(),
+    pendingInputs()
+{
+    for (Histogram& histogram : histograms)
+        histogram.buckets.assign(maxLatency * bucketsPerMillisecond + 1, 0);
+}
+
+//Public
+
+/*!
+ * \brief Stamp an input event that changes the perspective.
+ *
+ * Should be called right after taking the event from the event queue. The latency is measured until the next
+ * call of recordFrameDisplayed() for a frame that shows \p pGeneration or a newer generation.
+ *
+ * \param pInteraction Type of the interaction.
+ * \param pGeneration View generation produced by the input (must not decrease from call to call).
+ */
+void LatencyRecorder::recordInput(const Interaction pInteraction, const std::uint64_t pGeneration)
+{
+    pendingInputs.push_back({pInteraction, pGeneration, Clock::now()});
+}
+
+/*!
+ * \brief Complete the measurements of the pending inputs included in a displayed frame.
+ *
+ * Should be called right after the frame was displayed (i.e. after sf::Window::display() returned). Adds the
+ * latencies of all pending inputs (see recordInput()) up to view generation \p pGeneration to the respective
+ * histograms. Inputs of newer generations stay pending until a frame showing them is displayed.
+ *
+ * \param pGeneration View generation shown by the frame.
+ */
+void LatencyRecorder::recordFrameDisplayed(const std::uint64_t pGeneration)
+{
+    const Clock::time_point now = Clock::now();
+
+    //Inputs are stamped in order of increasing generation
+    auto it = pendingInputs.begin();
+
+    for (; it != pendingInputs.end() && it->generation <= pGeneration; ++it)
+    {
+        const double latency = std::chrono::duration<double, std::milli>(now - it->time).count();
+
+        Histogram& histogram = histograms[static_cast<int>(it->interaction)];
+
+        const std::size_t bucket = std::min(static_cast<std::size_t>(latency * bucketsPerMillisecond), histogram.buckets.size() - 1);
+
+        ++histogram.buckets[bucket];
+        ++histogram.count;
+        histogram.sum += latency;
+        histogram.max = std::max(histogram.max, latency);
+    }
+
+    pendingInputs.erase(pendingInputs.begin(), it);
+}
+
+//
+
+/*!
+ * \brief Get the number of measured latencies.
+ *
+ * \param pInteraction Type of the interaction.
+ * \return Number of measured latencies for \p pInteraction.
+ */
+std::size_t LatencyRecorder::getNumSamples(const Interaction pInteraction) const
+{
+    return histograms[static_cast<int>(pInteraction)].count;
+}
+
+/*!
+ * \brief Get a percentile of the measured latencies.
+ *
+ * Returns the upper edge of the histogram bucket containing the requested percentile,
+ * i.e. the value is accurate to 1/'bucketsPerMillisecond' ms. For latencies beyond
+ * 'maxLatency' the largest measured latency is returned.
+ *
+ * \param pInteraction Type of the interaction.
+ * \param pFraction Percentile as fraction between 0 and 1 (e.g. 0.5 for the median).
+ * \return Latency in milliseconds below which \p pFraction of the measurements are (or 0 if there are none).
+ */
+double LatencyRecorder::getPercentile(const Interaction pInteraction, const double pFraction) const
+{
+    const Histogram& histogram = histograms[static_cast<int>(pInteraction)];
+
+    if (histogram.count == 0)
+        return 0;
+
+    const std::size_t rank = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(pFraction * histogram.count)));
+
+    std::size_t cumulativeCount = 0;
+
+    for (std::size_t bucket = 0; bucket + 1 < histogram.buckets.size(); ++bucket)
+    {
+        cumulativeCount += histogram.buckets[bucket];
+
+        if (cumulativeCount >= rank)
+            return std::min(static_cast<double>(bucket + 1) / bucketsPerMillisecond, histogram.max);
+    }
+
+    return histogram.max;
+}
+
+/*!
+ * \brief Format latency percentiles and histograms as a human-readable table.
+ *
+ * Lists count, mean, median, 95th and 99th percentile and maximum latency for every interaction type,
+ * followed by the latency counts per interaction type in power-of-two millisecond ranges.
+ *
+ * \return Multi-line report.
+ */
+std::string LatencyRecorder::getReport() const
+{
+    static constexpr std::array<const char*, numInteractions> names = {"drag", "wheel", "key"};
+
+    char line[100];
+
+    std::string report = "Input-to-photon latency (ms)   count    mean  median     p95     p99     max\n";
+
+    for (int i = 0; i < numInteractions; ++i)
+    {
+        const Interaction interaction = static_cast<Interaction>(i);
+        const Histogram& histogram = histograms[i];
+
+        std::snprintf(line, sizeof(line), "%-28s%8zu%8.1f%8.1f%8.1f%8.1f%8.1f\n", names[i], histogram.count,
+                      histogram.count > 0 ? histogram.sum / histogram.count : 0., getPercentile(interaction, 0.5),
+                      getPercentile(interaction, 0.95), getPercentile(interaction, 0.99), histogram.max);
+        report.append(line);
+    }
+
+    report.append("\nLatency histogram (ms)          drag   wheel     key\n");
+
+    //Power-of-two ranges [0, 1), [1, 2), [2, 4), ..., [512, 'maxLatency') and ['maxLatency', inf)
+    int lower = 0;
+    int upper = 1;
+
+    while (lower < maxLatency)
+    {
+        const int clampedUpper = std::min(upper, maxLatency);
+
+        std::array<std::size_t, numInteractions> counts = {};
+
+        for (int i = 0; i < numInteractions; ++i)
+            for (int bucket = lower * bucketsPerMillisecond; bucket < clampedUpper * bucketsPerMillisecond; ++bucket)
+                counts[i] += histograms[i].buckets[bucket];
+
+        std::snprintf(line, sizeof(line), "%6d - %-6d%21zu%8zu%8zu\n", lower, clampedUpper, counts[0], counts[1], counts[2]);
+        report.append(line);
+
+        lower = upper;
+        upper *= 2;
+    }
+
+    std::snprintf(line, sizeof(line), "%6d -       %21zu%8zu%8zu\n", maxLatency, histograms[0].buckets.back(),
+                  histograms[1].buckets.back(), histograms[2].buckets.back());
+    report.append(line);
+
+    return report;
+}
@@ -0,0 +1,104 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_LATENCYRECORDER_H
+#define SPNV_LATENCYRECORDER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Measure input-to-photon latencies of interactive perspective changes.
+ *
+ * Every input event that changes the perspective is stamped when it is taken from the event queue
+ * (see recordInput()), together with the view generation that it produces. The time at which the first frame
+ * showing that generation or a newer one is displayed (see recordFrameDisplayed()) completes the measurement.
+ * The latencies are collected in histograms per interaction type (see Interaction) with a resolution of
+ * 1/'bucketsPerMillisecond' milliseconds up to 'maxLatency' milliseconds. A summary with
+ * percentiles and a coarse histogram can be obtained via getReport().
+ *
+ * Inputs taken from the queue before the same frame are all assigned to that frame (each with its own latency),
+ * such that coalescing many events into one frame is accounted for correctly. Frames showing an older generation
+ * (e.g. projected ahead before the input arrived) leave the input pending.
+ */
+class LatencyRecorder
+{
+public:
+    /*!
+     * \brief Type of interaction that changes the perspective.
+     */
+    enum class Interaction : int
+    {
+        Drag = 0,   ///< Mouse movement during mouse drag.
+        Wheel = 1,  ///< Mouse wheel scrolling (zoom).
+        Key = 2     ///< Key press that changes the perspective (arrow keys, zoom keys, etc.).
+    };
+
+    static constexpr int numInteractions = 3;           ///< Number of different Interaction types.
+    static constexpr int bucketsPerMillisecond = 4;     ///< Histogram resolution.
+    static constexpr int maxLatency = 1000;             ///< Largest resolved latency in milliseconds (larger ones are still counted).
+
+public:
+    LatencyRecorder();                                  ///< Constructor.
+    //
+    void recordInput(Interaction pInteraction, std::uint64_t pGeneration);  ///< Stamp an input event that changes the perspective.
+    void recordFrameDisplayed(std::uint64_t pGeneration);                   ///< \brief Complete the measurements of the pending inputs
+                                                                            ///  included in a displayed frame.
+    //
+    std::size_t getNumSamples(Interaction pInteraction) const;                  ///< Get the number of measured latencies.
+    double getPercentile(Interaction pInteraction, double pFraction) const;     ///< Get a percentile of the measured latencies.
+    std::string getReport() const;                      ///< Format latency percentiles and histograms as a human-readable table.
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    /*!
+     * \brief Stamped input that was not displayed yet.
+     */
+    struct PendingInput
+    {
+        Interaction interaction;            ///< Type of the interaction.
+        std::uint64_t generation;           ///< View generation produced by the input.
+        Clock::time_point time;             ///< Time at which the input was taken from the event queue.
+    };
+
+    /*!
+     * \brief Latency histogram of one interaction type.
+     */
+    struct Histogram
+    {
+        std::vector<std::size_t> buckets;   ///< Counts per 1/'bucketsPerMillisecond' ms (last bucket for larger latencies).
+        std::size_t count = 0;              ///< Number of measured latencies.
+        double sum = 0;                     ///< Sum of all latencies in milliseconds.
+        double max = 0;                     ///< Largest latency in milliseconds.
+    };
+
+private:
+    std::array<Histogram, numInteractions> histograms;                      //Latency histograms per interaction type
+    std::vector<PendingInput> pendingInputs;                                //Stamped inputs not displayed yet
+};
+
+#endif // SPNV_LATENCYRECORDER_H
@@ -20,14 +20,22 @@
 ////////////////////////////////////////////////////////////////////////////////////////
 */
 
+#include "batchrenderer.h"
+#include "cubemapexporter.h"
+#include "deepzoomexporter.h"
+#include "flythroughrenderer.h"
 #include "panoramawindow.h"
+#include "projector.h"
+#include "renderservice.h"
 #include "scenemetadata.h"
 #include "version.h"
 
+#include <cstddef>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,6 +45,52 @@
 ///
 /// \details See main() for information about what this does.
 
+/*!
+ * \brief Get the PNV file name corresponding to a picture file name.
+ *
+ * Replaces the extension of \p pPicFileName by ".pnv".
+ *
+ * \param pPicFileName Panorama picture file name.
+ * \return PNV file name (empty if it could not be determined).
+ */
+std::string getPNVFileName(const std::string& pPicFileName)
+{
+    try
+    {
+        std::filesystem::path tPath(pPicFileName);
+        tPath.replace_extension("pnv");
+        return tPath.string();
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not find out the PNV file name matching the picture file name!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return "";
+    }
+}
+
+/*!
+ * \brief Load panorama scene meta data from the PNV file corresponding to a picture file name.
+ *
+ * See getPNVFileName() and SceneMetaData::loadFromPNVFile().
+ *
+ * \param pPicFileName Panorama picture file name.
+ * \param pMetaData Target for the loaded meta data.
+ * \return If successful.
+ */
+bool loadMatchingPNVFile(const std::string& pPicFileName, SceneMetaData& pMetaData)
+{
+    const std::string pnvFileName = getPNVFileName(pPicFileName);
+
+    if (pnvFileName == "" || !pMetaData.loadFromPNVFile(pnvFileName))
+    {
+        std::cerr<<"ERROR: Could not load PNV file for \"" + pPicFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 /*!
  * \brief Print usage information.
  *
@@ -51,16 +105,69 @@ void printHelp()
     helpString.append(" [--help]");
     helpString.append(" PANORAMA-PICTURE");
     helpString.append(" [--pto=HUGIN-FILE | -p HUGIN-FILE]");
+    helpString.append(" [--render=VIEW-FILE]");
+    helpString.append(" [--export-dzi=BASENAME]");
+    helpString.append(" [--export-cubemap=FACE-SIZE [MORE-PANORAMA-PICTURES...]]");
+    helpString.append(" [--fly-through=PATH-FILE [MORE-PANORAMA-PICTURES...]]");
+    helpString.append(" [--serve=SOCKET-PATH [--scene-root=DIRECTORY] [--scene-cache=MEGABYTES] [MORE-PANORAMA-PICTURES...]]");
+    helpString.append(" [--cache]");
+    helpString.append(" [--tile-cache=MEGABYTES [--tile-dir=DIRECTORY]]");
+    helpString.append(" [--release-picture]");
+    helpString.append(" [--memory-report]");
+    helpString.append(" [--shm-output=NAME]");
+    helpString.append(" [--latency-report]");
+    helpString.append(" [--sphere-layout=rgba|rgb|planar]");
 
     helpString.append("\n\nDESCRIPTION:\n");
     helpString.append(" If no options are present, displays the panorama scene in PANORAMA-PICTURE using information from "
                       "previously saved \"PNV\" file (see OPTIONS)\n");
 
+    helpString.append(" At most one of the options --pto, --render, --export-dzi, --export-cubemap, --fly-through and --serve "
+                      "can be used at once.\n");
+
     helpString.append("\nOPTIONS:\n");
 
     helpString.append(" -h, --help\n        Print a description of the command line options and exit.\n\n");
     helpString.append(" -p, --pto=HUGIN-FILE\n        Extract information from Hugin project needed to properly display "
-                      "PANORAMA-PICTURE. Save this information to a \"PNV\" file (same basename as PANORAMA-PICTURE) and exit.\n");
+                      "PANORAMA-PICTURE. Save this information to a \"PNV\" file (same basename as PANORAMA-PICTURE) and exit.\n\n");
+    helpString.append(" --render=VIEW-FILE\n        Render the views listed in VIEW-FILE to picture files without opening a window and exit. "
+                      "Every line of VIEW-FILE reads \"OUTPUT-FILE WIDTH HEIGHT PHI THETA FOV\" with angles in degrees and FOV being "
+                      "\"zoom=ZOOM\", \"hfov=DEGREES\" or \"vfov=DEGREES\". Views are rendered in parallel if the panorama sphere "
+                      "pyramid is available (with \"--cache\" or \"--release-picture\"), otherwise one by one.\n\n");
+    helpString.append(" --export-dzi=BASENAME\n        Export the full resolution panorama sphere as Deep Zoom image for web viewers "
+                      "(descriptor \"BASENAME.dzi\" and JPEG tiles in \"BASENAME_files\") without opening a window and exit.\n\n");
+    helpString.append(" --export-cubemap=FACE-SIZE\n        Export the six FACE-SIZE x FACE-SIZE cube faces of every given 360 degree "
+                      "panorama scene to \"PICTURE-BASENAME-cube-FACE.png\" (FACE being front, right, back, left, up and down) "
+                      "without opening a window and exit. Multiple pictures are exported in parallel.\n\n");
+    helpString.append(" --fly-through=PATH-FILE\n        Render the camera path from PATH-FILE as numbered frames "
+                      "\"PICTURE-BASENAME-frame-NNNNNN.png\" (or \".rgba\") for every given panorama scene without opening a window "
+                      "and exit. The first line of PATH-FILE reads \"WIDTH HEIGHT png|raw\" and every further line defines a keyframe "
+                      "\"FRAME PHI THETA FOV\" (see --render). Frames are saved in parallel to rendering.\n\n");
+    helpString.append(" --serve=SOCKET-PATH\n        Run as render service on the Unix domain socket SOCKET-PATH until terminated. "
+                      "Every request line \"RENDER WIDTH HEIGHT PHI THETA FOV png|rgba PICTURE\" (see --render) is answered with "
+                      "\"OK BYTES WIDTH HEIGHT PHI THETA ZOOM\" and the rendered data or with \"ERROR MESSAGE\". The given panorama "
+                      "scenes are loaded in advance and only these can be requested, unless \"--scene-root\" is given.\n\n");
+    helpString.append(" --scene-root=DIRECTORY\n        Let the render service also load the panorama scenes of any pictures within "
+                      "DIRECTORY (including subdirectories) on request. With \"--cache\" their cache files are created there as well.\n\n");
+    helpString.append(" --scene-cache=MEGABYTES\n        Keep at most MEGABYTES (default 4096) of panorama scenes loaded on request in "
+                      "the render service, evicting the least recently used ones. The given panorama scenes are always kept.\n\n");
+    helpString.append(" -c, --cache\n        Load the panorama sphere from a \"PNVC\" cache file (same basename as PANORAMA-PICTURE) "
+                      "instead of from PANORAMA-PICTURE. The cache file is created if it is missing or outdated.\n\n");
+    helpString.append(" --tile-cache=MEGABYTES\n        Keep picture and panorama sphere in tiled temporary files (next to PANORAMA-PICTURE) "
+                      "instead of in memory and use at most MEGABYTES of memory for the tiles needed by the current view.\n\n");
+    helpString.append(" --tile-dir=DIRECTORY\n        Create the tiled temporary files of \"--tile-cache\" in DIRECTORY instead, "
+                      "which must be located on a disk (not e.g. on \"tmpfs\").\n\n");
+    helpString.append(" --release-picture\n        Build a multi-resolution panorama sphere in memory once and release PANORAMA-PICTURE "
+                      "afterwards, so that neither the full picture nor a separate panorama sphere stays in memory.\n\n");
+    helpString.append(" --memory-report\n        Print current and peak memory usage of picture, panorama sphere, transformation caches "
+                      "and display buffer when the window is closed.\n\n");
+    helpString.append(" --shm-output=NAME\n        Additionally publish every displayed frame with its perspective and timestamps to the "
+                      "POSIX shared memory triple buffer NAME for another local process (signaled via futex). Also works with "
+                      "\"--fly-through\" (every rendered frame). Fails if NAME is already in use.\n\n");
+    helpString.append(" --latency-report\n        Measure the latency from input events (mouse drag, mouse wheel, keys) to the first displayed "
+                      "frame that includes them and print histograms per input type when the window is closed.\n\n");
+    helpString.append(" --sphere-layout=rgba|rgb|planar\n        Store the panorama sphere with interleaved \"rgba\" values (default), "
+                      "interleaved \"rgb\" values or as separate \"r\", \"g\" and \"b\" planes. The latter two need 25% less memory.\n");
 
     std::cerr<<helpString;
 }
@@ -70,13 +177,37 @@ void printHelp()
  *
  * Parses the command line arguments first and depending on them does the following:
  *
- * - Print usage information (see printHelp()), if help requested ("-h" or "--help") or the arguments are invalid.
+ * - Print usage information (see printHelp()), if help requested ("-h" or "--help") or the arguments are invalid
+ *   (which includes combining more than one of the modes described below except for displaying the scene).
  * - If both a picture file and a PTO file (via option "-p" or "--pto=") were provided, read panorama scene meta data
  *   from PTO file, write it to a "PNV file" and exit (see SceneMetaData::loadFromPTOFile() and SceneMetaData::saveToPNVFile()).
  *   The PNV file name will be the same as the picture's file name except for the extension being replaced by ".pnv".
+ * - If a view file was provided (via option "--render="), render the listed views of the picture's panorama scene to
+ *   picture files and exit (see BatchRenderer). The scene meta data are loaded from the PNV file as described below.
+ *   The picture is released after building the panorama sphere, such that all threads share the same sphere.
+ * - If a Deep Zoom base name was provided (via option "--export-dzi="), export the full resolution panorama sphere
+ *   as Deep Zoom image and exit (see DeepZoomExporter). The scene meta data are loaded from the PNV file as described below.
+ * - If a cube face size was provided (via option "--export-cubemap="), export the cube faces of the panorama scenes of
+ *   all given picture files (only in this case multiple picture files are allowed) and exit (see CubemapExporter).
+ *   The scene meta data are loaded from the PNV files as described below.
+ * - If a path file was provided (via option "--fly-through="), render the camera path's frames for the panorama scenes
+ *   of all given picture files (multiple picture files allowed as well) and exit (see FlyThroughRenderer).
+ *   With option "--shm-output=" the frames are also published to shared memory (see FlyThroughRenderer::enableSharedFrameOutput()).
+ *   The scene meta data are loaded from the PNV files as described below.
+ * - If a socket path was provided (via option "--serve="), serve render requests for the panorama scenes of the given
+ *   picture files and of any further requested ones within the directory set via option "--scene-root=" until terminated
+ *   (see RenderService). The memory limit for scenes loaded on request can be set via option "--scene-cache=".
+ *   The scene meta data are loaded from the PNV files as described below.
  * - If only a picture file name is present, display the picture's panorama scene with a PanoramaWindow (see PanoramaWindow::run()).
  *   The required panorama scene meta data will be loaded from the corresponding PNV file (see SceneMetaData::loadFromPNVFile()),
  *   which is expected to have the same file name as the picture except for the extension being ".pnv".
+ *   With option "-c" or "--cache" the panorama sphere is loaded from (or saved to) a cache file (see ProjectorOptions).
+ *   With option "--tile-cache=" picture and panorama sphere are kept in memory-limited tiled storage (see ProjectorOptions).
+ *   With option "--release-picture" the picture is released after building the panorama sphere (see ProjectorOptions).
+ *   With option "--memory-report" the memory usage is printed at the end (see Projector::getMemoryUsageReport()).
+ *   With option "--shm-output=" every displayed frame is also published to shared memory (see SharedFrameOutput).
+ *   With option "--latency-report" input-to-photon latencies are printed at the end (see LatencyRecorder).
+ *   With option "--sphere-layout=" the storage layout of the panorama sphere can be chosen (see PanoSphereLayout).
  *
  * \param argc Command line argument count.
  * \param argv Array of command line arguments.
@@ -92,39 +223,188 @@ int main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
-    //File names of panorama picture and (optionally) the corresponding Hugin project file
-    std::string picFileName, ptoFileName;
+    //File names of panorama picture and (optionally) the corresponding Hugin project file or a view file for batch rendering
+    std::string picFileName, ptoFileName, viewFileName;
+
+    //Base name for exporting a Deep Zoom image (optional)
+    std::string dziBaseName;
+
+    //Face size for exporting cube maps or path file for rendering fly-throughs (optional) and further panorama pictures to use
+    int cubeFaceSize = 0;
+    std::string pathFileName;
+    std::vector<std::string> morePicFileNames;
+
+    //Socket path for running as render service (optional), its directory of requestable pictures
+    //and its maximum size of panorama scenes loaded on request
+    std::string socketPath;
+    std::string sceneRoot;
+    std::size_t maxSceneCacheSize = static_cast<std::size_t>(4096) * 1024 * 1024;
+
+    //Settings for picture loading and panorama sphere storage
+    ProjectorOptions projectorOptions;
+
+    //Name of shared memory object for publishing displayed frames (optional)
+    std::string shmOutputName;
+
+    //Measure and print input-to-photon latencies (optional)
+    bool latencyReport = false;
 
     //Parse command line arguments
-    if (args.size() == 2)
+
+    bool wrongCmdArgs = false;
+
+    for (std::size_t i = 1; i < args.size() && !wrongCmdArgs; ++i)
     {
-        if (args[1] == "-h" || args[1] == "--help")
+        const std::string& arg = args[i];
+
+        if (arg == "-h" || arg == "--help")
         {
             printHelp();
             return EXIT_SUCCESS;
         }
+        else if (arg == "-p")
+        {
+            if (i+1 < args.size())
+                ptoFileName = args[++i];
+            else
+                wrongCmdArgs = true;
+        }
+        else if (arg.find("--pto=") == 0)
+            ptoFileName = arg.substr(6);
+        else if (arg.find("--render=") == 0)
+            viewFileName = arg.substr(9);
+        else if (arg.find("--export-dzi=") == 0)
+        {
+            dziBaseName = arg.substr(13);
+
+            if (dziBaseName == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg.find("--export-cubemap=") == 0)
+        {
+            try
+            {
+                std::size_t numChars = 0;
+                const unsigned long faceSize = std::stoul(arg.substr(17), &numChars);
+
+                if (faceSize == 0 || faceSize > 65536 || numChars != arg.size() - 17)
+                    wrongCmdArgs = true;
+                else
+                    cubeFaceSize = static_cast<int>(faceSize);
+            }
+            catch (const std::exception&)
+            {
+                wrongCmdArgs = true;
+            }
+        }
+        else if (arg.find("--fly-through=") == 0)
+        {
+            pathFileName = arg.substr(14);
+
+            if (pathFileName == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg.find("--serve=") == 0)
+        {
+            socketPath = arg.substr(8);
+
+            if (socketPath == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg.find("--scene-root=") == 0)
+        {
+            sceneRoot = arg.substr(13);
+
+            if (sceneRoot == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg.find("--scene-cache=") == 0)
+        {
+            try
+            {
+                std::size_t numChars = 0;
+                const unsigned long megaBytes = std::stoul(arg.substr(14), &numChars);
+
+                if (megaBytes == 0 || numChars != arg.size() - 14)
+                    wrongCmdArgs = true;
+                else
+                    maxSceneCacheSize = static_cast<std::size_t>(megaBytes) * 1024 * 1024;
+            }
+            catch (const std::exception&)
+            {
+                wrongCmdArgs = true;
+            }
+        }
+        else if (arg == "-c" || arg == "--cache")
+            projectorOptions.useSphereCache = true;
+        else if (arg.find("--tile-cache=") == 0)
+        {
+            try
+            {
+                std::size_t numChars = 0;
+                const unsigned long megaBytes = std::stoul(arg.substr(13), &numChars);
+
+                if (megaBytes == 0 || numChars != arg.size() - 13)
+                    wrongCmdArgs = true;
+                else
+                    projectorOptions.tileCacheLimit = static_cast<std::size_t>(megaBytes) * 1024 * 1024;
+            }
+            catch (const std::exception&)
+            {
+                wrongCmdArgs = true;
+            }
+        }
+        else if (arg.find("--tile-dir=") == 0)
+        {
+            projectorOptions.tileDirectory = arg.substr(11);
+
+            if (projectorOptions.tileDirectory == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg == "--release-picture")
+            projectorOptions.releasePicture = true;
+        else if (arg == "--memory-report")
+            projectorOptions.reportMemoryUsage = true;
+        else if (arg.find("--shm-output=") == 0)
+        {
+            shmOutputName = arg.substr(13);
+
+            if (shmOutputName == "")
+                wrongCmdArgs = true;
+        }
+        else if (arg == "--latency-report")
+            latencyReport = true;
+        else if (arg == "--sphere-layout=rgba")
+            projectorOptions.sphereLayout = PanoSphereLayout::RGBA;
+        else if (arg == "--sphere-layout=rgb")
+            projectorOptions.sphereLayout = PanoSphereLayout::RGB;
+        else if (arg == "--sphere-layout=planar")
+            projectorOptions.sphereLayout = PanoSphereLayout::Planar;
+        else if (arg.find("-") == 0)
+            wrongCmdArgs = true;
+        else if (picFileName != "")
+            morePicFileNames.push_back(arg);
         else
-            picFileName = args[1];
+            picFileName = arg;
     }
-    else if (args.size() == 3)
-    {
-        if (args[2].find("--pto=") != 0)
-            goto _wrongCmdArg;
 
-        picFileName = args[1];
-        ptoFileName = args[2].substr(6);
-    }
-    else if (args.size() == 4)
-    {
-        if (args[2] != "-p")
-            goto _wrongCmdArg;
+    //At most one mode instead of displaying the panorama scene
+    const int numModes = (ptoFileName != "") + (viewFileName != "") + (dziBaseName != "") + (cubeFaceSize != 0) +
+                         (pathFileName != "") + (socketPath != "");
 
-        picFileName = args[1];
-        ptoFileName = args[3];
+    if (numModes > 1)
+    {
+        std::cerr<<"ERROR: Only one of the options --pto, --render, --export-dzi, --export-cubemap, --fly-through and --serve "
+                   "can be used at once!"<<std::endl;
+        wrongCmdArgs = true;
     }
-    else
+
+    //Multiple pictures only for cube map export, fly-through rendering or render service
+    if (!morePicFileNames.empty() && cubeFaceSize == 0 && pathFileName == "" && socketPath == "")
+        wrongCmdArgs = true;
+
+    if (wrongCmdArgs || picFileName == "")
     {
-        _wrongCmdArg:
         std::cerr<<"ERROR: Wrong or missing command line arguments!\n"<<std::endl;
 
         printHelp();
@@ -132,25 +412,114 @@ int main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
-    //Define PNV file name corresponding to the picture file name (replace extension)
-    std::string pnvFileName;
-    try
+    //Export cube maps of all pictures, if requested, using meta data from the matching PNV files
+    if (cubeFaceSize != 0)
     {
-        std::filesystem::path tPath(picFileName);
-        tPath.replace_extension("pnv");
-        pnvFileName = tPath.string();
+        morePicFileNames.insert(morePicFileNames.begin(), picFileName);
 
-        //If no PTO file was specified, there must be an already existing PNV file
-        if (ptoFileName == "" && !std::filesystem::exists(tPath))
+        std::vector<CubemapExporter::Scene> scenes;
+
+        for (const std::string& tPicFileName : morePicFileNames)
         {
-            std::cerr<<"ERROR: Could not find matching PNV file!"<<std::endl;
+            CubemapExporter::Scene scene;
+
+            if (!loadMatchingPNVFile(tPicFileName, scene.metaData))
+                return EXIT_FAILURE;
+
+            scene.picFileName = tPicFileName;
+            scene.outputBaseName = std::filesystem::path(tPicFileName).replace_extension().string();
+
+            scenes.push_back(std::move(scene));
+        }
+
+        CubemapExporter exporter(cubeFaceSize);
+
+        if (!exporter.run(scenes, projectorOptions))
+        {
+            std::cerr<<"ERROR: Could not export the cube maps of all panorama scenes!"<<std::endl;
             return EXIT_FAILURE;
         }
+
+        return EXIT_SUCCESS;
     }
-    catch (const std::exception& exc)
+
+    //Render fly-throughs of all pictures, if requested, using meta data from the matching PNV files
+    if (pathFileName != "")
     {
-        std::cerr<<"ERROR: Could not find out the PNV file name matching the picture file name!"<<std::endl;
-        std::cerr<<exc.what()<<std::endl;
+        FlyThroughRenderer renderer;
+
+        if (!renderer.loadPathFromFile(pathFileName))
+            return EXIT_FAILURE;
+
+        if (shmOutputName != "")
+            renderer.enableSharedFrameOutput(shmOutputName);
+
+        morePicFileNames.insert(morePicFileNames.begin(), picFileName);
+
+        std::vector<FlyThroughRenderer::Scene> scenes;
+
+        for (const std::string& tPicFileName : morePicFileNames)
+        {
+            FlyThroughRenderer::Scene scene;
+
+            if (!loadMatchingPNVFile(tPicFileName, scene.metaData))
+                return EXIT_FAILURE;
+
+            scene.picFileName = tPicFileName;
+            scene.outputBaseName = std::filesystem::path(tPicFileName).replace_extension().string() + "-frame";
+
+            scenes.push_back(std::move(scene));
+        }
+
+        if (!renderer.run(scenes, projectorOptions))
+        {
+            std::cerr<<"ERROR: Could not render the fly-throughs of all panorama scenes!"<<std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    //Serve render requests, if requested, with the given pictures' panorama scenes loaded in advance
+    if (socketPath != "")
+    {
+        morePicFileNames.insert(morePicFileNames.begin(), picFileName);
+
+        std::unique_ptr<RenderService> service;
+
+        try
+        {
+            service = std::make_unique<RenderService>(maxSceneCacheSize, sceneRoot, projectorOptions);
+        }
+        catch (const std::filesystem::filesystem_error&)
+        {
+            std::cerr<<"ERROR: Could not find scene root directory \"" + sceneRoot + "\"!"<<std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (const std::string& tPicFileName : morePicFileNames)
+            if (!service->preloadScene(tPicFileName))
+                return EXIT_FAILURE;
+
+        if (!service->run(socketPath))
+        {
+            std::cerr<<"ERROR: Could not run the render service!"<<std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    //Define PNV file name corresponding to the picture file name (replace extension)
+    const std::string pnvFileName = getPNVFileName(picFileName);
+
+    if (pnvFileName == "")
+        return EXIT_FAILURE;
+
+    //If no PTO file was specified, there must be an already existing PNV file
+    if (ptoFileName == "" && !std::filesystem::exists(pnvFileName))
+    {
+        std::cerr<<"ERROR: Could not find matching PNV file!"<<std::endl;
         return EXIT_FAILURE;
     }
 
@@ -185,11 +554,51 @@ int main(int argc, const char* argv[])
         }
     }
 
+    //Render views to picture files, if requested, using previously loaded meta data
+    if (viewFileName != "")
+    {
+        BatchRenderer renderer;
+
+        if (!renderer.loadViewsFromFile(viewFileName))
+            return EXIT_FAILURE;
+
+        //Share one panorama sphere pyramid between all rendering threads
+        projectorOptions.releasePicture = true;
+
+        if (!renderer.run(picFileName, metaData, projectorOptions))
+        {
+            std::cerr<<"ERROR: Could not render all views of the panorama scene!"<<std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    //Export Deep Zoom image, if requested, using previously loaded meta data
+    if (dziBaseName != "")
+    {
+        DeepZoomExporter exporter;
+
+        if (!exporter.run(picFileName, metaData, dziBaseName, projectorOptions))
+        {
+            std::cerr<<"ERROR: Could not export the Deep Zoom image!"<<std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
     //Create window and display the panorama scene using previously loaded meta data
 
     PanoramaWindow panoWindow;
 
-    if (!panoWindow.run(picFileName, metaData))
+    if (shmOutputName != "" && !panoWindow.enableSharedFrameOutput(shmOutputName))
+        return EXIT_FAILURE;
+
+    if (latencyReport)
+        panoWindow.enableLatencyReport();
+
+    if (!panoWindow.run(picFileName, metaData, projectorOptions))
     {
         std::cerr<<"ERROR: Could not properly display the panorama scene!"<<std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,438 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "panoramascene.h"
+
+#include "projector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+/*!
+ * \brief Check if a target buffer is valid for rendering.
+ *
+ * \param pOutput Target buffer.
+ * \return If \p pOutput has a non-zero size, a pixel buffer and a stride large enough for a row.
+ */
+bool isValidOutput(const PanoramaScene::OutputBuffer& pOutput)
+{
+    const std::size_t rowLength = PanoramaScene::getBytesPerPixel(pOutput.format) * pOutput.size.x;
+
+    return pOutput.pixels != nullptr && pOutput.size.x != 0 && pOutput.size.y != 0 &&
+           (pOutput.stride == 0 || pOutput.stride >= rowLength);
+}
+
+/*!
+ * \brief Call a function for a range of item indices on several threads.
+ *
+ * Every thread (including the calling one) repeatedly takes the next index until all are done.
+ *
+ * \tparam FunctionT Function type taking a 'std::size_t' index.
+ * \param pNumItems Number of items.
+ * \param pNumThreads Maximum number of threads (including the calling one).
+ * \param pFunction Function to call for every index from 0 to \p pNumItems-1.
+ */
+template<typename FunctionT>
+void runInParallel(const std::size_t pNumItems, const unsigned int pNumThreads, const FunctionT& pFunction)
+{
+    std::atomic<std::size_t> nextItem(0);
+
+    auto processItems = [pNumItems, &nextItem, &pFunction]() -> void
+    {
+        for (std::size_t i = nextItem++; i < pNumItems; i = nextItem++)
+            pFunction(i);
+    };
+
+    std::vector<std::thread> threads;
+
+    for (std::size_t i = 1; i < std::min<std::size_t>(pNumThreads, pNumItems); ++i)
+        threads.emplace_back(processItems);
+
+    processItems();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+} // namespace
+
+/*!
+ * \brief Constructor.
+ *
+ * Sets up the panorama scene for the panorama sphere pyramid \p pSpherePyramid, whose level 0 must be the full resolution
+ * panorama sphere of a Projector for the same scene (see Projector::createScene()). The field of view of the scene is
+ * defined by the angles of the top left and bottom right corners of the cropped picture (as for Projector).
+ *
+ * Uses the same target "oversampling" of 1.5 for choosing the pyramid level as Projector for its panorama sphere.
+ *
+ * \param pSpherePyramid Panorama sphere pyramid of the scene.
+ * \param pFOVTopLeft 'phi' and 'theta' angle of the cropped picture's top left corner.
+ * \param pFOVBottomRight 'phi' and 'theta' angle of the cropped picture's bottom right corner.
+ *
+ * \throws std::invalid_argument \p pSpherePyramid is empty.
+ */
+PanoramaScene::PanoramaScene(std::shared_ptr<const SpherePyramid> pSpherePyramid,
+                             const sf::Vector2f pFOVTopLeft, const sf::Vector2f pFOVBottomRight) :
+    spherePyramid(std::move(pSpherePyramid)),
+    //
+    fovTL(pFOVTopLeft),
+    fovBR(pFOVBottomRight),
+    fovCentHor({fovBR.x - fovTL.x, 2*std::max(fovTL.y, -fovBR.y)}),
+    //
+    minZoomCentHor(std::tan(fovCentHor.y / 2.) / std::tan(std::min(fovTL.y, -fovBR.y))),
+    minZoomNonCentHor(std::tan(fovCentHor.y / 2.) / std::tan((fovTL.y - fovBR.y) / 2.)),
+    //
+    targetOversampling(1.5)
+{
+    if (!spherePyramid || spherePyramid->getNumLevels() == 0)
+        throw std::invalid_argument("Panorama sphere pyramid is empty!");
+}
+
+//Public
+
+/*!
+ * \brief Adjust a perspective to avoid margins for a specific view size.
+ *
+ * Applies the special zoom values and the lower zoom limit as Projector::updateView() and then clips the view
+ * angle offsets as Projector does (both via the same helper functions, see Projector::clipZoom() and
+ * Projector::clipViewOffset()), such that the view of size \p pSize does not include areas that are not
+ * covered by the panorama scene. The horizontal view angle offset of a 360 degree scene is wrapped into [0, 2*pi).
+ *
+ * render() uses this function, so the result tells which perspective is actually rendered for \p pView.
+ *
+ * \param pView Requested perspective.
+ * \param pSize Size of the view.
+ * \return Adjusted perspective.
+ */
+PanoramaScene::ViewState PanoramaScene::fitView(const ViewState& pView, const sf::Vector2u pSize) const
+{
+    ViewState view = pView;
+
+    Projector::clipZoom(view.zoom, view.offsetTheta, minZoomCentHor, minZoomNonCentHor);
+
+    const float aspect = static_cast<float>(pSize.x) / pSize.y;
+    const float tanFOV2 = std::tan(fovCentHor.y / 2.);
+
+    const sf::Vector2f viewFOV(2. * std::atan(tanFOV2 * aspect / view.zoom), 2. * std::atan(tanFOV2 / view.zoom));
+
+    Projector::clipViewOffset(view.offsetPhi, view.offsetTheta, viewFOV, fovCentHor, fovTL, fovBR);
+
+    return view;
+}
+
+/*!
+ * \brief Render a perspective of the panorama scene.
+ *
+ * Fills \p pOutput (in its pixel format and with its row stride, see OutputBuffer) with the rectilinear projection of the
+ * panorama scene for the perspective \p pView after adjusting it to avoid margins (see fitView()).
+ * The result equals the display projection of a Projector with the same display
+ * size and perspective, except that the pixels are sampled from the smallest panorama sphere pyramid level that has
+ * at least the target "oversampling" (see Projector::updateDisplayFOV()) instead of from a re-mapped panorama sphere.
+ * The pixels are written directly to \p pOutput without any intermediate buffer. Padding bytes are not touched.
+ *
+ * This function is thread-safe: it only reads the shared pyramid. The transformations are calculated in bands of
+ * 'batchBandRows' rows (as in renderBatch()) in scratch buffers that are kept per thread, such that repeated calls
+ * on the same thread do not allocate them again and their size only depends on the view width.
+ *
+ * \param pView Perspective to render.
+ * \param pOutput Target buffer.
+ * \return If \p pOutput is valid (non-zero size, pixel buffer set and stride large enough for a row).
+ */
+bool PanoramaScene::render(const ViewState& pView, const OutputBuffer& pOutput) const
+{
+    if (!isValidOutput(pOutput))
+        return false;
+
+    const std::size_t rowLength = getBytesPerPixel(pOutput.format) * pOutput.size.x;
+
+    const sf::Vector2i size(pOutput.size.x, pOutput.size.y);
+
+    const ViewState view = fitView(pView, pOutput.size);
+
+    //Same focal length-like parameter as for a Projector display projection (see Projector::updateDisplayFOV())
+    const float f = size.y / 2. / std::tan(fovCentHor.y / 2.) * view.zoom;
+
+    const int level = selectPyramidLevel(size, f);
+    const sf::Vector2i levelSize = spherePyramid->getLevelSize(level);
+
+    const std::size_t width = static_cast<std::size_t>(size.x);
+    const std::size_t stride = (pOutput.stride != 0 ? pOutput.stride : rowLength);
+
+    //Final transformations to pyramid level positions for this perspective (see Projector::displayTrafoX() and displayTrafoY())
+
+    thread_local std::vector<float> trafosX;
+    thread_local std::vector<float> trafosY;
+
+    trafosX.resize(width+1);
+
+    for (int x = 0; x <= size.x; ++x)
+        trafosX[x] = (Projector::staticDisplayTrafoX(x, size, f) + view.offsetPhi) * levelSize.x / fovCentHor.x;
+
+    for (int firstRow = 0; firstRow < size.y; firstRow += batchBandRows)
+    {
+        const int numRows = std::min(batchBandRows, size.y - firstRow);
+
+        trafosY.resize((width+1) * (numRows+1));
+
+        for (int y = 0; y <= numRows; ++y)
+        {
+            for (int x = 0; x <= size.x; ++x)
+            {
+                trafosY[(width+1)*y + x] = (Projector::staticDisplayTrafoY(firstRow + y, x, size, f) + view.offsetTheta) *
+                                           levelSize.y / fovCentHor.y + levelSize.y / 2.;
+            }
+        }
+
+        Projector::projectRGBAToBuffer(levelSize, spherePyramid->getLevelData(level), numRows, trafosX, trafosY,
+                                       pOutput.pixels + stride * firstRow, stride, pOutput.format);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Render many perspectives of equal size and zoom level in one parallel pass.
+ *
+ * Renders the views with zoom level \p pZoom and the view angle offsets \p pOffsets ('x' being the horizontal and 'y'
+ * the vertical offset, see ViewState) to the corresponding target buffers \p pOutputs, e.g. all frames of a turntable
+ * strip. The result for every view is exactly the same as from render(). All targets must have the same size but can
+ * have different pixel formats and strides.
+ *
+ * Since the zoom level is adjusted independently of the view angle offsets (see fitView()), all views share the
+ * pyramid level to sample from and the expensive, perspective-independent part of the transformations (see
+ * Projector::staticDisplayTrafoX() and Projector::staticDisplayTrafoY()), which is hence calculated only once.
+ * Then all views are rendered in a single pass over bands of 'batchBandRows' rows, which are distributed over
+ * \p pNumThreads threads (or one thread per CPU core if 0). Every band only adds its view angle offsets to the shared
+ * transformations in small scratch buffers kept per thread, such that per view no transformation buffer needs to be allocated.
+ *
+ * Like render(), this function is thread-safe.
+ *
+ * \param pZoom Zoom level of all views (see ViewState).
+ * \param pOffsets View angle offsets of the views.
+ * \param pOutputs Target buffers of the views (same number as \p pOffsets).
+ * \param pNumThreads Number of threads to use (0 for number of CPU cores).
+ * \return If all \p pOutputs are valid (see render()) and have the same size and the numbers of views match.
+ */
+bool PanoramaScene::renderBatch(const float pZoom, const std::vector<sf::Vector2f>& pOffsets, const std::vector<OutputBuffer>& pOutputs,
+                                unsigned int pNumThreads) const
+{
+    if (pOffsets.size() != pOutputs.size())
+        return false;
+
+    if (pOutputs.empty())
+        return true;
+
+    for (const OutputBuffer& output : pOutputs)
+        if (!isValidOutput(output) || output.size != pOutputs.front().size)
+            return false;
+
+    const sf::Vector2i size(pOutputs.front().size.x, pOutputs.front().size.y);
+    const std::size_t width = static_cast<std::size_t>(size.x);
+
+    //Adjusted zoom level is the same for all views
+    std::vector<ViewState> views;
+    views.reserve(pOffsets.size());
+
+    for (const sf::Vector2f offset : pOffsets)
+        views.push_back(fitView(ViewState{pZoom, offset.x, offset.y}, pOutputs.front().size));
+
+    //Same focal length-like parameter as for a Projector display projection (see Projector::updateDisplayFOV())
+    const float f = size.y / 2. / std::tan(fovCentHor.y / 2.) * views.front().zoom;
+
+    const int level = selectPyramidLevel(size, f);
+    const sf::Vector2i levelSize = spherePyramid->getLevelSize(level);
+    const sf::Uint8 *const levelData = spherePyramid->getLevelData(level);
+
+    if (pNumThreads == 0)
+        pNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    //Perspective-independent transformations shared by all views (calculated row by row in parallel)
+
+    std::vector<float> staticTrafosX(width+1, 0);
+    std::vector<float> staticTrafosY((width+1) * (size.y+1), 0);
+
+    for (int x = 0; x <= size.x; ++x)
+        staticTrafosX[x] = Projector::staticDisplayTrafoX(x, size, f);
+
+    runInParallel(static_cast<std::size_t>(size.y) + 1, pNumThreads,
+                  [size, f, width, &staticTrafosY](const std::size_t pY) -> void
+                  {
+                      const int y = static_cast<int>(pY);
+
+                      for (int x = 0; x <= size.x; ++x)
+                          staticTrafosY[(width+1)*pY + x] = Projector::staticDisplayTrafoY(y, x, size, f);
+                  });
+
+    //Render all bands of all views, adding the view angle offsets to the shared transformations (as in render())
+
+    const std::size_t numBands = (static_cast<std::size_t>(size.y) + batchBandRows - 1) / batchBandRows;
+
+    runInParallel(views.size() * numBands, pNumThreads,
+                  [this, &views, &pOutputs, numBands, size, width, levelSize, levelData,
+                   &staticTrafosX, &staticTrafosY](const std::size_t pItem) -> void
+                  {
+                      const ViewState& view = views[pItem / numBands];
+                      const OutputBuffer& output = pOutputs[pItem / numBands];
+
+                      const int firstRow = static_cast<int>(pItem % numBands) * batchBandRows;
+                      const int numRows = std::min(batchBandRows, size.y - firstRow);
+
+                      thread_local std::vector<float> trafosX;
+                      thread_local std::vector<float> trafosY;
+
+                      trafosX.resize(width+1);
+                      trafosY.resize((width+1) * (numRows+1));
+
+                      for (std::size_t x = 0; x <= width; ++x)
+                          trafosX[x] = (staticTrafosX[x] + view.offsetPhi) * levelSize.x / fovCentHor.x;
+
+                      for (int y = 0; y <= numRows; ++y)
+                      {
+                          for (std::size_t x = 0; x <= width; ++x)
+                          {
+                              trafosY[(width+1)*y + x] = (staticTrafosY[(width+1)*(firstRow+y) + x] + view.offsetTheta) *
+                                                         levelSize.y / fovCentHor.y + levelSize.y / 2.;
+                          }
+                      }
+
+                      const std::size_t stride = (output.stride != 0 ? output.stride : getBytesPerPixel(output.format) * width);
+
+                      Projector::projectRGBAToBuffer(levelSize, levelData, numRows, trafosX, trafosY,
+                                                     output.pixels + stride * firstRow, stride, output.format);
+                  });
+
+    return true;
+}
+
+//
+
+/*!
+ * \brief Calculate the zoom level needed to obtain a specific horizontal field of view.
+ *
+ * See Projector::getRequiredZoomFromHFOV().
+ *
+ * \param pHFOV Desired horizontal field of view.
+ * \param pSize Size of the view.
+ * \return Required zoom level.
+ */
+float PanoramaScene::getRequiredZoomFromHFOV(const float pHFOV, const sf::Vector2u pSize) const
+{
+    const float aspect = static_cast<float>(pSize.x) / pSize.y;
+
+    return std::tan(fovCentHor.y / 2.) * aspect / std::tan(pHFOV / 2.);
+}
+
+/*!
+ * \brief Calculate the zoom level needed to obtain a specific vertical field of view.
+ *
+ * See Projector::getRequiredZoomFromVFOV().
+ *
+ * \param pVFOV Desired vertical field of view.
+ * \return Required zoom level.
+ */
+float PanoramaScene::getRequiredZoomFromVFOV(const float pVFOV) const
+{
+    return std::tan(fovCentHor.y / 2.) / std::tan(pVFOV / 2.);
+}
+
+/*!
+ * \brief Get the size of the panorama sphere pyramid data.
+ *
+ * Counts all levels, no matter whether they were built in memory or are memory-mapped from a cache file
+ * (unlike SpherePyramid::getMemoryUsage()), as mapped levels occupy memory as well while being rendered.
+ *
+ * \return Size of all pyramid levels in bytes.
+ */
+std::size_t PanoramaScene::getDataSize() const
+{
+    std::size_t bytes = 0;
+
+    for (int level = 0; level < spherePyramid->getNumLevels(); ++level)
+    {
+        const sf::Vector2i levelSize = spherePyramid->getLevelSize(level);
+        bytes += 4 * static_cast<std::size_t>(levelSize.x) * static_cast<std::size_t>(levelSize.y);
+    }
+
+    return bytes;
+}
+
+//
+
+/*!
+ * \brief Get the number of bytes per pixel of a pixel format.
+ *
+ * \param pFormat Pixel format.
+ * \return Bytes per pixel (4 for "rgba"/"bgra", 3 for "rgb" and 1 for gray).
+ */
+std::size_t PanoramaScene::getBytesPerPixel(const PixelFormat pFormat)
+{
+    switch (pFormat)
+    {
+        case PixelFormat::RGB:
+            return 3;
+        case PixelFormat::Gray:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
+//Private
+
+/*!
+ * \brief Select the pyramid level to sample for a view.
+ *
+ * Chooses the smallest pyramid level that still yields the target "oversampling" for a view of size \p pSize
+ * with the focal length-like parameter \p pF (lowest oversampling at top left corner, see Projector::updateDisplayFOV()).
+ *
+ * \param pSize Size of the view.
+ * \param pF Focal length-like parameter of the view (see Projector::staticDisplayTrafoX()).
+ * \return Pyramid level.
+ */
+int PanoramaScene::selectPyramidLevel(const sf::Vector2i pSize, const float pF) const
+{
+    const sf::Vector2i fullSize = spherePyramid->getLevelSize(0);
+
+    const float over = std::min((Projector::staticDisplayTrafoX(1, pSize, pF) - Projector::staticDisplayTrafoX(0, pSize, pF)) *
+                                fullSize.x / fovCentHor.x,
+                                (Projector::staticDisplayTrafoY(1, 0, pSize, pF) - Projector::staticDisplayTrafoY(0, 0, pSize, pF)) *
+                                fullSize.y / fovCentHor.y);
+
+    sf::Vector2i minSize = fullSize;
+
+    if (over > targetOversampling)
+    {
+        minSize.x = static_cast<int>(std::ceil(fullSize.x * targetOversampling / over));
+        minSize.y = static_cast<int>(std::ceil(fullSize.y * targetOversampling / over));
+    }
+
+    return spherePyramid->selectLevel(minSize);
+}
@@ -0,0 +1,109 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_PANORAMASCENE_H
+#define SPNV_PANORAMASCENE_H
+
+#include "projector.h"
+#include "spherepyramid.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*!
+ * \brief Immutable panorama scene for rendering arbitrary perspectives concurrently from many threads.
+ *
+ * Unlike Projector, which combines the panorama scene with a mutable perspective, display size and display buffer,
+ * this class only holds the immutable scene: its field of view limits and a shared panorama sphere pyramid (see
+ * SpherePyramid). All perspective information is passed to render() as a ViewState and the result is written to a
+ * caller-provided OutputBuffer. Since render() is const and does not modify any shared data, any number of threads
+ * can render different views of the same scene at the same time, while the panorama sphere is kept in memory only once.
+ *
+ * A scene is obtained from a Projector with a panorama sphere pyramid (see Projector::createScene()).
+ *
+ * The perspective is handled exactly as by Projector::updateView() (zoom level, view angle offsets and automatic
+ * adjustment to avoid margins, see fitView()), such that the same ViewState values can be used with both classes.
+ * Instead of re-mapping a panorama sphere of suitable resolution, the smallest sufficient pyramid level is sampled directly.
+ *
+ * Many views of equal size and zoom level that only differ in their view angle offsets (e.g. a turntable strip) can be
+ * rendered together with renderBatch(), which computes their common transformations only once.
+ */
+class PanoramaScene
+{
+public:
+    /*!
+     * \brief Perspective of a rendered view.
+     *
+     * See Projector::updateView().
+     */
+    struct ViewState
+    {
+        float zoom = 0;         ///< Zoom level (or 0 for the minimum zoom or -1 for the minimum zoom with centered horizon).
+        float offsetPhi = 0;    ///< Horizontal view angle offset.
+        float offsetTheta = 0;  ///< Vertical view angle offset.
+    };
+
+    using OutputBuffer = ::OutputBuffer;    ///< Caller-provided target buffer of a rendered view (same as for Projector::renderInto()).
+
+public:
+    PanoramaScene(std::shared_ptr<const SpherePyramid> pSpherePyramid,
+                  sf::Vector2f pFOVTopLeft, sf::Vector2f pFOVBottomRight);              ///< Constructor.
+    //
+    ViewState fitView(const ViewState& pView, sf::Vector2u pSize) const;                ///< \brief Adjust a perspective to avoid
+                                                                                        ///  margins for a specific view size.
+    bool render(const ViewState& pView, const OutputBuffer& pOutput) const;             ///< Render a perspective of the panorama scene.
+    bool renderBatch(float pZoom, const std::vector<sf::Vector2f>& pOffsets, const std::vector<OutputBuffer>& pOutputs,
+                     unsigned int pNumThreads = 0) const;                               ///< \brief Render many perspectives of equal size
+                                                                                        ///  and zoom level in one parallel pass.
+    //
+    float getRequiredZoomFromHFOV(float pHFOV, sf::Vector2u pSize) const;   ///< \brief Calculate the zoom level needed to obtain
+                                                                            ///  a specific horizontal field of view.
+    float getRequiredZoomFromVFOV(float pVFOV) const;                       ///< \brief Calculate the zoom level needed to obtain
+                                                                            ///  a specific vertical field of view.
+    std::size_t getDataSize() const;                                        ///< Get the size of the panorama sphere pyramid data.
+    //
+    static std::size_t getBytesPerPixel(PixelFormat pFormat);               ///< Get the number of bytes per pixel of a pixel format.
+
+private:
+    int selectPyramidLevel(sf::Vector2i pSize, float pF) const;     ///< Select the pyramid level to sample for a view.
+
+private:
+    static constexpr int batchBandRows = 32;        ///< Number of rows rendered at once by render() and renderBatch() (see there).
+
+private:
+    const std::shared_ptr<const SpherePyramid> spherePyramid;   //Multi-resolution panorama sphere (level 0 at full picture resolution)
+    //
+    const sf::Vector2f fovTL;                       //Horizontal/vertical FOV angle corresponding to top left corner of cropped picture
+    const sf::Vector2f fovBR;                       //Horizontal/vertical FOV angle corresponding to bottom right corner of cropped picture
+    const sf::Vector2f fovCentHor;                  //Maximum symmetric FOV covered by cropped picture (possibly with one-sided margin)
+    //
+    const float minZoomCentHor;                     //Minimal allowed zoom for views without margins (given centered horizon)
+    const float minZoomNonCentHor;                  //Minimal allowed zoom for views without margins ("optimal" theta angle)
+    //
+    const float targetOversampling;                 //Minimal pyramid level to view oversampling (see Projector::updateDisplayFOV())
+};
+
+#endif // SPNV_PANORAMASCENE_H
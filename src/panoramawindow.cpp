@@ -25,6 +25,9 @@
 #include "version.h"
 
 #include <SFML/Graphics/View.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Sleep.hpp>
+#include <SFML/System/Time.hpp>
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Window/Event.hpp>
 #include <SFML/Window/Keyboard.hpp>
@@ -32,9 +35,16 @@
 #include <SFML/Window/VideoMode.hpp>
 #include <SFML/Window/WindowStyle.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <exception>
+#include <filesystem>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <utility>
 
 /*!
  * \brief Constructor.
@@ -48,27 +58,93 @@ PanoramaWindow::PanoramaWindow() :
     //
     panoTexture(),
     panoSprite(),
+    panoTextureOutdated(true),
+    textureUploadBuffer(),
+    textureZoom(1),
+    textureOffsetPhi(0),
+    textureOffsetTheta(0),
+    textureFocalLength(1),
     //
     projector(nullptr),
+    projectorIsPreview(false),
+    lastProjectionTime(sf::Time::Zero),
+    viewChange(),
+    viewChangeGeneration(0),
     //
-    mouseDragLockThetaAngle(false)
+    inputGeneration(0),
+    //
+    mouseDragLockThetaAngle(false),
+    //
+    frameOutput(nullptr),
+    latencyRecorder(nullptr)
 {
 }
 
 //Public
 
+/*!
+ * \brief Additionally hand every displayed frame to another process.
+ *
+ * Creates a shared memory triple buffer named \p pName (see SharedFrameOutput), to which every frame is
+ * published right before displaying it (see renderPanoramaView()), together with its perspective and timestamps.
+ * Frames can hence be taken by a local consumer (e.g. a video compositor) independently of the window.
+ *
+ * The maximum frame size is the largest of the desktop and fullscreen resolutions. Larger frames are skipped.
+ *
+ * \param pName Name of the shared memory object.
+ * \return If the shared memory object could be created.
+ */
+bool PanoramaWindow::enableSharedFrameOutput(const std::string& pName)
+{
+    sf::Vector2u maxSize(sf::VideoMode::getDesktopMode().width, sf::VideoMode::getDesktopMode().height);
+
+    for (const sf::VideoMode& mode : sf::VideoMode::getFullscreenModes())
+    {
+        maxSize.x = std::max(maxSize.x, mode.width);
+        maxSize.y = std::max(maxSize.y, mode.height);
+    }
+
+    try
+    {
+        frameOutput = std::make_unique<SharedFrameOutput>(pName, maxSize);
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not set up the shared memory frame output!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return false;
+    }
+
+    std::cout<<"Publishing frames to shared memory object \""<<frameOutput->getName()<<"\".\n";
+
+    return true;
+}
+
+/*!
+ * \brief Measure input-to-photon latencies and print them after closing the window.
+ *
+ * Every input event that changes the perspective (mouse drag, mouse wheel and keys, see run()) is then stamped
+ * when it is taken from the event queue, and its latency is measured until the first complete frame including it
+ * is displayed (see LatencyRecorder and renderPanoramaView()). The latency report is printed to stdout when run() returns.
+ */
+void PanoramaWindow::enableLatencyReport()
+{
+    latencyRecorder = std::make_unique<LatencyRecorder>();
+}
+
 /*!
  * \brief Display a picture as panorama scene in a window.
  *
  * Creates a new window to display the panorama scene shown in picture \p pFileName. Required meta information
  * about the scene (such as field of view etc.) is taken from \p pSceneMetaData (see SceneMetaData) and passed
- * to Projector, which takes care of all the graphics transformations (see also Projector()).
+ * to Projector, which takes care of all the graphics transformations (see also Projector()). Optional settings
+ * for picture loading and panorama sphere storage can be passed to Projector via \p pProjectorOptions.
  *
  * The scene perspective can be changed via mouse or keyboard in the following ways:
  *
  * - Mouse drag (click + move): Self-explanatory.
  * - Mouse scroll or plus and minus keys: Zoom in and out (and move vertical view angle if necessary to avoid margins).
- * - Arrow keys left/right/up/down: Move view angle left/right/up/down about 5 degrees.
+ * - Arrow keys left/right/up/down: Move view angle left/right/up/down while held (accelerating and slowing down smoothly).
  * - Space key: Vertically center horizon line and adjust zoom if necessary to avoid margins.
  * - CTRL+'0': Vertically center horizon line and adjust zoom to minimum possible one given the centered horizon.
  * - '0': Adjust zoom to minimum possible and move vertical view angle if necessary to avoid margins (then possibly non-centered horizon).
@@ -79,30 +155,51 @@ PanoramaWindow::PanoramaWindow() :
  * The screen is re-drawn using an updated display projection after every of the aforementioned
  * movements/changes as well as every time the window is resized (which keeps the vertical field
  * of view constant and adjusts the horizontal field of view according to the new aspect ratio).
+ * While resizing the window, the last frame is only stretched to the new window height and the display projection
+ * is adjusted to the new window size once no further resize event arrived for 'resizeSettleTime'.
+ * During mouse drag the display projection is only updated after the mouse was moved and at most 'maxFrameRate'
+ * times per second (in addition to vertical synchronization); meanwhile the thread sleeps instead of polling for events.
+ * The movement via held arrow keys is simulated in fixed time steps ('keyNavStepRate' per second) with a velocity that
+ * ramps up to 'keyNavMaxSpeed' within 'keyNavRampTime' and down again after releasing the keys. The display projection
+ * is then updated once per frame slot as well, independently of repeated key press events.
+ * If the mouse is released during a fast mouse drag, the perspective keeps gliding with the last drag velocity, which
+ * decays exponentially with time constant 'coastDecayTime' (inertial panning). While a gliding frame is shown, the
+ * projection of the next one is already calculated on another thread (overlapping the wait for vertical synchronization).
+ * Any other interaction than mouse movement abandons that projection, if it is still running (see Projector::cancelDisplayUpdate()).
+ * During mouse drag, keyboard navigation and inertial panning, frames that take longer than 'frameDeadline' to project
+ * are presented partially: the display projection is calculated from the center outwards and the outer part
+ * keeps the previous frame (see Projector::setDisplayTimeLimit()). The full frame is completed once the movement stops.
+ * If projecting takes long nevertheless, mouse drag and zooming first show the previous frame warped to the new perspective
+ * (see changeView()). Events are handled and further warped frames are shown while the exact frame is projected on another
+ * thread; a projection that is outdated by a newer perspective is abandoned. Other interactions wait for it to finish.
  *
  * The window can be closed again via your preferred operating system functions or by pressing CTRL+'W'.
  *
+ * The current perspective can be saved as PNG file at several times the window resolution by pressing CTRL+'P' (see savePoster()).
+ *
  * Fullscreen mode of the window can be toggled by pressing 'F' or F11.
  *
+ * The window is created right away and the picture is loaded on a background thread (see loadProjectors()).
+ * Until then, only closing and resizing the window is possible. For large pictures a coarse preview is shown
+ * first, which is replaced by the full resolution scene (keeping the current perspective) as soon as possible.
+ * If the window is closed while loading, the loading thread is cancelled after its current stage and this function waits for it.
+ *
+ * If requested via ProjectorOptions::reportMemoryUsage, the memory usage of the full resolution
+ * Projector is printed to stdout before returning (see Projector::getMemoryUsageReport()).
+ * Likewise, the input-to-photon latencies are printed, if enabled (see enableLatencyReport()).
+ *
  * \param pFileName Panorama picture to load.
  * \param pSceneMetaData Meta data for panorama scene from \p pFileName.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage (see ProjectorOptions).
  * \return If could successfully load \p pFileName (and picture dimensions match information from \p pSceneMetaData).
  */
-bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSceneMetaData)
+bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSceneMetaData, const ProjectorOptions& pProjectorOptions)
 {
-    //Create a new projector for the current panorama scene
-    try
-    {
-        projector = std::make_unique<Projector>(pFileName, pSceneMetaData);
-    }
-    catch (const std::runtime_error& exc)
-    {
-        std::cerr<<"ERROR: "<<exc.what()<<std::endl;
-        return false;
-    }
-
     fileName = pFileName;
 
+    projector.reset();
+    projectorIsPreview = false;
+
     //Setup a window
 
     bool fullscreenMode = false;
@@ -111,21 +208,42 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
 
     sf::Vector2u currentWindowSize = window.getSize();
 
-    //Initialize panorama scene with current window size and reset perspective
+    window.clear();
+    window.display();
+
+    //Set proper window title (indicates loading)
+    updateWindowTitle();
+
+    //Load picture and create projectors for the current panorama scene on a background thread (see loadProjectors())
 
-    updateDisplaySize();
+    std::promise<std::unique_ptr<Projector>> previewPromise;
+    std::promise<std::unique_ptr<Projector>> fullPromise;
 
-    projector->updateView(0, 0, 0);
+    std::future<std::unique_ptr<Projector>> previewFuture = previewPromise.get_future();
+    std::future<std::unique_ptr<Projector>> fullFuture = fullPromise.get_future();
 
-    renderPanoramaView();
+    const sf::Vector2u loadingDisplaySize = currentWindowSize;
 
-    //Set proper window title
-    updateWindowTitle();
+    //Shared with the loading thread and its projectors, such that also a running panorama sphere mapping can be abandoned
+    const auto loadingCancelled = std::make_shared<std::atomic<bool>>(false);
+
+    ProjectorOptions loadingOptions = pProjectorOptions;
+    loadingOptions.cancelFlag = loadingCancelled;
+
+    std::thread loadingThread(&PanoramaWindow::loadProjectors, pFileName, pSceneMetaData, loadingOptions,
+                              loadingDisplaySize, std::move(previewPromise), std::move(fullPromise));
+
+    bool loading = true;
+    bool loadingFailed = false;
 
     //Event loop control flags for performance-intensive "continuous" user interactions (see below)
     bool windowResizing = false;
     bool mouseDragging = false;
 
+    //Helper variables for deferring the projection resize until the window size settles
+    sf::Clock resizeClock;
+    sf::Vector2u stretchedWindowSize = currentWindowSize;
+
     //Helper variables for view angle manipulation via mouse drag
     sf::Vector2f dragInitialMouseAngle;
     sf::Vector2i dragCurrentMousePos;
@@ -133,6 +251,119 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
     double dragInitialViewOffsetPhi = 0;
     bool dragWaitForWrap = false;   //Skip mouse move events until current event's mouse position matches set mouse position again
 
+    //Helper variable for updating the perspective during mouse drag only after the mouse moved
+    sf::Vector2i dragRenderedMousePos;
+
+    //Helper variables for view angle manipulation via held arrow keys (angular velocity in radians per second)
+    bool keyNavLeft = false, keyNavRight = false, keyNavUp = false, keyNavDown = false;
+    sf::Vector2f keyNavVelocity;
+    sf::Clock keyNavClock;
+    sf::Time keyNavLag;     //Elapsed time not yet simulated in fixed time steps
+
+    const sf::Time keyNavTimeStep = sf::microseconds(1000000 / keyNavStepRate);
+
+    //Helper variables for pacing the perspective updates of mouse drag and keyboard navigation (at most once per frame slot)
+    sf::Clock frameClock;
+    const sf::Time frameInterval = sf::microseconds(1000000 / maxFrameRate);
+
+    //Helper variables for inertial panning after mouse drag (angular velocities in radians per second)
+    sf::Vector2f dragVelocity;              //Smoothed view angle velocity during mouse drag
+    sf::Clock dragVelocityClock;            //Time since last perspective update during mouse drag
+    bool coasting = false;                  //Perspective keeps gliding after mouse drag
+    sf::Vector2f coastVelocity;
+    sf::Clock coastClock;                   //Time since inertial panning started
+    sf::Time coastTime;                     //Time on 'coastClock' at which the last simulated perspective is to be shown
+    sf::Time coastLag;                      //Simulated time not yet covered by fixed time steps
+    bool coastFrameReady = false;           //Projector already holds the next coasting frame (see 'coastPrerender')
+    std::future<bool> coastPrerender;       //Projection of the next coasting frame on another thread (true if vertically clipped)
+    std::uint64_t coastPrerenderGeneration = 0;     //View generation projected by 'coastPrerender'
+
+    //Perspective and simulation state of the displayed coasting frame (for rolling back the next one, see below)
+    sf::Vector2f coastShownOffset;
+    sf::Vector2f coastShownVelocity;
+    sf::Time coastShownTime, coastShownLag;
+
+    /*
+     * Lambda for waiting for the projection of the next coasting frame (see below), optionally abandoning it.
+     * While 'coastPrerender' is valid, only its thread uses the projector; everything else (including the simulation state)
+     * is only accessed on this thread and the projector may only be used again after calling this lambda.
+     * Abandoning it rolls the projector back to the perspective of the displayed frame, because an interrupting input
+     * (e.g. starting a mouse drag) refers to what is visible and not to the prerendered frame that was never shown.
+     * The rollback keeps the frame deadline, as it is on the input path; the remainder is completed later (see below).
+     */
+    auto finishCoastPrerender = [&](const bool pAbandon) -> void
+    {
+        if (!coastPrerender.valid())
+            return;
+
+        if (pAbandon && coastPrerender.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            projector->cancelDisplayUpdate();
+
+        //Stop vertical movement at the upper or lower limit of the scene
+        const bool clipped = coastPrerender.get();
+
+        if (pAbandon)
+        {
+            coastVelocity = coastShownVelocity;
+            coastTime = coastShownTime;
+            coastLag = coastShownLag;
+            coastFrameReady = false;
+
+            //Re-project the displayed frame (only the central part of a slow one; the texture still shows all of it)
+            projector->setDisplayTimeLimit(sf::milliseconds(frameDeadline));
+            projector->updateView(projector->getZoom(), coastShownOffset.x, coastShownOffset.y);
+
+            return;
+        }
+
+        if (clipped)
+            coastVelocity.y = 0;
+
+        //Perspective is kept but needs to be projected again for showing it
+        if (!projector->isDisplayDataComplete())
+            coastFrameReady = false;
+    };
+
+    //Lambda for checking if an event changes or stops the gliding perspective (see inertial panning below)
+    auto eventInterruptsCoasting = [](const sf::Event& pEvent) -> bool
+    {
+        switch (pEvent.type)
+        {
+            case sf::Event::Closed:
+            case sf::Event::Resized:
+            case sf::Event::MouseButtonPressed:
+            case sf::Event::MouseWheelScrolled:
+                return true;
+            case sf::Event::KeyPressed:
+            {
+                //All handled keys except toggling the locked theta angle mode use the projector
+                switch (pEvent.key.code)
+                {
+                    case sf::Keyboard::Key::Left:
+                    case sf::Keyboard::Key::Right:
+                    case sf::Keyboard::Key::Up:
+                    case sf::Keyboard::Key::Down:
+                    case sf::Keyboard::Key::Space:
+                    case sf::Keyboard::Key::Add:
+                    case sf::Keyboard::Key::Subtract:
+                    case sf::Keyboard::Key::Num0:
+                    case sf::Keyboard::Key::Numpad0:
+                    case sf::Keyboard::Key::H:
+                    case sf::Keyboard::Key::V:
+                    case sf::Keyboard::Key::F:
+                    case sf::Keyboard::Key::F11:
+                    case sf::Keyboard::Key::P:
+                    case sf::Keyboard::Key::W:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+            default:
+                return false;
+        }
+    };
+
     //Lambda for enabling view angle manipulation via mouse drag
     auto enableMouseDragging = [&]() -> void
     {
@@ -144,12 +375,134 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
 
         dragCurrentMousePos = sf::Mouse::getPosition(window);
 
-        dragInitialMouseAngle = projector->getViewAngle(dragCurrentMousePos);
+        //Current perspective already corresponds to this mouse position
+        dragRenderedMousePos = dragCurrentMousePos;
+
+        dragInitialMouseAngle = projector->getViewAngle(mapWindowToDisplay(dragCurrentMousePos));
 
         dragInitialViewOffsetPhi = projector->getOffsetPhi();
         dragInitialViewOffsetTheta = projector->getOffsetTheta();
     };
 
+    //Lambda for checking if the mouse was moved during mouse drag since the perspective was last updated
+    auto dragRenderPending = [&]() -> bool
+    {
+        return mouseDragging && dragCurrentMousePos != dragRenderedMousePos;
+    };
+
+    //Lambda for checking if the perspective is moving due to held arrow keys (or still slowing down after releasing them)
+    auto keyNavActive = [&]() -> bool
+    {
+        return keyNavLeft || keyNavRight || keyNavUp || keyNavDown || keyNavVelocity.x != 0 || keyNavVelocity.y != 0;
+    };
+
+    //Lambda for calculating the current vertical field of view (measured at the horizontal center of the view);
+    //uses the size of the display projection, which differs from the window size while resizing the window
+    auto getViewHeightAngle = [&]() -> float
+    {
+        const sf::Vector2u displaySize = panoTexture.getSize();
+        const sf::Vector2i viewCenterBottom(displaySize.x / 2, displaySize.y);
+
+        return projector->getViewAngle(viewCenterBottom).y - projector->getViewAngle({viewCenterBottom.x, 0}).y;
+    };
+
+    /*
+     * Lambda for advancing the gliding perspective in fixed time steps to the time at which it will be shown, i.e. now plus
+     * \p pAhead (returns the view angle change). The simulated time follows the measured time between the calls (limited
+     * to a maximum step), so the gliding speed does not depend on the actually achieved frame rate.
+     */
+    auto advanceCoasting = [&](const sf::Time pAhead) -> sf::Vector2f
+    {
+        const float dt = keyNavTimeStep.asSeconds();
+        const float decay = std::exp(-dt / coastDecayTime);
+
+        const sf::Time showTime = coastClock.getElapsedTime() + pAhead;
+
+        coastLag = std::min(coastLag + std::max(showTime - coastTime, sf::Time::Zero), sf::milliseconds(250));
+        coastTime = std::max(coastTime, showTime);
+
+        sf::Vector2f deltaAngle(0, 0);
+
+        for (; coastLag >= keyNavTimeStep; coastLag -= keyNavTimeStep)
+        {
+            coastVelocity.x *= decay;
+            coastVelocity.y *= decay;
+
+            deltaAngle.x += coastVelocity.x * dt;
+            deltaAngle.y += coastVelocity.y * dt;
+        }
+
+        //Stop when hardly moving anymore
+        if (std::hypot(coastVelocity.x, coastVelocity.y) < coastStopSpeed * getViewHeightAngle())
+            coasting = false;
+
+        return deltaAngle;
+    };
+
+    //Lambda for stamping an input event that changes the perspective (see enableLatencyReport());
+    //every input starts a new view generation, which frames projected afterwards include
+    auto recordInput = [this](const LatencyRecorder::Interaction pInteraction) -> void
+    {
+        ++inputGeneration;
+
+        if (latencyRecorder)
+            latencyRecorder->recordInput(pInteraction, inputGeneration);
+    };
+
+    //Lambda for waiting for a perspective changed on another thread (see changeView()) and showing its exact frame
+    auto showViewChange = [this]() -> void
+    {
+        if (finishViewChange(false))
+        {
+            updateWindowTitle();
+            renderPanoramaView(std::function<void()>(), viewChangeGeneration);
+        }
+    };
+
+    //Lambda for holding or releasing an arrow key (returns false for other keys)
+    auto setKeyNavKey = [&](const sf::Keyboard::Key pKey, const bool pHeld) -> bool
+    {
+        //Keyboard navigation stops inertial panning
+        if (pHeld && (pKey == sf::Keyboard::Key::Left || pKey == sf::Keyboard::Key::Right ||
+                      pKey == sf::Keyboard::Key::Up || pKey == sf::Keyboard::Key::Down))
+        {
+            coasting = false;
+        }
+
+        //Start simulating from now on if the perspective was not moving before
+        if (pHeld && !keyNavActive())
+        {
+            keyNavClock.restart();
+            keyNavLag = sf::Time::Zero;
+        }
+
+        switch (pKey)
+        {
+            case sf::Keyboard::Key::Left:
+            {
+                keyNavLeft = pHeld;
+                return true;
+            }
+            case sf::Keyboard::Key::Right:
+            {
+                keyNavRight = pHeld;
+                return true;
+            }
+            case sf::Keyboard::Key::Up:
+            {
+                keyNavUp = pHeld;
+                return true;
+            }
+            case sf::Keyboard::Key::Down:
+            {
+                keyNavDown = pHeld;
+                return true;
+            }
+            default:
+                return false;
+        }
+    };
+
     //Reset locked theta angle mouse drag mode
     mouseDragLockThetaAngle = false;
 
@@ -163,11 +516,29 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
          * - blocking wait for "normal" operation to reduce CPU load from top-level while loop, or
          * - non-blocking wait when "continuous" user interactions are going on, because actual logic
          *   for those is done below the event loop (hence need to exit the loop) in order to skip
-         *   unnecessary, expensive recalculations for each of many consecutive events.
+         *   unnecessary, expensive recalculations for each of many consecutive events, or when
+         *   the picture is still loading in the background (need to check progress regularly).
+         * Note that a held mouse drag without mouse movement since the last update does not count as
+         * "continuous" interaction, such that the loop blocks until the next input instead of spinning.
          */
-        while ((!(mouseDragging || windowResizing) && window.waitEvent(event)) ||
-               ( (mouseDragging || windowResizing) && window.pollEvent(event)))
+        while ((!(dragRenderPending() || keyNavActive() || coasting || windowResizing || loading || viewChange.valid()) &&
+                window.waitEvent(event)) ||
+               ( (dragRenderPending() || keyNavActive() || coasting || windowResizing || loading || viewChange.valid()) &&
+                window.pollEvent(event)))
         {
+            //Only closing and resizing the window is possible before a (preview) projector is available
+            if (!projector && event.type != sf::Event::Closed && event.type != sf::Event::Resized)
+                continue;
+
+            //Interactions that change or stop the gliding perspective (see inertial panning below) abandon an outdated
+            //projection of the next coasting frame instead of waiting for it to finish; other events leave it running
+            if (eventInterruptsCoasting(event))
+                finishCoastPrerender(true);
+
+            //Only mouse drag and zooming keep going while a changed perspective is projected on another thread (see changeView())
+            if (event.type != sf::Event::MouseMoved && event.type != sf::Event::MouseWheelScrolled)
+                showViewChange();
+
             switch (event.type)
             {
                 case sf::Event::Closed:
@@ -177,13 +548,17 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                 }
                 case sf::Event::Resized:
                 {
-                    //Do not resize scene here, but set resize flag so that resizing will be handled once below the event loop after all
-                    //pending events have been processed (this ignores/groups consecutive resize events of a single resize operation)
+                    //Do not resize scene here, but set resize flag so that resizing will be handled below the event loop once
+                    //no further resize events arrived for a while (this groups consecutive resize events of a single resize operation)
                     windowResizing = true;
+                    resizeClock.restart();
                     break;
                 }
                 case sf::Event::MouseWheelScrolled:
                 {
+                    if (event.mouseWheelScroll.delta != 0)
+                        recordInput(LatencyRecorder::Interaction::Wheel);
+
                     if (event.mouseWheelScroll.delta > 0)
                         zoomIn();
                     else if (event.mouseWheelScroll.delta < 0)
@@ -196,14 +571,35 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                     //Enable view angle manipulation via mouse movement, which will be handled below the event loop each time when all
                     //pending events have been processed (this groups/ignores small consecutive move events from continuous mouse movement)
                     if (event.mouseButton.button == sf::Mouse::Button::Left)
+                    {
+                        coasting = false;
+
                         enableMouseDragging();
+
+                        dragVelocity = sf::Vector2f(0, 0);
+                        dragVelocityClock.restart();
+                    }
                     break;
                 }
                 case sf::Event::MouseButtonReleased:
                 {
-                    //Disable view angle manipulation via mouse movement again
-                    if (event.mouseButton.button == sf::Mouse::Button::Left)
+                    //Disable view angle manipulation via mouse movement again, but let the perspective keep gliding
+                    //if the mouse was still moving fast enough when released (see inertial panning below)
+                    if (event.mouseButton.button == sf::Mouse::Button::Left && mouseDragging)
+                    {
                         mouseDragging = false;
+
+                        if (dragVelocityClock.getElapsedTime() < sf::milliseconds(coastReleaseWindow) &&
+                                std::hypot(dragVelocity.x, dragVelocity.y) > coastStopSpeed * getViewHeightAngle())
+                        {
+                            coasting = true;
+                            coastVelocity = dragVelocity;
+                            coastClock.restart();
+                            coastTime = sf::Time::Zero;
+                            coastLag = sf::Time::Zero;
+                            coastFrameReady = false;
+                        }
+                    }
                     break;
                 }
                 case sf::Event::MouseMoved:
@@ -224,6 +620,8 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
 
                         dragCurrentMousePos.x = event.mouseMove.x;
                         dragCurrentMousePos.y = event.mouseMove.y;
+
+                        recordInput(LatencyRecorder::Interaction::Drag);
                     }
                     break;
                 }
@@ -232,43 +630,28 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                     switch (event.key.code)
                     {
                         case sf::Keyboard::Key::Left:
-                        {
-                            //Turn perspective to the left (fixed step size)
-                            projector->updateView(projector->getZoom(),
-                                                  projector->getOffsetPhi() - 5.*M_PI/180.,
-                                                  projector->getOffsetTheta());
-                            renderPanoramaView();
-                            break;
-                        }
                         case sf::Keyboard::Key::Right:
-                        {
-                            //Turn perspective to the right (fixed step size)
-                            projector->updateView(projector->getZoom(),
-                                                  projector->getOffsetPhi() + 5.*M_PI/180.,
-                                                  projector->getOffsetTheta());
-                            renderPanoramaView();
-                            break;
-                        }
                         case sf::Keyboard::Key::Up:
-                        {
-                            //Turn perspective upwards (fixed step size)
-                            projector->updateView(projector->getZoom(),
-                                                  projector->getOffsetPhi(),
-                                                  projector->getOffsetTheta() - 5*M_PI/180.);
-                            renderPanoramaView();
-                            break;
-                        }
                         case sf::Keyboard::Key::Down:
                         {
-                            //Turn perspective downwards (fixed step size)
-                            projector->updateView(projector->getZoom(),
-                                                  projector->getOffsetPhi(),
-                                                  projector->getOffsetTheta() + 5*M_PI/180.);
-                            renderPanoramaView();
+                            //Only the first key press event changes the perspective (repeated events while holding the key do not)
+                            if (!((event.key.code == sf::Keyboard::Key::Left && keyNavLeft) ||
+                                  (event.key.code == sf::Keyboard::Key::Right && keyNavRight) ||
+                                  (event.key.code == sf::Keyboard::Key::Up && keyNavUp) ||
+                                  (event.key.code == sf::Keyboard::Key::Down && keyNavDown)))
+                            {
+                                recordInput(LatencyRecorder::Interaction::Key);
+                            }
+
+                            //Accelerate perspective movement while held; actual movement logic happens below the event loop
+                            //(repeated key press events while holding the key are thus ignored)
+                            setKeyNavKey(event.key.code, true);
                             break;
                         }
                         case sf::Keyboard::Key::Space:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
+
                             //Center the horizon line and update window title as this might change zoom level
                             projector->centerHorizon();
                             updateWindowTitle();
@@ -277,17 +660,21 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                         }
                         case sf::Keyboard::Key::Add:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
                             zoomIn();
                             break;
                         }
                         case sf::Keyboard::Key::Subtract:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
                             zoomOut();
                             break;
                         }
                         case sf::Keyboard::Key::Num0:
                         case sf::Keyboard::Key::Numpad0:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
+
                             //Reset to minimum possible zoom level (!CTRL) or center horizon and reset to minimum possible zoom level
                             //that can just preserve the centered horizon (CTRL); update window title for resulting zoom level
                             if (event.key.control)
@@ -301,6 +688,8 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                         }
                         case sf::Keyboard::Key::H:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
+
                             //Adjust zoom so that horizontal field of view is 65 degrees; update window title for changed zoom level
                             projector->updateView(projector->getRequiredZoomFromHFOV(65.f * static_cast<float>(M_PI) / 180.f),
                                                   projector->getOffsetPhi(), projector->getOffsetTheta());
@@ -310,6 +699,8 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                         }
                         case sf::Keyboard::Key::V:
                         {
+                            recordInput(LatencyRecorder::Interaction::Key);
+
                             //Adjust zoom so that vertical field of view is 45 degrees; update window title for changed zoom level
                             projector->updateView(projector->getRequiredZoomFromVFOV(45.f * static_cast<float>(M_PI) / 180.f),
                                                   projector->getOffsetPhi(), projector->getOffsetTheta());
@@ -330,11 +721,22 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                             //Toggle fullscreen mode
                             fullscreenMode = !fullscreenMode;
 
+                            //Prepare display projection for the fullscreen size while the window is re-created (the size of
+                            //a decorated window is not known in advance, so nothing is prepared when leaving fullscreen mode)
+                            if (fullscreenMode)
+                            {
+                                const sf::VideoMode videoMode = getVideoMode(true);
+                                projector->precomputeDisplayTrafos({videoMode.width, videoMode.height});
+                            }
+
                             //Create new window
                             createWindow(fullscreenMode);
 
-                            //Update window size
+                            //Update window size and display projection (keeps panorama sphere and, if size is unchanged, everything else)
                             currentWindowSize = window.getSize();
+                            stretchedWindowSize = currentWindowSize;
+
+                            updateDisplaySize();
 
                             //Update title and display
                             updateWindowTitle();
@@ -342,6 +744,13 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
 
                             break;
                         }
+                        case sf::Keyboard::Key::P:
+                        {
+                            //Export current perspective as poster (not from the coarse preview)
+                            if (event.key.control && !projectorIsPreview)
+                                savePoster();
+                            break;
+                        }
                         case sf::Keyboard::Key::W:
                         {
                             if (event.key.control)
@@ -353,30 +762,228 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                     }
                     break;
                 }
+                case sf::Event::KeyReleased:
+                {
+                    //Let perspective movement slow down again
+                    setKeyNavKey(event.key.code, false);
+                    break;
+                }
+                case sf::Event::LostFocus:
+                {
+                    //Key release events might be missed without focus
+                    keyNavLeft = keyNavRight = keyNavUp = keyNavDown = false;
+                    break;
+                }
                 default:
                     break;
             }
         }
 
-        //If at least one window resize event was collected in the event loop above, resize the panorama scene now
-        if (windowResizing)
+        //Wait for the projection of the next coasting frame before using the projector again
+        finishCoastPrerender(false);
+
+        //Show the exact frame of a changed perspective as soon as it is projected (see changeView()), unless the mouse was moved
+        //meanwhile and a newer perspective is shown in this frame slot anyway; other continuous interactions wait for it
+        if (viewChange.valid())
+        {
+            const bool projected = (viewChange.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+            if (projected ? !dragRenderPending() : (keyNavActive() || coasting || windowResizing || loading))
+                showViewChange();
+            else if (!dragRenderPending())
+                viewChange.wait_for(std::chrono::milliseconds(1));  //Avoid busy waiting
+        }
+
+        //During continuous movements only project the central part of slow frames in time and keep the previous outer part
+        if (projector && !viewChange.valid())
+            projector->setDisplayTimeLimit((mouseDragging || keyNavActive() || coasting) ? sf::milliseconds(frameDeadline) : sf::Time::Zero);
+
+        //While loading, switch to the preview projector and then to the full projector as soon as they are available
+        if (loading)
+        {
+            bool loadingProgressed = false;
+
+            if (previewFuture.valid() && previewFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                loadingProgressed = true;
+
+                std::unique_ptr<Projector> previewProjector = previewFuture.get();
+
+                if (previewProjector)
+                {
+                    projector = std::move(previewProjector);
+                    projectorIsPreview = true;
+
+                    currentWindowSize = window.getSize();
+
+                    updateDisplaySize();
+
+                    projector->updateView(0, 0, 0);
+
+                    updateWindowTitle();
+                    renderPanoramaView();
+                }
+            }
+
+            if (fullFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                loadingProgressed = true;
+                loading = false;
+
+                try
+                {
+                    std::unique_ptr<Projector> fullProjector = fullFuture.get();
+
+                    //Keep perspective that might have been changed while showing the preview
+                    float zoom = 0;
+                    float offsetPhi = 0;
+                    float offsetTheta = 0;
+
+                    if (projector)
+                    {
+                        zoom = projector->getZoom();
+                        offsetPhi = projector->getOffsetPhi();
+                        offsetTheta = projector->getOffsetTheta();
+                    }
+
+                    projector = std::move(fullProjector);
+                    projectorIsPreview = false;
+
+                    //Already initialized with 'loadingDisplaySize' by loading thread (no panorama sphere re-mapping needed then)
+                    currentWindowSize = window.getSize();
+
+                    updateDisplaySize();
+
+                    projector->updateView(zoom, offsetPhi, offsetTheta);
+
+                    updateWindowTitle();
+                    renderPanoramaView();
+                }
+                catch (const std::exception& exc)
+                {
+                    std::cerr<<"ERROR: "<<exc.what()<<std::endl;
+
+                    loadingFailed = true;
+                    window.close();
+                }
+            }
+
+            //Avoid busy waiting
+            if (!loadingProgressed && !windowResizing && !dragRenderPending() && !keyNavActive() && !coasting)
+                sf::sleep(sf::milliseconds(10));
+        }
+
+        //If at least one window resize event was collected in the event loop above, resize the panorama scene as soon as the
+        //window size did not change for 'resizeSettleTime'; meanwhile only stretch the last frame to the current window size
+        if (windowResizing && projector && resizeClock.getElapsedTime() < sf::milliseconds(resizeSettleTime))
+        {
+            if (window.getSize() != stretchedWindowSize)
+            {
+                stretchedWindowSize = window.getSize();
+
+                window.setView(sf::View({0, 0, static_cast<float>(stretchedWindowSize.x), static_cast<float>(stretchedWindowSize.y)}));
+
+                drawPanoSprite();
+                window.display();
+            }
+
+            sf::sleep(std::min(frameInterval, sf::milliseconds(resizeSettleTime) - resizeClock.getElapsedTime()));
+            continue;
+        }
+        else if (windowResizing)
         {
             windowResizing = false;
 
             currentWindowSize = window.getSize();
+            stretchedWindowSize = currentWindowSize;
 
             updateDisplaySize();
 
             renderPanoramaView();
+
+            //Dragging origin was taken from the stretched last frame, so take it again from the new display projection
+            if (mouseDragging)
+                enableMouseDragging();
         }
 
-        //If view angle manipulation via mouse drag is active, change scene perspective according to initial (at mouse
-        //drag activation) and current mouse position so that mouse pointer stays aligned with same spot in the scene
-        if (mouseDragging)
+        //If view angle manipulation via arrow keys is active, advance the perspective movement in fixed time steps
+        //(independent of the frame rate) and update the perspective once per frame slot
+        if (keyNavActive() && !mouseDragging)
         {
+            const sf::Time untilNextFrame = frameInterval - frameClock.getElapsedTime();
+
+            if (untilNextFrame > sf::Time::Zero)
+            {
+                sf::sleep(untilNextFrame);
+                continue;
+            }
+
+            frameClock.restart();
+
+            //Limit simulated time after stalls (e.g. while the window was blocked by the operating system)
+            keyNavLag = std::min(keyNavLag + keyNavClock.restart(), sf::milliseconds(250));
+
+            //Speed relative to the current vertical field of view, such that the movement appears equally fast at any zoom level
+            const float viewHeightAngle = getViewHeightAngle();
+
+            const sf::Vector2f targetVelocity(static_cast<float>(keyNavRight - keyNavLeft) * keyNavMaxSpeed * viewHeightAngle,
+                                              static_cast<float>(keyNavDown - keyNavUp) * keyNavMaxSpeed * viewHeightAngle);
+
+            const float dt = keyNavTimeStep.asSeconds();
+            const float maxSpeedChange = keyNavMaxSpeed * viewHeightAngle * dt / keyNavRampTime;
+
+            sf::Vector2f deltaAngle(0, 0);
+
+            for (; keyNavLag >= keyNavTimeStep; keyNavLag -= keyNavTimeStep)
+            {
+                //Approach target velocity with limited acceleration (stop smoothly when no key is held)
+                keyNavVelocity.x += std::clamp(targetVelocity.x - keyNavVelocity.x, -maxSpeedChange, maxSpeedChange);
+                keyNavVelocity.y += std::clamp(targetVelocity.y - keyNavVelocity.y, -maxSpeedChange, maxSpeedChange);
+
+                deltaAngle.x += keyNavVelocity.x * dt;
+                deltaAngle.y += keyNavVelocity.y * dt;
+            }
+
+            if (deltaAngle.x != 0 || deltaAngle.y != 0)
+            {
+                const float requestedOffsetTheta = projector->getOffsetTheta() + deltaAngle.y;
+
+                projector->updateView(projector->getZoom(), projector->getOffsetPhi() + deltaAngle.x, requestedOffsetTheta);
+
+                //Stop vertical movement at the upper or lower limit of the scene
+                if (std::abs(projector->getOffsetTheta() - requestedOffsetTheta) > 1e-6f)
+                    keyNavVelocity.y = 0;
+
+                renderPanoramaView();
+            }
+        }
+
+        //If view angle manipulation via mouse drag is active and the mouse was moved, change scene perspective according to initial
+        //(at mouse drag activation) and current mouse position so that mouse pointer stays aligned with same spot in the scene
+        if (dragRenderPending())
+        {
+            //Update at most once per frame slot; sleep until the next slot and collect further mouse movement meanwhile
+            const sf::Time untilNextFrame = frameInterval - frameClock.getElapsedTime();
+
+            if (untilNextFrame > sf::Time::Zero)
+            {
+                sf::sleep(untilNextFrame);
+                continue;
+            }
+
+            frameClock.restart();
+
+            //Take the finished projection of the previous perspective or abandon it as outdated (see changeView())
+            if (finishViewChange(true))
+                updatePanoTexture();
+
+            //Mouse drag takes precedence over keyboard navigation
+            keyNavLeft = keyNavRight = keyNavUp = keyNavDown = false;
+            keyNavVelocity = sf::Vector2f(0, 0);
+
             //Calculate relative movement of mouse position between start of mouse drag and now in terms of panorama sphere angles
 
-            sf::Vector2f dragCurrentMouseAngle = projector->getViewAngle(dragCurrentMousePos);
+            sf::Vector2f dragCurrentMouseAngle = projector->getViewAngle(mapWindowToDisplay(dragCurrentMousePos));
 
             float deltaPhi = dragInitialMouseAngle.x - dragCurrentMouseAngle.x;
             float deltaTheta = dragInitialMouseAngle.y - dragCurrentMouseAngle.y;
@@ -385,9 +992,32 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
                 deltaTheta = 0;
 
             //Move the perspective about the same relative view angle
-            projector->updateView(projector->getZoom(), dragInitialViewOffsetPhi + deltaPhi, dragInitialViewOffsetTheta + deltaTheta);
+            const sf::Vector2f previousOffset(projector->getOffsetPhi(), projector->getOffsetTheta());
+            const sf::Vector2f requestedOffset(dragInitialViewOffsetPhi + deltaPhi, dragInitialViewOffsetTheta + deltaTheta);
 
-            renderPanoramaView();
+            changeView(projector->getZoom(), requestedOffset.x, requestedOffset.y);
+
+            //Track the (smoothed) velocity of the perspective for inertial panning after releasing the mouse
+            //(from the requested perspective, as the projector might still be busy with it; see changeView())
+            const float dt = dragVelocityClock.restart().asSeconds();
+
+            if (dt > 0)
+            {
+                //Horizontal offset is wrapped for 360 degree panoramas
+                float offsetChangePhi = requestedOffset.x - previousOffset.x;
+
+                if (offsetChangePhi > M_PI)
+                    offsetChangePhi -= 2*M_PI;
+                else if (offsetChangePhi < -M_PI)
+                    offsetChangePhi += 2*M_PI;
+
+                const float weight = dt / (dt + dragVelocitySmoothing);
+
+                dragVelocity.x += (offsetChangePhi / dt - dragVelocity.x) * weight;
+                dragVelocity.y += ((requestedOffset.y - previousOffset.y) / dt - dragVelocity.y) * weight;
+            }
+
+            dragRenderedMousePos = dragCurrentMousePos;
 
             //If the mouse leaves a window edge while dragging, move the mouse to the opposite
             //edge and reset the dragging origin in order to allow for a continuous movement
@@ -408,23 +1038,203 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
 
                 sf::Mouse::setPosition(dragCurrentMousePos + mouseOffs, window);
 
-                //Reset dragging origin
+                //Reset dragging origin (needs the exact current perspective)
+                showViewChange();
                 enableMouseDragging();
 
                 //Skip pending mouse move events until event triggered by sf::Mouse::setPosition is reached
                 dragWaitForWrap = true;
             }
         }
+
+        //Let the perspective glide with decaying velocity after a fast mouse drag (inertial panning)
+        if (coasting && !mouseDragging)
+        {
+            const sf::Time untilNextFrame = frameInterval - frameClock.getElapsedTime();
+
+            if (untilNextFrame > sf::Time::Zero)
+            {
+                sf::sleep(untilNextFrame);
+                continue;
+            }
+
+            frameClock.restart();
+
+            //Calculate the first frame here; later ones are projected ahead while the previous one is displayed (see below)
+            if (!coastFrameReady)
+            {
+                const sf::Vector2f deltaAngle = advanceCoasting(sf::Time::Zero);
+                const float requestedOffsetTheta = projector->getOffsetTheta() + deltaAngle.y;
+
+                projector->updateView(projector->getZoom(), projector->getOffsetPhi() + deltaAngle.x, requestedOffsetTheta);
+
+                if (std::abs(projector->getOffsetTheta() - requestedOffsetTheta) > 1e-6f)
+                    coastVelocity.y = 0;
+            }
+
+            const std::optional<std::uint64_t> frameGeneration = coastFrameReady ? std::optional(coastPrerenderGeneration) : std::nullopt;
+
+            coastFrameReady = false;
+
+            coastShownOffset = sf::Vector2f(projector->getOffsetPhi(), projector->getOffsetTheta());
+            coastShownVelocity = coastVelocity;
+            coastShownTime = coastTime;
+            coastShownLag = coastLag;
+
+            //Project the next frame on another thread while waiting for vertical synchronization of the current one,
+            //which is shown one frame interval after the current one
+            renderPanoramaView([&]()
+                               {
+                                   const sf::Vector2f deltaAngle = advanceCoasting(frameInterval);
+
+                                   if (!coasting)
+                                       return;
+
+                                   const float zoom = projector->getZoom();
+                                   const float offsetPhi = projector->getOffsetPhi() + deltaAngle.x;
+                                   const float offsetTheta = projector->getOffsetTheta() + deltaAngle.y;
+
+                                   coastPrerenderGeneration = inputGeneration;
+                                   coastPrerender = std::async(std::launch::async,
+                                                               [this, zoom, offsetPhi, offsetTheta]() -> bool
+                                                               {
+                                                                   projector->updateView(zoom, offsetPhi, offsetTheta);
+
+                                                                   //Stop vertical movement at the upper or lower limit of the scene
+                                                                   return std::abs(projector->getOffsetTheta() - offsetTheta) > 1e-6f;
+                                                               });
+
+                                   coastFrameReady = true;
+                               },
+                               frameGeneration);
+        }
+
+        //Complete the last, possibly partial or abandoned frame as soon as the perspective stops changing
+        //(check movement first, as a coasting frame or a changed perspective may still be projected on another thread)
+        if (!(mouseDragging || keyNavActive() || coasting || viewChange.valid()) && projector && !projector->isDisplayDataComplete())
+        {
+            projector->setDisplayTimeLimit(sf::Time::Zero);
+            projector->updateView(projector->getZoom(), projector->getOffsetPhi(), projector->getOffsetTheta());
+
+            renderPanoramaView();
+        }
+    }
+
+    //Abandon still running projections of a coasting frame or a changed perspective
+    if (coastPrerender.valid())
+    {
+        projector->cancelDisplayUpdate();
+        coastPrerender.wait();
     }
 
+    finishViewChange(true);
+
+    //Cancel loading in case window was closed while loading and wait for the current loading stage to finish
+    *loadingCancelled = true;
+    loadingThread.join();
+
+    if (pProjectorOptions.reportMemoryUsage && projector && !projectorIsPreview)
+        std::cout<<projector->getMemoryUsageReport();
+
+    if (latencyRecorder)
+        std::cout<<latencyRecorder->getReport();
+
     //Delete the projector
     projector.reset();
+    projectorIsPreview = false;
 
-    return true;
+    return !loadingFailed;
 }
 
 //Private
 
+/*!
+ * \brief Load the picture and set up preview and full Projector.
+ *
+ * Creates a Projector for the picture \p pFileName, \p pSceneMetaData and \p pProjectorOptions (see Projector())
+ * and passes a preview version of it (see Projector::createPreview(), possibly nullptr) to \p pPreviewPromise.
+ * Then initializes the full Projector with \p pDisplaySize and the default perspective (see Projector::updateDisplaySize()
+ * and Projector::updateView()), which includes the expensive initial panorama sphere projection, and passes it to
+ * \p pFullPromise. Exceptions are passed to \p pFullPromise (and \p pPreviewPromise is then set to nullptr).
+ *
+ * ProjectorOptions::cancelFlag of \p pProjectorOptions is checked between these stages and by the Projector
+ * during the panorama sphere mapping. If it is set, loading is stopped and an exception is passed
+ * to \p pFullPromise as well, such that a closed window does not wait for the remaining stages.
+ *
+ * This is meant to be run on a background thread (see run()). All arguments are taken by value
+ * such that no other data than the cancel flag are shared with the calling thread.
+ *
+ * \param pFileName Panorama picture to load.
+ * \param pSceneMetaData Meta data for panorama scene from \p pFileName.
+ * \param pProjectorOptions Settings for picture loading and panorama sphere storage.
+ * \param pDisplaySize Initial display projection size for the full Projector.
+ * \param pPreviewPromise Receives the preview Projector (or nullptr if no preview was created).
+ * \param pFullPromise Receives the full Projector (or an exception if loading failed or was cancelled).
+ */
+void PanoramaWindow::loadProjectors(const std::string pFileName, const SceneMetaData pSceneMetaData,
+                                    const ProjectorOptions pProjectorOptions, const sf::Vector2u pDisplaySize,
+                                    std::promise<std::unique_ptr<Projector>> pPreviewPromise,
+                                    std::promise<std::unique_ptr<Projector>> pFullPromise)
+{
+    //Decimated picture width used for the preview
+    constexpr int previewMaxWidth = 4096;
+
+    bool previewDone = false;
+
+    //Stop at the next stage if the window was closed meanwhile
+    auto checkCancelled = [&pProjectorOptions]() -> void
+    {
+        if (pProjectorOptions.cancelFlag && *pProjectorOptions.cancelFlag)
+            throw std::runtime_error("Loading was cancelled.");
+    };
+
+    try
+    {
+        std::unique_ptr<Projector> fullProjector = std::make_unique<Projector>(pFileName, pSceneMetaData, pProjectorOptions);
+
+        checkCancelled();
+
+        pPreviewPromise.set_value(fullProjector->createPreview(previewMaxWidth));
+        previewDone = true;
+
+        checkCancelled();
+
+        fullProjector->updateDisplaySize(pDisplaySize);
+
+        checkCancelled();
+
+        fullProjector->updateView(0, 0, 0);
+
+        pFullPromise.set_value(std::move(fullProjector));
+    }
+    catch (...)
+    {
+        if (!previewDone)
+            pPreviewPromise.set_value(nullptr);
+
+        pFullPromise.set_exception(std::current_exception());
+    }
+}
+
+//
+
+/*!
+ * \brief Get the video mode for creating a window.
+ *
+ * Returns the best fullscreen mode if \p pFullscreenMode is true and fullscreen mode is supported,
+ * and the desktop mode otherwise. See also createWindow().
+ *
+ * \param pFullscreenMode Get video mode for fullscreen mode, if available.
+ * \return Video mode to create the window with.
+ */
+sf::VideoMode PanoramaWindow::getVideoMode(const bool pFullscreenMode)
+{
+    if (pFullscreenMode && !sf::VideoMode::getFullscreenModes().empty())
+        return sf::VideoMode::getFullscreenModes()[0];
+
+    return sf::VideoMode::getDesktopMode();
+}
+
 /*!
  * \brief Create a new window or recreate the old window.
  *
@@ -436,14 +1246,10 @@ bool PanoramaWindow::run(const std::string& pFileName, const SceneMetaData& pSce
  */
 void PanoramaWindow::createWindow(bool pFullscreenMode)
 {
-    sf::VideoMode videoMode = sf::VideoMode::getDesktopMode();
-
-    if (pFullscreenMode && sf::VideoMode::getFullscreenModes().size() > 0)
-        videoMode = sf::VideoMode::getFullscreenModes()[0];
-    else
+    if (sf::VideoMode::getFullscreenModes().empty())
         pFullscreenMode = false;
 
-    window.create(videoMode, "", pFullscreenMode ? sf::Style::Fullscreen : sf::Style::Default);
+    window.create(getVideoMode(pFullscreenMode), "", pFullscreenMode ? sf::Style::Fullscreen : sf::Style::Default);
 
     window.setVerticalSyncEnabled(true);
 }
@@ -453,19 +1259,82 @@ void PanoramaWindow::createWindow(bool pFullscreenMode)
  *
  * Sets the window title according to the current file name and zoom level.
  * Appends an 'L' to the title if the "lock vertical view angle during mouse drag" mode is active.
+ * Appends "(preview)" to the title if only a coarse preview of the scene is shown yet (see run()).
  *
  * Note: The shown zoom level is a percentage measured relative to the minimal possible zoom
  * that just fits the vertical window field of view. See also Projector::getNormalizedZoom().
  *
- * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
+ * Note: Shows "loading..." instead of the zoom level, if no projector is defined (yet).
  */
 void PanoramaWindow::updateWindowTitle()
 {
+    std::string title = std::string(Version::programName) + " " + Version::toString() + " - \"" + fileName + "\" - ";
+
     if (!projector)
+    {
+        window.setTitle(title + "loading...");
         return;
+    }
 
-    window.setTitle(std::string(Version::programName) + " " + Version::toString() + " - \"" + fileName + "\" - " +
-                    std::to_string(std::lroundf(100*projector->getNormalizedZoom())) + "%" + (mouseDragLockThetaAngle ? " L" : ""));
+    window.setTitle(title + std::to_string(std::lroundf(100*projector->getNormalizedZoom())) + "%" + (mouseDragLockThetaAngle ? " L" : "") +
+                    (projectorIsPreview ? " (preview)" : ""));
+}
+
+//
+
+/*!
+ * \brief Save the current perspective as a poster-size PNG file.
+ *
+ * Renders the current perspective at 'posterScale' times the window size and streams it to a PNG file next to
+ * the picture (see Projector::savePoster()). The file name is the picture's file name with the extension
+ * replaced by "-poster.png" (or "-poster-N.png" with the first free number N, if that file exists).
+ *
+ * The window does not respond while the poster is rendered, which is indicated in the window title.
+ *
+ * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
+ */
+void PanoramaWindow::savePoster()
+{
+    if (!projector)
+        return;
+
+    std::string posterFileName;
+
+    try
+    {
+        std::filesystem::path tPath(fileName);
+        const std::string stem = tPath.stem().string();
+
+        tPath.replace_filename(stem + "-poster.png");
+
+        for (int i = 2; std::filesystem::exists(tPath); ++i)
+            tPath.replace_filename(stem + "-poster-" + std::to_string(i) + ".png");
+
+        posterFileName = tPath.string();
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not find a file name for the poster!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+        return;
+    }
+
+    window.setTitle(std::string(Version::programName) + " " + Version::toString() + " - \"" + fileName + "\" - saving poster...");
+
+    try
+    {
+        if (projector->savePoster(posterFileName, {posterScale * window.getSize().x, posterScale * window.getSize().y}))
+            std::cout<<"Poster saved to \""<<posterFileName<<"\".\n";
+        else
+            std::cerr<<"ERROR: Could not save the poster!"<<std::endl;
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not save the poster!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+    }
+
+    updateWindowTitle();
 }
 
 //
@@ -491,7 +1360,11 @@ void PanoramaWindow::updateDisplaySize()
 
     projector->updateDisplaySize(window.getSize());
 
-    panoTexture.create(window.getSize().x, window.getSize().y);
+    if (panoTexture.getSize() != window.getSize())
+    {
+        panoTexture.create(window.getSize().x, window.getSize().y);
+        panoTextureOutdated = true;
+    }
 }
 
 //
@@ -506,6 +1379,9 @@ void PanoramaWindow::updateDisplaySize()
  *
  * See also Projector::updateView().
  *
+ * A zoom step still projected on another thread (see changeView()) is taken or abandoned first,
+ * such that fast consecutive steps accumulate.
+ *
  * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
  */
 void PanoramaWindow::zoomIn()
@@ -513,12 +1389,16 @@ void PanoramaWindow::zoomIn()
     if (!projector)
         return;
 
-    //Zoom in
-    projector->updateView(projector->getZoom() * 1.1, projector->getOffsetPhi(), projector->getOffsetTheta());
+    //Take the projection of a previous zoom step first (an abandoned one keeps its perspective, see Projector::cancelDisplayUpdate()),
+    //such that the projector is not read while it is projecting on another thread and every step builds on the previous one
+    if (finishViewChange(true))
+        updatePanoTexture();
 
-    //Update display
-    updateWindowTitle();
-    renderPanoramaView();
+    //Zoom in and update display (title is updated with the exact frame, if projected on another thread; see changeView())
+    changeView(projector->getZoom() * 1.1, projector->getOffsetPhi(), projector->getOffsetTheta());
+
+    if (!viewChange.valid())
+        updateWindowTitle();
 }
 
 /*!
@@ -533,38 +1413,298 @@ void PanoramaWindow::zoomOut()
     if (!projector)
         return;
 
-    //Zoom out
-    projector->updateView(projector->getZoom() / 1.1, projector->getOffsetPhi(), projector->getOffsetTheta());
+    //Take the projection of a previous zoom step first (an abandoned one keeps its perspective, see Projector::cancelDisplayUpdate()),
+    //such that the projector is not read while it is projecting on another thread and every step builds on the previous one
+    if (finishViewChange(true))
+        updatePanoTexture();
 
-    //Update display
-    updateWindowTitle();
-    renderPanoramaView();
+    //Zoom out and update display (title is updated with the exact frame, if projected on another thread; see changeView())
+    changeView(projector->getZoom() / 1.1, projector->getOffsetPhi(), projector->getOffsetTheta());
+
+    if (!viewChange.valid())
+        updateWindowTitle();
 }
 
 //
 
+/*!
+ * \brief Change the perspective and draw it, showing a warped previous frame meanwhile if projecting is slow.
+ *
+ * Same as Projector::updateView() followed by renderPanoramaView(), if the last projection was fast.
+ *
+ * If it took longer than 'warpThreshold' instead (e.g. at high resolutions or if the panorama sphere needs to be
+ * re-mapped after zooming), the new perspective is projected on another thread and this function returns right away.
+ * Meanwhile the last frame is displayed shifted and scaled according to the view angle and zoom change, which approximates
+ * the new perspective well near the center. This hides the projection latency during fast mouse drag, similar to
+ * "timewarp" in VR compositors. The caller must not use the Projector until finishViewChange() was called
+ * and then displays the exact frame (see run()).
+ *
+ * A projection from a previous call that is still running is abandoned as outdated (see finishViewChange()),
+ * while a finished one is uploaded to the texture (see updatePanoTexture()) and warped instead of the older frame.
+ *
+ * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
+ *
+ * \param pZoom New zoom level (must be positive).
+ * \param pOffsetPhi New horizontal view angle offset.
+ * \param pOffsetTheta New vertical view angle offset.
+ */
+void PanoramaWindow::changeView(const float pZoom, const float pOffsetPhi, const float pOffsetTheta)
+{
+    if (!projector)
+        return;
+
+    if (finishViewChange(true))
+        updatePanoTexture();
+
+    if (lastProjectionTime < sf::milliseconds(warpThreshold))
+    {
+        const sf::Clock clock;
+
+        projector->updateView(pZoom, pOffsetPhi, pOffsetTheta);
+
+        lastProjectionTime = clock.getElapsedTime();
+
+        renderPanoramaView();
+        return;
+    }
+
+    //Approximate the perspective change at the center by scaling and shifting the texture (shift converted to window pixels)
+
+    const float scale = pZoom / textureZoom;
+    const float shiftScale = textureFocalLength * scale * window.getSize().y / panoTexture.getSize().y;
+
+    float deltaPhi = pOffsetPhi - textureOffsetPhi;
+    const float deltaTheta = pOffsetTheta - textureOffsetTheta;
+
+    if (deltaPhi > M_PI)
+        deltaPhi -= 2*M_PI;
+    else if (deltaPhi < -M_PI)
+        deltaPhi += 2*M_PI;
+
+    //A horizontal angle change moves the center less the farther it is from the horizon
+    const sf::Vector2f shift(-deltaPhi * std::cos(textureOffsetTheta) * shiftScale, -deltaTheta * shiftScale);
+
+    //Project the exact frame meanwhile (the display data remain unchanged until then)
+    viewChangeGeneration = inputGeneration;
+    viewChange = std::async(std::launch::async,
+                            [this, pZoom, pOffsetPhi, pOffsetTheta]() -> sf::Time
+                            {
+                                const sf::Clock clock;
+                                projector->updateView(pZoom, pOffsetPhi, pOffsetTheta);
+                                return clock.getElapsedTime();
+                            });
+
+    //Warped frame does not count as displaying the new perspective (see LatencyRecorder)
+    drawPanoSprite(scale, shift);
+    window.display();
+}
+
+/*!
+ * \brief Wait for the projection of a perspective changed by changeView() on another thread.
+ *
+ * Does nothing if no such projection was started. If \p pAbandon is true and the projection is still running,
+ * it is abandoned (see Projector::cancelDisplayUpdate()). The Projector can be used again afterwards.
+ * The duration of a finished projection becomes the new 'lastProjectionTime'.
+ *
+ * The projected frame is neither uploaded nor displayed (see updatePanoTexture() and renderPanoramaView()).
+ *
+ * \param pAbandon Abandon the projection if it is still running.
+ * \return If a projection was started and has finished (i.e. was not abandoned).
+ */
+bool PanoramaWindow::finishViewChange(const bool pAbandon)
+{
+    if (!viewChange.valid())
+        return false;
+
+    const bool abandon = pAbandon && viewChange.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+
+    if (abandon)
+        projector->cancelDisplayUpdate();
+
+    const sf::Time projectionTime = viewChange.get();
+
+    if (abandon)
+        return false;
+
+    lastProjectionTime = projectionTime;
+
+    return true;
+}
+
 /*!
  * \brief Draw the current scene projection.
  *
- * Gets the current display projection from Projector::getDisplayData(),
- * updates the corresponding texture and displays it in the window.
+ * Updates the texture with the current display projection (see updatePanoTexture()) and displays it in the window.
+ *
+ * If enabled (see enableSharedFrameOutput()), the display projection is also published to the shared memory frame output.
+ *
+ * \p pBeforeDisplay is called after the frame was handed to SFML but before waiting for vertical synchronization
+ * (see sf::Window::display()). It can start preparing the next frame, but must not change the display data meanwhile.
+ *
+ * The display projection might be only partially updated during continuous movements (see run()).
+ *
+ * If enabled (see enableLatencyReport()), the frame completes the latency measurements of the inputs up to
+ * view generation \p pGeneration, which defaults to the current 'inputGeneration' and must be passed
+ * for display projections that were projected ahead on another thread. Partial frames complete none.
  *
  * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
+ *
+ * \param pBeforeDisplay Optional function to call right before displaying the frame.
+ * \param pGeneration View generation included in the display projection (current one if unset).
  */
-void PanoramaWindow::renderPanoramaView()
+void PanoramaWindow::renderPanoramaView(const std::function<void()>& pBeforeDisplay, const std::optional<std::uint64_t> pGeneration)
 {
     if (!projector)
         return;
 
-    //Load current projection data into texture and update sprite accordingly
-    panoTexture.update(projector->getDisplayData().data());
-    panoSprite.setTexture(panoTexture, true);
+    const std::int64_t renderTimeNs = SharedFrameOutput::getMonotonicTimeNs();
+
+    //Load updated regions of current projection data into texture
+
+    updatePanoTexture();
 
     //Display the scene
 
-    window.clear();
+    drawPanoSprite();
 
-    window.draw(panoSprite);
+    //Hand the same frame to an external consumer
+    if (frameOutput)
+    {
+        SharedFrameOutput::FrameInfo info;
+        info.zoom = projector->getZoom();
+        info.offsetPhi = projector->getOffsetPhi();
+        info.offsetTheta = projector->getOffsetTheta();
+        info.renderTimeNs = renderTimeNs;
+
+        frameOutput->publish(projector->getDisplayData().data(), panoTexture.getSize(), info);
+    }
+
+    //Evaluate before the display projection might be changed by 'pBeforeDisplay'
+    const bool frameComplete = projector->isDisplayDataComplete();
+    const std::uint64_t generation = pGeneration.value_or(inputGeneration);
+
+    if (pBeforeDisplay)
+        pBeforeDisplay();
 
     window.display();
+
+    if (latencyRecorder && frameComplete)
+        latencyRecorder->recordFrameDisplayed(generation);
+}
+
+/*!
+ * \brief Upload the updated regions of the display projection to the texture.
+ *
+ * Gets the current display projection from Projector::getDisplayData() and updates the corresponding texture.
+ * Only the regions of the display projection that changed since the last call are uploaded
+ * (see Projector::takeDirtyDisplayRects()), unless the texture was re-created.
+ *
+ * Also remembers the perspective shown by the texture, from which changeView() warps it.
+ *
+ * Note: Returns immediately, if no projector is defined (no panorama window running (see run()).
+ */
+void PanoramaWindow::updatePanoTexture()
+{
+    if (!projector)
+        return;
+
+    const std::vector<sf::Uint8>& displayData = projector->getDisplayData();
+    const std::vector<sf::IntRect> dirtyRects = projector->takeDirtyDisplayRects();
+
+    const unsigned int displayWidth = panoTexture.getSize().x;
+
+    if (panoTextureOutdated)
+    {
+        panoTexture.update(displayData.data());
+        panoTextureOutdated = false;
+    }
+    else
+    {
+        for (const sf::IntRect& rect : dirtyRects)
+        {
+            const sf::Uint8* regionPixels = displayData.data() + 4 * (static_cast<std::size_t>(displayWidth) * rect.top + rect.left);
+
+            //Full rows are contiguous already, otherwise need a contiguous copy of the region
+            if (static_cast<unsigned int>(rect.width) != displayWidth)
+            {
+                const std::size_t rowSize = 4 * static_cast<std::size_t>(rect.width);
+
+                textureUploadBuffer.resize(rowSize * rect.height);
+
+                for (int y = 0; y < rect.height; ++y)
+                    std::copy_n(regionPixels + 4 * static_cast<std::size_t>(displayWidth) * y, rowSize, textureUploadBuffer.data() + rowSize * y);
+
+                regionPixels = textureUploadBuffer.data();
+            }
+
+            panoTexture.update(regionPixels, rect.width, rect.height, rect.left, rect.top);
+        }
+    }
+
+    //Focal length in texture pixels (from the vertical field of view at the center column)
+
+    const sf::Vector2u textureSize = panoTexture.getSize();
+    const int centerColumn = static_cast<int>(textureSize.x / 2);
+
+    const float viewHeightAngle = projector->getViewAngle({centerColumn, static_cast<int>(textureSize.y)}).y -
+                                  projector->getViewAngle({centerColumn, 0}).y;
+
+    textureFocalLength = textureSize.y / 2.f / std::tan(viewHeightAngle / 2.f);
+
+    textureZoom = projector->getZoom();
+    textureOffsetPhi = projector->getOffsetPhi();
+    textureOffsetTheta = projector->getOffsetTheta();
+}
+
+/*!
+ * \brief Map a window position to the display projection position shown there.
+ *
+ * Inverts the placement of the texture by drawPanoSprite() (without additional scale and shift), such that positions
+ * of mouse events can be passed to the projector (see Projector::getViewAngle()) even while the last frame is only
+ * stretched to a changed window size (see run()). Otherwise, the texture matches the window and nothing changes.
+ *
+ * \param pWindowPosition Position in window pixels.
+ * \return Corresponding position in display projection (texture) pixels.
+ */
+sf::Vector2i PanoramaWindow::mapWindowToDisplay(const sf::Vector2i pWindowPosition) const
+{
+    const sf::Vector2f windowSize(window.getSize().x, window.getSize().y);
+    const sf::Vector2f textureSize(panoTexture.getSize().x, panoTexture.getSize().y);
+
+    if (windowSize == textureSize || textureSize.y == 0)
+        return pWindowPosition;
+
+    const float scale = windowSize.y / textureSize.y;
+
+    return sf::Vector2i(std::lround((pWindowPosition.x - windowSize.x / 2.f) / scale + textureSize.x / 2.f),
+                        std::lround((pWindowPosition.y - windowSize.y / 2.f) / scale + textureSize.y / 2.f));
+}
+
+/*!
+ * \brief Draw the texture of the last scene projection to the window (without displaying it).
+ *
+ * Clears the window and draws the texture updated by renderPanoramaView() such that its vertical extent fills
+ * the window and it is horizontally centered. The texture matches the window size, except while resizing the
+ * window (see run()), when the last frame is stretched like this (keeping the vertical field of view).
+ *
+ * The texture can additionally be scaled by \p pScale about its center and shifted by \p pShift
+ * (in window pixels), which approximates a perspective change (see changeView()).
+ *
+ * \param pScale Additional scale factor.
+ * \param pShift Shift of the texture center from the window center.
+ */
+void PanoramaWindow::drawPanoSprite(const float pScale, const sf::Vector2f pShift)
+{
+    const sf::Vector2f windowSize(window.getSize().x, window.getSize().y);
+    const sf::Vector2f textureSize(panoTexture.getSize().x, panoTexture.getSize().y);
+
+    const float scale = pScale * windowSize.y / textureSize.y;
+
+    panoSprite.setTexture(panoTexture, true);
+    panoSprite.setOrigin(textureSize.x / 2.f, textureSize.y / 2.f);
+    panoSprite.setPosition(windowSize.x / 2.f + pShift.x, windowSize.y / 2.f + pShift.y);
+    panoSprite.setScale(scale, scale);
+
+    window.clear();
+    window.draw(panoSprite);
 }
@@ -23,15 +23,25 @@
 #ifndef SPNV_PANORAMAWINDOW_H
 #define SPNV_PANORAMAWINDOW_H
 
+#include "latencyrecorder.h"
 #include "projector.h"
 #include "scenemetadata.h"
+#include "sharedframeoutput.h"
 
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Texture.hpp>
+#include <SFML/Window/VideoMode.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 /*!
  * \brief Display panorama scenes on screen from variable perspectives.
@@ -46,25 +56,63 @@
  *
  * A single PanoramaWindow can be used to subsequently display different panorama scenes
  * as the used window and Projector instances will be dynamically created by run().
+ *
+ * The picture is loaded on a background thread while the window is already shown (see loadProjectors()).
+ * For large pictures a coarse preview of the scene (see Projector::createPreview()) is displayed
+ * and can be navigated until the full resolution Projector is ready.
  */
 class PanoramaWindow
 {
 public:
     PanoramaWindow();                           ///< Constructor.
     //
-    bool run(const std::string& pFileName, const SceneMetaData& pSceneMetaData);    ///< Display a picture as panorama scene in a window.
+    bool enableSharedFrameOutput(const std::string& pName);     ///< Additionally hand every displayed frame to another process.
+    void enableLatencyReport();                                 ///< Measure input-to-photon latencies and print them after closing the window.
+    bool run(const std::string& pFileName, const SceneMetaData& pSceneMetaData,
+             const ProjectorOptions& pProjectorOptions = ProjectorOptions());   ///< Display a picture as panorama scene in a window.
 
 private:
+    static void loadProjectors(std::string pFileName, SceneMetaData pSceneMetaData, ProjectorOptions pProjectorOptions,
+                               sf::Vector2u pDisplaySize, std::promise<std::unique_ptr<Projector>> pPreviewPromise,
+                               std::promise<std::unique_ptr<Projector>> pFullPromise);  ///< \brief Load the picture and set up
+                                                                                        ///  preview and full Projector.
+    //
+    static sf::VideoMode getVideoMode(bool pFullscreenMode);    ///< Get the video mode for creating a window.
     void createWindow(bool pFullscreenMode);    ///< Create a new window or recreate the old window.
     //
     void updateWindowTitle();                   ///< Update the window title with current file name and zoom level.
     //
+    void savePoster();                          ///< Save the current perspective as a poster-size PNG file.
+    //
     void updateDisplaySize();                   ///< Adjust window settings and Projector projection to current window resolution.
     //
     void zoomIn();                              ///< Zoom into the scene.
     void zoomOut();                             ///< Zoom out of the scene.
     //
-    void renderPanoramaView();                  ///< Draw the current scene projection.
+    void changeView(float pZoom, float pOffsetPhi, float pOffsetTheta);     ///< \brief Change the perspective and draw it, showing
+                                                                            ///  a warped previous frame meanwhile if projecting is slow.
+    bool finishViewChange(bool pAbandon);       ///< Wait for the projection of a perspective changed by changeView() on another thread.
+    void renderPanoramaView(const std::function<void()>& pBeforeDisplay = std::function<void()>(),
+                            std::optional<std::uint64_t> pGeneration = std::nullopt);   ///< Draw the current scene projection.
+    void updatePanoTexture();                   ///< Upload the updated regions of the display projection to the texture.
+    sf::Vector2i mapWindowToDisplay(sf::Vector2i pWindowPosition) const;    ///< \brief Map a window position to the display projection
+                                                                            ///  position shown there.
+    void drawPanoSprite(float pScale = 1, sf::Vector2f pShift = sf::Vector2f(0, 0));    ///< \brief Draw the texture of the last scene
+                                                                                        ///  projection to the window (without displaying it).
+
+private:
+    static constexpr unsigned int posterScale = 4;  ///< Poster size relative to window size (see savePoster()).
+    static constexpr int maxFrameRate = 60;         ///< Maximum rate of perspective updates during mouse drag or keyboard navigation.
+    static constexpr int keyNavStepRate = 120;      ///< Rate of fixed time steps for simulating keyboard navigation (see run()).
+    static constexpr float keyNavMaxSpeed = 0.5f;   ///< Keyboard navigation speed in vertical fields of view per second.
+    static constexpr float keyNavRampTime = 0.3f;   ///< Time in seconds to reach or lose full keyboard navigation speed.
+    static constexpr float coastDecayTime = 0.35f;  ///< Time constant in seconds of the velocity decay during inertial panning.
+    static constexpr float coastStopSpeed = 0.02f;  ///< Minimum inertial panning speed in vertical fields of view per second.
+    static constexpr int coastReleaseWindow = 50;   ///< Maximum time in ms between last mouse movement and release to start inertial panning.
+    static constexpr float dragVelocitySmoothing = 0.04f;   ///< Time constant in seconds for smoothing the mouse drag velocity.
+    static constexpr int frameDeadline = 12;        ///< Maximum time in ms for projecting a frame during continuous movements (see run()).
+    static constexpr int warpThreshold = 8;         ///< Minimum duration in ms of the last projection for showing warped frames (see changeView()).
+    static constexpr int resizeSettleTime = 150;    ///< Time in ms without further resize events before adjusting the projection size.
 
 private:
     sf::RenderWindow window;                //Window used to display the panorama scene
@@ -73,10 +121,25 @@ private:
     //
     sf::Texture panoTexture;                //Texture used to draw the panorama scene
     sf::Sprite panoSprite;                  //Sprite used to draw the panorama scene
+    bool panoTextureOutdated;               //Whole display projection needs to be uploaded to 'panoTexture' (e.g. after re-creation)
+    std::vector<sf::Uint8> textureUploadBuffer;     //Contiguous copy of a display projection region for uploading it to 'panoTexture'
+    float textureZoom;                      //Zoom level of the perspective shown by 'panoTexture'
+    float textureOffsetPhi;                 //Horizontal view angle offset of the perspective shown by 'panoTexture'
+    float textureOffsetTheta;               //Vertical view angle offset of the perspective shown by 'panoTexture'
+    float textureFocalLength;               //Focal length in texture pixels of the perspective shown by 'panoTexture'
     //
     std::unique_ptr<Projector> projector;   //Projector for picture loading, perspective transformation and display projection
+    bool projectorIsPreview;                //Current 'projector' only shows a coarse preview while the picture is still loading
+    sf::Time lastProjectionTime;            //Duration of the last display projection update by changeView()
+    std::future<sf::Time> viewChange;       //Projection of a perspective changed by changeView() on another thread (returns duration)
+    std::uint64_t viewChangeGeneration;     //View generation projected by 'viewChange'
+    //
+    std::uint64_t inputGeneration;          //View generation, incremented by every stamped input (see LatencyRecorder)
     //
     bool mouseDragLockThetaAngle;           //Lock the vertical view angle during mouse drag
+    //
+    std::unique_ptr<SharedFrameOutput> frameOutput;     //Shared memory output of every displayed frame (if enabled)
+    std::unique_ptr<LatencyRecorder> latencyRecorder;   //Input-to-photon latency measurement (if enabled)
 };
 
 #endif // SPNV_PANORAMAWINDOW_H
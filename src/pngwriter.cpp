@@ -0,0 +1,431 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "pngwriter.h"
+
+#include <zlib.h>
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+
+constexpr std::size_t outBufferSize = 1 << 18;  ///< Size of compressed data per "IDAT" chunk.
+
+/*!
+ * \brief Write a 32 bit unsigned integer in big endian byte order (as used by PNG).
+ *
+ * \param pValue Value to write.
+ * \param pData Target for the four bytes.
+ */
+void writeUInt32BE(const std::uint32_t pValue, sf::Uint8 *const pData)
+{
+    pData[0] = static_cast<sf::Uint8>(pValue >> 24);
+    pData[1] = static_cast<sf::Uint8>(pValue >> 16);
+    pData[2] = static_cast<sf::Uint8>(pValue >> 8);
+    pData[3] = static_cast<sf::Uint8>(pValue);
+}
+
+/*!
+ * \brief Check if a picture size can be stored in a PNG file.
+ *
+ * \param pSize Size of the picture.
+ * \return If valid (prints an error otherwise).
+ */
+bool checkPictureSize(const sf::Vector2u pSize)
+{
+    if (pSize.x == 0 || pSize.y == 0 || pSize.x > (1u << 31) / 4 || pSize.y > (1u << 31) - 1)
+    {
+        std::cerr<<"ERROR: Invalid PNG picture size!"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+/*!
+ * \brief Constructor.
+ *
+ * Use open() to start writing a file.
+ */
+PngWriter::PngWriter() :
+    file(),
+    fileName(),
+    memoryBuffer(nullptr),
+    size({0, 0}),
+    rowsWritten(0),
+    stream(nullptr),
+    rowBuffer(),
+    outBuffer()
+{
+}
+
+/*!
+ * \brief Destructor.
+ *
+ * Removes the file again, if it was opened but not successfully closed (see close()).
+ */
+PngWriter::~PngWriter()
+{
+    if (stream)
+        abort();
+}
+
+//Public
+
+/*!
+ * \brief Create the PNG file and write its header.
+ *
+ * Creates (or overwrites) \p pFileName and writes the PNG signature and header for a picture of size
+ * \p pSize with 8 bit "rgb" pixels. Afterwards the rows of the picture must be passed to writeRows().
+ *
+ * \param pFileName File name of the PNG file.
+ * \param pSize Size of the picture.
+ * \return If successful.
+ */
+bool PngWriter::open(const std::string& pFileName, const sf::Vector2u pSize)
+{
+    if (stream)
+        abort();
+
+    if (!checkPictureSize(pSize))
+        return false;
+
+    fileName = pFileName;
+    memoryBuffer = nullptr;
+
+    file.open(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+    if (!file.is_open())
+    {
+        std::cerr<<"ERROR: Could not open file \"" + fileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    return begin(pSize);
+}
+
+/*!
+ * \brief Start writing the PNG file to a memory buffer.
+ *
+ * Like open(const std::string&, sf::Vector2u) but appends the PNG file to \p pBuffer (after clearing it) instead of writing
+ * it to a file, e.g. for sending it over a socket (see RenderService). \p pBuffer must stay valid until close() (or until
+ * the writer is destroyed) and holds the complete PNG file after a successful close(). On failure it is cleared again.
+ *
+ * \param pBuffer Target buffer for the PNG file.
+ * \param pSize Size of the picture.
+ * \return If successful.
+ */
+bool PngWriter::open(std::vector<sf::Uint8>& pBuffer, const sf::Vector2u pSize)
+{
+    if (stream)
+        abort();
+
+    pBuffer.clear();
+
+    if (!checkPictureSize(pSize))
+        return false;
+
+    fileName = "(memory)";
+    memoryBuffer = &pBuffer;
+
+    return begin(pSize);
+}
+
+/*!
+ * \brief Compress and write the next rows of the picture.
+ *
+ * Takes \p pNumRows continuous rows from \p pPixels, which uses the same "rgba" format as Projector::getDisplayData()
+ * with the picture width from open() (the alpha channel is dropped). The rows are filtered ("sub" filter) and
+ * compressed, and the compressed data are written to the file whenever enough of them have accumulated.
+ *
+ * On failure the file is removed again.
+ *
+ * \param pPixels Picture rows as flat array.
+ * \param pNumRows Number of rows.
+ * \return If successful (including that no more than the remaining number of rows was passed).
+ */
+bool PngWriter::writeRows(const sf::Uint8 *const pPixels, const unsigned int pNumRows)
+{
+    if (!stream)
+        return false;
+
+    if (pNumRows > size.y - rowsWritten)
+    {
+        std::cerr<<"ERROR: Too many rows for PNG file \"" + fileName + "\"!"<<std::endl;
+        abort();
+        return false;
+    }
+
+    for (unsigned int y = 0; y < pNumRows; ++y)
+    {
+        const sf::Uint8* row = pPixels + 4 * static_cast<std::size_t>(size.x) * y;
+
+        //Filter type "sub": store difference to the left neighbor pixel
+        rowBuffer[0] = 1;
+
+        for (int c = 0; c < 3; ++c)
+            rowBuffer[1 + c] = row[c];
+
+        for (std::size_t x = 1; x < size.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                rowBuffer[1 + 3*x + c] = row[4*x + c] - row[4*(x-1) + c];
+
+        if (!deflateData(rowBuffer.data(), rowBuffer.size(), false))
+        {
+            abort();
+            return false;
+        }
+    }
+
+    rowsWritten += pNumRows;
+
+    return true;
+}
+
+/*!
+ * \brief Finish the compressed data and close the PNG file.
+ *
+ * Flushes the remaining compressed data and writes the end of the PNG file.
+ * All rows of the picture must have been written before (see writeRows()).
+ *
+ * On failure the file is removed again.
+ *
+ * \return If successful.
+ */
+bool PngWriter::close()
+{
+    if (!stream)
+        return false;
+
+    if (rowsWritten != size.y)
+    {
+        std::cerr<<"ERROR: Missing rows for PNG file \"" + fileName + "\"!"<<std::endl;
+        abort();
+        return false;
+    }
+
+    if (!deflateData(nullptr, 0, true) || !writeChunk("IEND", nullptr, 0))
+    {
+        abort();
+        return false;
+    }
+
+    deflateEnd(stream.get());
+    stream.reset();
+
+    if (memoryBuffer)
+    {
+        memoryBuffer = nullptr;
+        return true;
+    }
+
+    file.close();
+
+    if (file.fail())
+    {
+        std::cerr<<"ERROR: Could not write file \"" + fileName + "\"!"<<std::endl;
+        std::remove(fileName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+//Private
+
+/*!
+ * \brief Set up the compression and write the PNG signature and header.
+ *
+ * Writes the PNG signature and header for a picture of size \p pSize with 8 bit "rgb" pixels to the
+ * opened output (see open()). On failure the output is discarded.
+ *
+ * \param pSize Size of the picture.
+ * \return If successful.
+ */
+bool PngWriter::begin(const sf::Vector2u pSize)
+{
+    size = pSize;
+    rowsWritten = 0;
+
+    stream = std::make_unique<z_stream_s>();
+
+    if (deflateInit(stream.get(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        std::cerr<<"ERROR: Could not initialize PNG compression!"<<std::endl;
+        abort();
+        return false;
+    }
+
+    rowBuffer.resize(1 + 3 * static_cast<std::size_t>(size.x));
+    outBuffer.resize(outBufferSize);
+
+    stream->next_out = outBuffer.data();
+    stream->avail_out = static_cast<uInt>(outBuffer.size());
+
+    //PNG signature
+    const std::array<sf::Uint8, 8> signature = {137, 80, 78, 71, 13, 10, 26, 10};
+    writeData(signature.data(), signature.size());
+
+    //Header: size, bit depth 8, color type 2 ("rgb"), default compression/filter method, no interlacing
+    std::array<sf::Uint8, 13> header = {};
+    writeUInt32BE(size.x, header.data());
+    writeUInt32BE(size.y, header.data() + 4);
+    header[8] = 8;
+    header[9] = 2;
+
+    if (!writeChunk("IHDR", header.data(), header.size()))
+    {
+        abort();
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Compress data and write full output buffers.
+ *
+ * Passes \p pData to the compression and writes an "IDAT" chunk each time the output buffer is full.
+ * If \p pFinish is set, the compressed stream is finished and the remaining output is written as well.
+ *
+ * \param pData Data to compress.
+ * \param pLength Length of \p pData.
+ * \param pFinish Finish the compressed stream.
+ * \return If successful.
+ */
+bool PngWriter::deflateData(const sf::Uint8 *const pData, const std::size_t pLength, const bool pFinish)
+{
+    stream->next_in = const_cast<Bytef*>(pData);
+    stream->avail_in = static_cast<uInt>(pLength);
+
+    while (true)
+    {
+        const int status = deflate(stream.get(), pFinish ? Z_FINISH : Z_NO_FLUSH);
+
+        if (status == Z_STREAM_ERROR)
+        {
+            std::cerr<<"ERROR: PNG compression failed!"<<std::endl;
+            return false;
+        }
+
+        //Write output buffer as chunk when full or when done
+        if (stream->avail_out == 0 || status == Z_STREAM_END)
+        {
+            if (!writeChunk("IDAT", outBuffer.data(), outBuffer.size() - stream->avail_out))
+                return false;
+
+            stream->next_out = outBuffer.data();
+            stream->avail_out = static_cast<uInt>(outBuffer.size());
+        }
+
+        if (status == Z_STREAM_END || (!pFinish && stream->avail_in == 0 && stream->avail_out != 0))
+            return true;
+    }
+}
+
+/*!
+ * \brief Write a PNG chunk to the file.
+ *
+ * Writes length, type, data and CRC of the chunk.
+ *
+ * \param pType Four-character chunk type.
+ * \param pData Chunk data.
+ * \param pLength Length of \p pData.
+ * \return If successful.
+ */
+bool PngWriter::writeChunk(const char *const pType, const sf::Uint8 *const pData, const std::size_t pLength)
+{
+    std::array<sf::Uint8, 8> chunkHead = {};
+    writeUInt32BE(static_cast<std::uint32_t>(pLength), chunkHead.data());
+
+    for (int i = 0; i < 4; ++i)
+        chunkHead[4 + i] = static_cast<sf::Uint8>(pType[i]);
+
+    //CRC covers type and data
+    uLong crc = crc32(0, chunkHead.data() + 4, 4);
+    if (pLength > 0)
+        crc = crc32(crc, pData, static_cast<uInt>(pLength));
+
+    std::array<sf::Uint8, 4> chunkTail = {};
+    writeUInt32BE(static_cast<std::uint32_t>(crc), chunkTail.data());
+
+    writeData(chunkHead.data(), chunkHead.size());
+    if (pLength > 0)
+        writeData(pData, pLength);
+    writeData(chunkTail.data(), chunkTail.size());
+
+    if (!memoryBuffer && file.fail())
+    {
+        std::cerr<<"ERROR: Could not write file \"" + fileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write raw data to the file or memory buffer.
+ *
+ * Appends \p pData to the memory buffer, if writing to memory (see open(std::vector<sf::Uint8>&, sf::Vector2u)),
+ * and to the file otherwise. File errors are not checked here but remain set for the file stream.
+ *
+ * \param pData Data to write.
+ * \param pLength Length of \p pData.
+ */
+void PngWriter::writeData(const sf::Uint8 *const pData, const std::size_t pLength)
+{
+    if (memoryBuffer)
+        memoryBuffer->insert(memoryBuffer->end(), pData, pData + pLength);
+    else
+        file.write(reinterpret_cast<const char*>(pData), pLength);
+}
+
+/*!
+ * \brief Discard the unfinished file.
+ *
+ * Releases the compression state, closes the file and removes it (or clears the memory buffer).
+ */
+void PngWriter::abort()
+{
+    if (stream)
+    {
+        deflateEnd(stream.get());
+        stream.reset();
+    }
+
+    if (memoryBuffer)
+    {
+        memoryBuffer->clear();
+        memoryBuffer = nullptr;
+    }
+
+    if (file.is_open())
+    {
+        file.close();
+        std::remove(fileName.c_str());
+    }
+}
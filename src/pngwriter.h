@@ -0,0 +1,82 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_PNGWRITER_H
+#define SPNV_PNGWRITER_H
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+/*!
+ * \brief Streaming writer for PNG files of arbitrary size.
+ *
+ * Writes an 8 bit "rgb" PNG file row by row (see writeRows()), such that only a few rows
+ * need to be in memory at any time, even for pictures that would be too large to be held
+ * in memory as a whole (see Projector::renderPoster()). The rows are compressed with zlib.
+ *
+ * Usage: open() the file, pass all rows in top to bottom order to writeRows() and finally close() the file.
+ * Alternatively, the PNG file can be written to a memory buffer instead (see open(std::vector<sf::Uint8>&, sf::Vector2u)).
+ */
+class PngWriter
+{
+public:
+    PngWriter();                                                    ///< Constructor.
+    PngWriter(const PngWriter&) = delete;                           ///< Deleted copy constructor.
+    ~PngWriter();                                                   ///< Destructor.
+    //
+    PngWriter& operator=(const PngWriter&) = delete;                ///< Deleted copy assignment operator.
+    //
+    bool open(const std::string& pFileName, sf::Vector2u pSize);    ///< Create the PNG file and write its header.
+    bool open(std::vector<sf::Uint8>& pBuffer, sf::Vector2u pSize); ///< Start writing the PNG file to a memory buffer.
+    bool writeRows(const sf::Uint8* pPixels, unsigned int pNumRows);    ///< Compress and write the next rows of the picture.
+    bool close();                                                   ///< Finish the compressed data and close the PNG file.
+
+private:
+    bool begin(sf::Vector2u pSize);                                 ///< Set up the compression and write the PNG signature and header.
+    bool deflateData(const sf::Uint8* pData, std::size_t pLength, bool pFinish);   ///< Compress data and write full output buffers.
+    bool writeChunk(const char* pType, const sf::Uint8* pData, std::size_t pLength);   ///< Write a PNG chunk to the file.
+    void writeData(const sf::Uint8* pData, std::size_t pLength);    ///< Write raw data to the file or memory buffer.
+    void abort();                                                   ///< Discard the unfinished file.
+
+private:
+    std::ofstream file;                     //Output file
+    std::string fileName;                   //Name of output file
+    std::vector<sf::Uint8>* memoryBuffer;   //Output memory buffer instead of 'file' (if not null)
+    //
+    sf::Vector2u size;                      //Picture size
+    unsigned int rowsWritten;               //Number of rows written so far
+    //
+    std::unique_ptr<z_stream_s> stream;     //Compression state (only while file is open)
+    //
+    std::vector<sf::Uint8> rowBuffer;       //Filtered "rgb" row (with leading filter type byte) to be compressed
+    std::vector<sf::Uint8> outBuffer;       //Compressed data for the next "IDAT" chunk
+};
+
+#endif // SPNV_PNGWRITER_H
@@ -22,9 +22,270 @@
 
 #include "projector.h"
 
+#include "panoramascene.h"
+#include "pngwriter.h"
+
+#include <SFML/System/Clock.hpp>
+
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <iostream>
 #include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+/*!
+ * \brief Pixel access to an image stored as flat array of interleaved color channels.
+ *
+ * Provides the same pixel access interface as TileStore for a flat image buffer with
+ * \p NumChannels interleaved channels per pixel (4 for the format of Projector::getDisplayData(),
+ * 3 for plain "rgb"), such that the projection functions of Projector can be used with any
+ * kind of image storage. Only the first three ("rgb") channels are used by Projector.
+ */
+template<typename T, int NumChannels = 4>
+class FlatPixels
+{
+public:
+    /*!
+     * \brief Constructor.
+     *
+     * \param pSize Image size.
+     * \param pData Image data as flat array.
+     */
+    FlatPixels(const sf::Vector2i pSize, T *const pData) :
+        size(pSize),
+        data(pData)
+    {
+    }
+    //
+    /*!
+     * \brief Get the image size.
+     *
+     * \return Image size.
+     */
+    sf::Vector2i getSize() const
+    {
+        return size;
+    }
+    /*!
+     * \brief Get access to the color values of a pixel.
+     *
+     * \param pX Horizontal pixel position.
+     * \param pY Vertical pixel position.
+     * \return Pointer to the \p NumChannels color values of the pixel.
+     */
+    T* getPixel(const int pX, const int pY) const
+    {
+        return data + NumChannels * (static_cast<std::size_t>(size.x) * pY + pX);
+    }
+    /*!
+     * \brief Do nothing, as the whole image is always in memory (see TileStore::fetchRegion()).
+     */
+    void fetchRegion(int, int, int, int, bool = false) const
+    {
+    }
+
+private:
+    const sf::Vector2i size;    //Image size
+    T *const data;              //Image data
+};
+
+/*!
+ * \brief Pixel access to an image stored as three separate "r", "g" and "b" planes.
+ *
+ * Provides the same pixel access interface as FlatPixels for a flat image buffer that holds
+ * all red values first, then all green values and then all blue values (each plane stored as
+ * continuous rows). The color values of a pixel are accessed via a small proxy object.
+ */
+template<typename T>
+class PlanarPixels
+{
+public:
+    /*!
+     * \brief Access to the color values of a single pixel, which are spread over the planes.
+     */
+    class Pixel
+    {
+    public:
+        /*!
+         * \brief Constructor.
+         *
+         * \param pRed Red value of the pixel.
+         * \param pPlaneSize Number of pixels per plane.
+         */
+        Pixel(T *const pRed, const std::size_t pPlaneSize) :
+            red(pRed),
+            planeSize(pPlaneSize)
+        {
+        }
+        /*!
+         * \brief Get access to a color value of the pixel.
+         *
+         * \param pChannel Color channel (0 for "r", 1 for "g", 2 for "b").
+         * \return Color value of the pixel for \p pChannel.
+         */
+        T& operator[](const int pChannel) const
+        {
+            return red[pChannel * planeSize];
+        }
+
+    private:
+        T *const red;                   //Red value of the pixel
+        const std::size_t planeSize;    //Number of pixels per plane
+    };
+
+public:
+    /*!
+     * \brief Constructor.
+     *
+     * \param pSize Image size.
+     * \param pData Image data as three continuous planes.
+     */
+    PlanarPixels(const sf::Vector2i pSize, T *const pData) :
+        size(pSize),
+        data(pData)
+    {
+    }
+    //
+    /*!
+     * \brief Get the image size.
+     *
+     * \return Image size.
+     */
+    sf::Vector2i getSize() const
+    {
+        return size;
+    }
+    /*!
+     * \brief Get access to the color values of a pixel.
+     *
+     * \param pX Horizontal pixel position.
+     * \param pY Vertical pixel position.
+     * \return Proxy for the three "rgb" values of the pixel.
+     */
+    Pixel getPixel(const int pX, const int pY) const
+    {
+        return Pixel(data + static_cast<std::size_t>(size.x) * pY + pX, static_cast<std::size_t>(size.x) * size.y);
+    }
+    /*!
+     * \brief Do nothing, as the whole image is always in memory (see TileStore::fetchRegion()).
+     */
+    void fetchRegion(int, int, int, int, bool = false) const
+    {
+    }
+
+private:
+    const sf::Vector2i size;    //Image size
+    T *const data;              //Image data
+};
+
+/*!
+ * \brief Write access to display projection pixels in a buffer with arbitrary row stride and pixel format.
+ *
+ * Target type for Projector::projectSphereToDisplay(), which sets one "rgb" color per pixel via setPixel().
+ * The color is stored in the format \p Format (see PixelFormat); for four byte formats the alpha value is set to 255.
+ */
+template<PixelFormat Format>
+class DisplayPixels
+{
+public:
+    static constexpr int bytesPerPixel = (Format == PixelFormat::RGB ? 3 : (Format == PixelFormat::Gray ? 1 : 4));
+                                                                                                ///< Number of bytes per pixel.
+
+public:
+    /*!
+     * \brief Constructor.
+     *
+     * \param pData Buffer data starting with the first row.
+     * \param pStride Distance between the starts of two consecutive rows in bytes.
+     */
+    DisplayPixels(sf::Uint8 *const pData, const std::size_t pStride) :
+        data(pData),
+        stride(pStride)
+    {
+    }
+    //
+    /*!
+     * \brief Set the color of a pixel.
+     *
+     * \param pX Horizontal pixel position.
+     * \param pY Vertical pixel position.
+     * \param pRGB Color as {r, g, b}.
+     */
+    void setPixel(const int pX, const int pY, const std::array<sf::Uint8, 3>& pRGB) const
+    {
+        sf::Uint8 *const pixel = data + stride * pY + static_cast<std::size_t>(bytesPerPixel) * pX;
+
+        if constexpr (Format == PixelFormat::Gray)
+            pixel[0] = static_cast<sf::Uint8>((77 * pRGB[0] + 150 * pRGB[1] + 29 * pRGB[2] + 128) >> 8);
+        else if constexpr (Format == PixelFormat::BGRA)
+        {
+            pixel[0] = pRGB[2];
+            pixel[1] = pRGB[1];
+            pixel[2] = pRGB[0];
+            pixel[3] = 255;
+        }
+        else
+        {
+            pixel[0] = pRGB[0];
+            pixel[1] = pRGB[1];
+            pixel[2] = pRGB[2];
+
+            if constexpr (Format == PixelFormat::RGBA)
+                pixel[3] = 255;
+        }
+    }
+
+private:
+    sf::Uint8 *const data;      //Buffer data
+    const std::size_t stride;   //Row stride in bytes
+};
+
+/*!
+ * \brief Call a function with a DisplayPixels target for a pixel format chosen at runtime.
+ *
+ * \tparam FunctionT Function type accepting a DisplayPixels of every PixelFormat.
+ * \param pPixels Buffer data starting with the first row.
+ * \param pStride Distance between the starts of two consecutive rows in bytes.
+ * \param pFormat Pixel format of \p pPixels.
+ * \param pFunction Function to call.
+ */
+template<typename FunctionT>
+void visitDisplayPixels(sf::Uint8 *const pPixels, const std::size_t pStride, const PixelFormat pFormat, FunctionT& pFunction)
+{
+    switch (pFormat)
+    {
+        case PixelFormat::RGBA:
+        {
+            pFunction(DisplayPixels<PixelFormat::RGBA>(pPixels, pStride));
+            break;
+        }
+        case PixelFormat::BGRA:
+        {
+            pFunction(DisplayPixels<PixelFormat::BGRA>(pPixels, pStride));
+            break;
+        }
+        case PixelFormat::RGB:
+        {
+            pFunction(DisplayPixels<PixelFormat::RGB>(pPixels, pStride));
+            break;
+        }
+        case PixelFormat::Gray:
+        {
+            pFunction(DisplayPixels<PixelFormat::Gray>(pPixels, pStride));
+            break;
+        }
+    }
+}
+
+} // namespace
 
 /*!
  * \brief Constructor.
@@ -32,6 +293,24 @@
  * Loads the panorama picture \p pFileName and sets up panorama
  * scene-specific configuration using meta data from \p pSceneMetaData.
  *
+ * If ProjectorOptions::useSphereCache of \p pOptions is set, the panorama sphere is instead memory-mapped
+ * from a matching cache file, if available, and the picture is not loaded at all. Otherwise the picture is
+ * loaded and used to create the cache file (see loadOrCreateSphereCache()).
+ *
+ * If ProjectorOptions::tileCacheLimit of \p pOptions is non-zero, the loaded picture is moved to a TileStore and
+ * the panorama sphere is also held in a TileStore (see mapPicToPanoSphere()), such that only this amount of memory
+ * is used for their tiles that are touched by the current perspective. Half of the limit is used for each one.
+ * The temporary tile files are created in ProjectorOptions::tileDirectory or, by default, next to the picture.
+ *
+ * ProjectorOptions::sphereLayout of \p pOptions selects the storage layout of the in-memory panorama sphere buffer
+ * (see PanoSphereLayout). The tiled panorama sphere is always stored as "rgba".
+ *
+ * If ProjectorOptions::releasePicture of \p pOptions is set instead, a SpherePyramid is built in memory from the loaded
+ * picture and the picture is released afterwards (see createSpherePyramid()). Display projections are then obtained
+ * directly from a pyramid level without a separate panorama sphere buffer (see mapPicToPanoSphere()), such that the
+ * steady-state memory usage (see getMemoryUsage()) is the pyramid only, i.e. about 4/3 of the full resolution panorama
+ * sphere in "rgba" format. ProjectorOptions::sphereLayout is not used then.
+ *
  * Sets lower/upper "oversampling" thresholds and the target "oversampling" value (see updateDisplayFOV()
  * and calcLowestDisplayTrafoOversampling()) to fixed values of 1.0, 2.0 and 1.5, respectively.
  *
@@ -40,12 +319,64 @@
  *
  * \param pFileName The panorama picture to load.
  * \param pSceneMetaData Meta data for the panorama scene shown in \p pFileName.
+ * \param pOptions Settings for picture loading and panorama sphere storage.
  *
  * \throws std::runtime_error Picture loading failed (unsupported file format, file does not exist, etc.).
  * \throws std::runtime_error Picture size from \p pSceneMetaData does not match actual size of \p pFileName.
+ * \throws std::filesystem::filesystem_error Could not query picture file properties for the sphere cache.
+ * \throws std::runtime_error Could not create a temporary tile file (see TileStore()).
+ * \throws std::runtime_error Loading was cancelled via ProjectorOptions::cancelFlag (also thrown by later
+ *                            panorama sphere mappings, see updateView(), as long as the flag stays set).
+ */
+Projector::Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData, const ProjectorOptions& pOptions) :
+    Projector(pFileName, pSceneMetaData, nullptr)
+{
+    tileCacheLimit = pOptions.tileCacheLimit;
+    tileDirectory = pOptions.tileDirectory;
+    cancelFlag = pOptions.cancelFlag;
+
+    if (tileDirectory.empty())
+    {
+        tileDirectory = std::filesystem::path(pFileName).parent_path().string();
+
+        if (tileDirectory.empty())
+            tileDirectory = ".";
+    }
+    panoSphereLayout = pOptions.sphereLayout;
+
+    if (pOptions.useSphereCache)
+        loadOrCreateSphereCache();
+    else
+    {
+        loadPicture();
+
+        if (tileCacheLimit > 0)
+        {
+            picTiles = std::make_unique<TileStore>(picSize, tileCacheLimit / 2, tileDirectory);
+            picTiles->loadFromPixels(pic->getPixelsPtr());
+
+            //Picture only needed as tiles from now on
+            pic.reset();
+        }
+        else if (pOptions.releasePicture)
+            createSpherePyramid();
+    }
+}
+
+/*!
+ * \brief Construct from an already loaded picture.
+ *
+ * Same as Projector(const std::string&, const SceneMetaData&, const ProjectorOptions&) but takes
+ * the picture data from \p pPicture instead of loading \p pFileName. The picture size is \e not
+ * checked and must match the cropped picture size from \p pSceneMetaData (see createPreview()).
+ *
+ * \param pFileName File name of the panorama picture.
+ * \param pSceneMetaData Meta data for the panorama scene shown in \p pPicture.
+ * \param pPicture The panorama picture (or nullptr if loaded later).
  */
-Projector::Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData) :
-    pic(),
+Projector::Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData, std::unique_ptr<sf::Image> pPicture) :
+    pic(std::move(pPicture)),
+    picTiles(nullptr),
     //
     fileName(pFileName),
     //
@@ -76,23 +407,54 @@ Projector::Projector(const std::string& pFileName, const SceneMetaData& pSceneMe
     displaySize({0, 0}),
     displayFOV({0, 0}),
     displayData(),
+    displayDataComplete(true),
+    displayGeneration(0),
+    displayTimeLimit(sf::Time::Zero),
+    dirtyDisplayTiles(),
     //
     staticDisplayTrafosX(),
     staticDisplayTrafosY(),
     //
+    precomputeCancelled(false),
+    precomputedDisplayTrafos(),
+    precomputedDisplaySize({0, 0}),
+    precomputedF(0),
+    //
     panoSphereSize({0, 0}),
     panoSphereData(),
+    panoSphereTiles(nullptr),
+    //
+    tileCacheLimit(0),
+    tileDirectory(),
+    cancelFlag(nullptr),
+    //
+    panoSphereLayout(PanoSphereLayout::RGBA),
+    //
+    panoSpherePyramid(nullptr),
+    panoSphereLevel(-1),
     //
     panoSphereRemapHystMinOvers(1.0),
     panoSphereRemapHystTargOvers(1.5),
     panoSphereRemapHystMaxOvers(2.0),
-    panoSphereRemapHystMaxF(0)
+    panoSphereRemapHystMaxF(0),
+    //
+    peakMemoryUsage()
 {
-    if (!pic.loadFromFile(fileName))
-        throw std::runtime_error("Could not load the picture \"" + fileName + "\"!");
+}
 
-    if (pic.getSize().x != static_cast<unsigned int>(picSize.x) || pic.getSize().y != static_cast<unsigned int>(picSize.y))
-        throw std::runtime_error("Loaded picture size does not match specified cropped picture size!");
+/*!
+ * \brief Destructor.
+ *
+ * Tells a still running calculation of display projection transformations prepared in advance
+ * (see precomputeDisplayTrafos()) to stop and waits for it, such that it neither outlives
+ * this instance nor delays its destruction by finishing the whole calculation.
+ */
+Projector::~Projector()
+{
+    precomputeCancelled = true;
+
+    if (precomputedDisplayTrafos.valid())
+        precomputedDisplayTrafos.wait();
 }
 
 //Public
@@ -103,11 +465,21 @@ Projector::Projector(const std::string& pFileName, const SceneMetaData& pSceneMe
  * Resizes display projection buffer, adjusts transformations (see updateDisplayFOV())
  * and updates the display projection (see updateDisplayData()).
  *
+ * Does nothing if the display size did not change, the display projection is complete
+ * (see isDisplayDataComplete()) and \p pForceAdjustResolution is false.
+ *
  * \param pDisplaySize New size for display projection.
  * \param pForceAdjustResolution Force re-projection of panorama sphere (see updateDisplayFOV()).
  */
 void Projector::updateDisplaySize(const sf::Vector2u pDisplaySize, const bool pForceAdjustResolution)
 {
+    //Keep transformation caches and display projection
+    if (static_cast<int>(pDisplaySize.x) == displaySize.x && static_cast<int>(pDisplaySize.y) == displaySize.y &&
+            displayDataComplete && !pForceAdjustResolution)
+    {
+        return;
+    }
+
     displaySize.x = static_cast<int>(pDisplaySize.x);
     displaySize.y = static_cast<int>(pDisplaySize.y);
 
@@ -121,6 +493,63 @@ void Projector::updateDisplaySize(const sf::Vector2u pDisplaySize, const bool pF
     updateDisplayData();
 }
 
+/*!
+ * \brief Prepare the display projection transformations for an upcoming display size on a background thread.
+ *
+ * Starts calculating the view angle-independent display projection transformations (see updateStaticDisplayTrafoCache())
+ * for \p pDisplaySize and the current zoom level on another thread. If the display size is later on changed to
+ * \p pDisplaySize while the zoom level is still the same (see updateDisplaySize()), these transformations are
+ * taken over (waiting for them if necessary) instead of calculating them once again. This is useful if the
+ * new display size is known in advance but setting up the display takes a while (e.g. switching to fullscreen).
+ *
+ * The prepared transformations are as large as the permanent ones for \p pDisplaySize and are counted as such
+ * (see getMemoryUsage()). They are released as soon as the display size or zoom level is changed to anything else.
+ *
+ * Replaces previously prepared transformations (abandoning them if still running).
+ *
+ * \param pDisplaySize Upcoming size for display projection.
+ */
+void Projector::precomputeDisplayTrafos(const sf::Vector2u pDisplaySize)
+{
+    const sf::Vector2i size(static_cast<int>(pDisplaySize.x), static_cast<int>(pDisplaySize.y));
+
+    //Same focal length as will be set by updateDisplayFOV()
+    const float tanFOV2 = std::tan(fovCentHor.y / 2.);
+    const float f0 = size.y / 2. / tanFOV2;
+    const float newF = f0 * zoom;
+
+    releasePrecomputedDisplayTrafos();
+
+    precomputeCancelled = false;
+
+    precomputedDisplayTrafos = std::async(std::launch::async,
+                                          [size, newF, &cancelled = precomputeCancelled]() -> DisplayTrafoCache
+                                          {
+                                              DisplayTrafoCache cache;
+                                              cache.trafosX.resize(size.x+1, 0);
+                                              cache.trafosY.resize((size.x+1)*(size.y+1), 0);
+
+                                              for (int x = 0; x <= size.x; ++x)
+                                                  cache.trafosX[x] = staticDisplayTrafoX(x, size, newF);
+
+                                              for (int y = 0; y <= size.y; ++y)
+                                              {
+                                                  if (cancelled.load(std::memory_order_relaxed))
+                                                      return DisplayTrafoCache();
+
+                                                  for (int x = 0; x <= size.x; ++x)
+                                                      cache.trafosY[(size.x+1)*y + x] = staticDisplayTrafoY(y, x, size, newF);
+                                              }
+
+                                              return cache;
+                                          });
+
+    precomputedDisplaySize = size;
+    precomputedF = newF;
+
+    trackPeakMemoryUsage();
+}
+
 /*!
  * \brief Change the current perspective of the display projection.
  *
@@ -138,21 +567,7 @@ void Projector::updateDisplaySize(const sf::Vector2u pDisplaySize, const bool pF
  */
 void Projector::updateView(float pZoom, const float pOffsetPhi, float pOffsetTheta, const bool pForceAdjustResolution)
 {
-    if (pZoom == -1)
-    {
-        //Set minimum possible zoom under centered horizon condition
-        pZoom = minZoomCentHor;
-
-        pOffsetTheta = 0;
-    }
-    else if (pZoom == 0)
-    {
-        //Set minimum possible zoom under condition of "perfect" theta angle (that just avoids
-        //both top and bottom margins and which will be automatically figured out below)
-        pZoom = minZoomNonCentHor;
-    }
-    else if (pZoom < minZoomNonCentHor) //Constrain zoom level with lower limit to avoid margins
-        pZoom = minZoomNonCentHor;
+    clipZoom(pZoom, pOffsetTheta, minZoomCentHor, minZoomNonCentHor);
 
     //Only need to adjust FOV of display projection if zoom level did actually change
     if (pZoom != zoom)
@@ -273,7 +688,8 @@ float  Projector::getRequiredZoomFromVFOV(const float pVFOV) const
  */
 sf::Vector2f Projector::getViewAngle(const sf::Vector2i pDisplayPosition) const
 {
-    return {staticDisplayTrafoX(pDisplayPosition.x), staticDisplayTrafoY(pDisplayPosition.y, pDisplayPosition.x)};
+    return {staticDisplayTrafoX(pDisplayPosition.x, displaySize, f),
+            staticDisplayTrafoY(pDisplayPosition.y, pDisplayPosition.x, displaySize, f)};
 }
 
 //
@@ -291,17 +707,886 @@ sf::Vector2f Projector::getViewAngle(const sf::Vector2i pDisplayPosition) const
  *
  * The alpha channel is unused!
  *
- * Note that the calculation of the projection and the image data is \e not done
- * by this function but directly by those functions that change perspective.
+ * Note that the calculation of the projection and the image data is \e not done
+ * by this function but directly by those functions that change perspective.
+ *
+ * \return Image data of display projection as flat array.
+ */
+const std::vector<sf::Uint8>& Projector::getDisplayData() const
+{
+    return displayData;
+}
+
+/*!
+ * \brief Get the regions of the display projection updated since the last call.
+ *
+ * Returns rectangles that cover all tiles of the display projection (see updateDisplayData()) that were
+ * updated since the last call, such that only these need to be copied elsewhere (e.g. to a texture).
+ * Dirty tiles are merged per row of tiles (possibly including clean tiles in between)
+ * and consecutive rows with the same horizontal extent are merged as well.
+ *
+ * \return Updated regions of the display projection in pixels.
+ */
+std::vector<sf::IntRect> Projector::takeDirtyDisplayRects()
+{
+    const sf::Vector2i numTiles((displaySize.x + displayTileSize - 1) / displayTileSize, (displaySize.y + displayTileSize - 1) / displayTileSize);
+
+    std::vector<sf::IntRect> rects;
+
+    if (dirtyDisplayTiles.size() != static_cast<std::size_t>(numTiles.x) * numTiles.y)
+        return rects;
+
+    for (int ty = 0; ty < numTiles.y; ++ty)
+    {
+        //Horizontal extent of dirty tiles in this row
+        int firstDirty = numTiles.x;
+        int lastDirty = -1;
+
+        for (int tx = 0; tx < numTiles.x; ++tx)
+        {
+            if (dirtyDisplayTiles[numTiles.x*ty + tx])
+            {
+                firstDirty = std::min(firstDirty, tx);
+                lastDirty = tx;
+            }
+        }
+
+        if (lastDirty < 0)
+            continue;
+
+        const int left = firstDirty * displayTileSize;
+        const int top = ty * displayTileSize;
+        const int width = std::min((lastDirty + 1) * displayTileSize, displaySize.x) - left;
+        const int height = std::min(displayTileSize, displaySize.y - top);
+
+        //Extend previous rectangle if directly above and of same extent
+        if (!rects.empty() && rects.back().left == left && rects.back().width == width && rects.back().top + rects.back().height == top)
+            rects.back().height += height;
+        else
+            rects.emplace_back(left, top, width, height);
+    }
+
+    dirtyDisplayTiles.assign(dirtyDisplayTiles.size(), false);
+
+    return rects;
+}
+
+/*!
+ * \brief Check if the last display projection update was finished.
+ *
+ * \return False if the last update of the display projection was abandoned (see cancelDisplayUpdate())
+ *         or cut off at the deadline (see setDisplayTimeLimit()).
+ */
+bool Projector::isDisplayDataComplete() const
+{
+    return displayDataComplete;
+}
+
+/*!
+ * \brief Abandon a display projection update that is running on another thread.
+ *
+ * Can be called from any thread while another thread changes the perspective (e.g. via updateView()).
+ * The running projection then stops before its next tile (see updateDisplayData()), leaving the display
+ * projection partially updated (see isDisplayDataComplete()). The new perspective itself is kept, so that
+ * calling updateView() again with the same values later on produces the complete display projection.
+ *
+ * This allows to immediately start a more current perspective instead of waiting for an outdated one.
+ *
+ * Note: Has no effect on projections that start only after this call.
+ */
+void Projector::cancelDisplayUpdate()
+{
+    displayGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Set a deadline for display projection updates (partial frames).
+ *
+ * If \p pTimeLimit is non-zero, every following update of the display projection stops processing further
+ * tiles (see updateDisplayData()) once it took longer than \p pTimeLimit. The central tiles then show the
+ * new perspective while the outer tiles still show the previous one (see isDisplayDataComplete()).
+ * This keeps up with continuous perspective changes at high resolutions, since one mostly looks at the
+ * center meanwhile. Update the perspective again without time limit afterwards to complete it.
+ *
+ * \param pTimeLimit Maximum duration of a display projection update or zero to always complete it.
+ */
+void Projector::setDisplayTimeLimit(const sf::Time pTimeLimit)
+{
+    displayTimeLimit = pTimeLimit;
+}
+
+//
+
+/*!
+ * \brief Create a coarse copy of the panorama scene for quickly showing a first preview.
+ *
+ * Decimates the loaded picture by the smallest integer factor that reduces its width to at most \p pMaxWidth,
+ * using plain point sampling, and returns a new Projector for the decimated picture. The scene meta data
+ * (sizes and crop positions) are scaled down accordingly, while the field of view stays the same, so
+ * the same perspective values (see updateView()) can be used with both the preview and this instance.
+ *
+ * As the decimation only reads a small fraction of the picture pixels, the preview and its
+ * first display projection are much faster to compute than the first display projection here.
+ *
+ * \param pMaxWidth Maximum picture width for the preview.
+ * \return New Projector for the preview or nullptr if the picture is not wider than \p pMaxWidth
+ *         or if no picture is loaded (panorama sphere loaded from cache file, see ProjectorOptions).
+ */
+std::unique_ptr<Projector> Projector::createPreview(const int pMaxWidth) const
+{
+    if ((!pic && !picTiles) || picSize.x <= pMaxWidth)
+        return nullptr;
+
+    //Smallest decimation factor that reduces the picture width to at most 'pMaxWidth'
+    const int factor = (picSize.x + pMaxWidth - 1) / pMaxWidth;
+
+    //Scale sizes and crop positions down by the decimation factor; field of view remains unchanged
+
+    const sf::Vector2i previewCropPosTL(picCropPosTL.x / factor, picCropPosTL.y / factor);
+    const sf::Vector2i previewCropPosBR(picCropPosBR.x / factor, picCropPosBR.y / factor);
+
+    const SceneMetaData previewMetaData(projectionType, {picUncroppedSize.x / factor, picUncroppedSize.y / factor},
+                                        picUncroppedFOV, previewCropPosTL, previewCropPosBR);
+
+    const sf::Vector2i previewSize(previewCropPosBR.x - previewCropPosTL.x, previewCropPosBR.y - previewCropPosTL.y);
+
+    //Pick one picture pixel for every preview pixel
+
+    std::vector<sf::Uint8> previewPixels(4 * static_cast<std::size_t>(previewSize.x) * static_cast<std::size_t>(previewSize.y));
+
+    auto decimate = [this, factor, &previewCropPosTL, &previewSize, &previewPixels](auto& pSource) -> void
+    {
+        for (int y = 0; y < previewSize.y; ++y)
+        {
+            const int sourceY = std::clamp((previewCropPosTL.y + y) * factor - picCropPosTL.y, 0, picSize.y - 1);
+
+            pSource.fetchRegion(0, sourceY, picSize.x - 1, sourceY);
+
+            for (int x = 0; x < previewSize.x; ++x)
+            {
+                const int sourceX = std::clamp((previewCropPosTL.x + x) * factor - picCropPosTL.x, 0, picSize.x - 1);
+
+                const sf::Uint8* sourcePixel = pSource.getPixel(sourceX, sourceY);
+                const std::size_t targetIdx = 4 * (static_cast<std::size_t>(previewSize.x) * y + x);
+
+                for (int c = 0; c < 4; ++c)
+                    previewPixels[targetIdx + c] = sourcePixel[c];
+            }
+        }
+    };
+
+    if (picTiles)
+        decimate(*picTiles);
+    else
+    {
+        FlatPixels<const sf::Uint8> source(picSize, pic->getPixelsPtr());
+        decimate(source);
+    }
+
+    auto previewPic = std::make_unique<sf::Image>();
+    previewPic->create(previewSize.x, previewSize.y, previewPixels.data());
+
+    return std::unique_ptr<Projector>(new Projector(fileName, previewMetaData, std::move(previewPic)));
+}
+
+/*!
+ * \brief Create an independent Projector for the same panorama scene that shares the panorama sphere pyramid.
+ *
+ * The returned Projector has its own perspective, display size and buffers (and copies all
+ * ProjectorOptions) but shares the read-only panorama sphere pyramid (see ProjectorOptions)
+ * with this instance. Different instances can hence be used concurrently on different threads
+ * for rendering several perspectives of the same scene while the pyramid is kept in memory only once.
+ *
+ * As for a new instance, updateDisplaySize() needs to be called first.
+ *
+ * \return New Projector or nullptr if no panorama sphere pyramid is available
+ *         (i.e. neither ProjectorOptions::useSphereCache nor ProjectorOptions::releasePicture was set).
+ */
+std::unique_ptr<Projector> Projector::createSharedCopy() const
+{
+    if (!panoSpherePyramid)
+        return nullptr;
+
+    const SceneMetaData metaData(projectionType, picUncroppedSize, picUncroppedFOV, picCropPosTL, picCropPosBR);
+
+    std::unique_ptr<Projector> copy(new Projector(fileName, metaData, nullptr));
+
+    copy->panoSpherePyramid = panoSpherePyramid;
+    copy->tileCacheLimit = tileCacheLimit;
+    copy->tileDirectory = tileDirectory;
+    copy->panoSphereLayout = panoSphereLayout;
+
+    return copy;
+}
+
+/*!
+ * \brief Get the full resolution panorama sphere pyramid.
+ *
+ * Level 0 of the pyramid is the panorama sphere at full picture resolution (see SpherePyramid),
+ * which can be used e.g. for exporting the whole scene (see DeepZoomExporter).
+ *
+ * \return Panorama sphere pyramid or nullptr if not available
+ *         (i.e. neither ProjectorOptions::useSphereCache nor ProjectorOptions::releasePicture was set).
+ */
+std::shared_ptr<const SpherePyramid> Projector::getSpherePyramid() const
+{
+    return panoSpherePyramid;
+}
+
+/*!
+ * \brief Create an immutable panorama scene for concurrent rendering that shares the panorama sphere pyramid.
+ *
+ * The returned PanoramaScene only references the read-only panorama sphere pyramid and the field of view of this scene.
+ * It renders arbitrary perspectives with a const function (see PanoramaScene::render()) and can hence be used by any
+ * number of threads at the same time, unlike a Projector, whose perspective and buffers can only be used by one thread.
+ *
+ * \return New panorama scene or nullptr if no panorama sphere pyramid is available
+ *         (i.e. neither ProjectorOptions::useSphereCache nor ProjectorOptions::releasePicture was set).
+ */
+std::shared_ptr<const PanoramaScene> Projector::createScene() const
+{
+    if (!panoSpherePyramid)
+        return nullptr;
+
+    return std::make_shared<const PanoramaScene>(panoSpherePyramid, fovTL, fovBR);
+}
+
+//
+
+/*!
+ * \brief Render the current perspective at an arbitrary size in horizontal strips.
+ *
+ * Renders the display projection for the current perspective (zoom level and view angle offset, see updateView())
+ * at the size \p pPosterSize, which may be much larger than the display size (e.g. for printing a poster), and
+ * passes it top to bottom in strips of consecutive rows to \p pWriteRows (e.g. to stream them to a file, see savePoster()).
+ * The strips use the format of getDisplayData() with a width of pPosterSize.x and are only valid during the call.
+ *
+ * Neither a full size display projection buffer nor full size transformation caches are allocated. Instead, the strips
+ * and their transformations are computed in scratch buffers of fixed size (a few MiB for the strip data), so the memory
+ * usage of the strips does not grow with the poster height. The panorama sphere is mapped with the resolution needed for
+ * the poster (see mapPicToPanoSphere()), which is limited by the picture resolution (see calcFullPanoSphereSize()). If that
+ * differs from the current panorama sphere size, a temporary panorama sphere is used (see visitPanoSphereOfSize()),
+ * which is hence at most as large as the full resolution sphere but independent of the poster size.
+ *
+ * The vertical field of view is the same as for the display projection. The aspect ratio of \p pPosterSize
+ * should hence match the display size, as a wider poster also shows a wider horizontal field of view.
+ *
+ * updateDisplaySize() must have been called before.
+ *
+ * \param pPosterSize Size of the rendered poster.
+ * \param pWriteRows Function called with every strip (pointer to strip data and number of rows); return false to abort.
+ * \return If the display size was set up, \p pPosterSize is valid and \p pWriteRows returned true for all strips.
+ *
+ * \throws std::runtime_error Could not create a temporary tile file (see TileStore()).
+ */
+bool Projector::renderPoster(const sf::Vector2u pPosterSize, const std::function<bool(const sf::Uint8*, unsigned int)>& pWriteRows)
+{
+    //Size of the strip buffer (determines the number of rows per strip)
+    constexpr std::size_t stripBufferSize = 8 * 1024 * 1024;
+
+    if (displaySize.x <= 0 || displaySize.y <= 0 || pPosterSize.x == 0 || pPosterSize.y == 0 ||
+        pPosterSize.x > stripBufferSize || pPosterSize.y > (1u << 30))
+    {
+        return false;
+    }
+
+    const sf::Vector2i posterSize(pPosterSize.x, pPosterSize.y);
+
+    //Same vertical field of view as display projection (see updateDisplayFOV())
+    const float posterF = posterSize.y / 2. / std::tan(fovCentHor.y / 2.) * zoom;
+
+    //Only the poster columns need a full transformation cache
+
+    std::vector<float> staticTrafosX(posterSize.x+1, 0);
+
+    for (int x = 0; x <= posterSize.x; ++x)
+        staticTrafosX[x] = staticDisplayTrafoX(x, posterSize, posterF);
+
+    //Choose panorama sphere size for the poster's resolution as in mapPicToPanoSphere() (lowest oversampling at top left corner)
+
+    sf::Vector2i sphereSize = calcFullPanoSphereSize();
+    float scaleFactor = 1;
+
+    const float over = std::min((staticTrafosX[1] - staticTrafosX[0]) * sphereSize.x / fovCentHor.x,
+                                (staticDisplayTrafoY(1, 0, posterSize, posterF) - staticDisplayTrafoY(0, 0, posterSize, posterF)) *
+                                sphereSize.y / fovCentHor.y);
+
+    if (over > panoSphereRemapHystTargOvers)
+    {
+        scaleFactor = panoSphereRemapHystTargOvers / over;
+        sphereSize = calcScaledPanoSphereSize(scaleFactor);
+    }
+
+    std::vector<float> trafosX(posterSize.x+1, 0);
+
+    for (int x = 0; x <= posterSize.x; ++x)
+        trafosX[x] = (staticTrafosX[x] + viewOffsetPhi) * sphereSize.x / fovCentHor.x;
+
+    std::vector<float>().swap(staticTrafosX);
+
+    //Scratch buffers for a single strip of rows
+
+    const int stripRows = static_cast<int>(std::clamp<std::size_t>(stripBufferSize / (4 * static_cast<std::size_t>(posterSize.x)),
+                                                                   1, posterSize.y));
+
+    std::vector<sf::Uint8> stripData(4 * static_cast<std::size_t>(posterSize.x) * stripRows, 255);
+    std::vector<float> trafosY(static_cast<std::size_t>(posterSize.x+1) * (stripRows+1), 0);
+
+    bool success = true;
+
+    auto renderStrips = [this, &pWriteRows, posterSize, posterF, sphereSize, &trafosX, &trafosY, stripRows, &stripData,
+                         &success](auto& pSphere, const std::size_t pTempSphereSize) -> void
+    {
+        for (int stripY = 0; stripY < posterSize.y; stripY += stripRows)
+        {
+            const int numRows = std::min(stripRows, posterSize.y - stripY);
+
+            for (int y = 0; y <= numRows; ++y)
+            {
+                for (int x = 0; x <= posterSize.x; ++x)
+                {
+                    trafosY[static_cast<std::size_t>(posterSize.x+1)*y + x] =
+                            (staticDisplayTrafoY(stripY + y, x, posterSize, posterF) + viewOffsetTheta) *
+                            sphereSize.y / fovCentHor.y + sphereSize.y / 2.;
+                }
+            }
+
+            projectSphereToDisplay(pSphere, numRows, trafosX, trafosY,
+                                   DisplayPixels<PixelFormat::RGBA>(stripData.data(), 4 * static_cast<std::size_t>(posterSize.x)));
+
+            trackPeakMemoryUsage((trafosX.capacity() + trafosY.capacity()) * sizeof(float), pTempSphereSize, stripData.capacity());
+
+            if (!pWriteRows(stripData.data(), static_cast<unsigned int>(numRows)))
+            {
+                success = false;
+                return;
+            }
+        }
+    };
+
+    visitPanoSphereOfSize(sphereSize, scaleFactor, renderStrips);
+
+    return success;
+}
+
+/*!
+ * \brief Render the current perspective at an arbitrary size and save it as PNG file.
+ *
+ * Streams the strips from renderPoster() directly to the PNG file \p pFileName (see PngWriter),
+ * such that the full poster is never held in memory. On failure the file is removed again.
+ *
+ * \param pFileName File name of the PNG file.
+ * \param pPosterSize Size of the rendered poster.
+ * \return If successful.
+ *
+ * \throws std::runtime_error Could not create a temporary tile file (see TileStore()).
+ */
+bool Projector::savePoster(const std::string& pFileName, const sf::Vector2u pPosterSize)
+{
+    PngWriter writer;
+
+    if (!writer.open(pFileName, pPosterSize))
+        return false;
+
+    auto writeRows = [&writer](const sf::Uint8 *const pPixels, const unsigned int pNumRows) -> bool
+    {
+        return writer.writeRows(pPixels, pNumRows);
+    };
+
+    if (!renderPoster(pPosterSize, writeRows))
+    {
+        std::cerr<<"ERROR: Could not render the poster \"" + pFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    return writer.close();
+}
+
+/*!
+ * \brief Render the current perspective into a caller-provided buffer.
+ *
+ * Renders the same display projection as for getDisplayData() (current display size and perspective, see updateView())
+ * directly into \p pOutput, in its pixel format and with its row stride (see OutputBuffer), e.g. into a mapped GPU
+ * staging buffer or shared memory (see SharedFrameOutput::getBackBuffer()). This avoids converting or copying the
+ * display buffer afterwards. The display buffer itself is not changed and the projection is always complete
+ * (see setDisplayTimeLimit() and cancelDisplayUpdate(), which do not apply here).
+ *
+ * The transformations are calculated in bands of 'displayTileSize' rows, so that no full-size transformation cache
+ * is needed. A tiled panorama sphere (see Projector()) is fetched row by row as for the display projection.
+ *
+ * \param pOutput Target buffer.
+ * \return If \p pOutput is valid (size equal to display size, pixel buffer set and stride large enough for a row).
+ */
+bool Projector::renderInto(const OutputBuffer& pOutput)
+{
+    const std::size_t rowLength = PanoramaScene::getBytesPerPixel(pOutput.format) * pOutput.size.x;
+
+    if (pOutput.pixels == nullptr || displaySize.x <= 0 || displaySize.y <= 0 || sf::Vector2i(pOutput.size) != displaySize ||
+            (pOutput.stride != 0 && pOutput.stride < rowLength))
+    {
+        return false;
+    }
+
+    const std::size_t stride = (pOutput.stride != 0 ? pOutput.stride : rowLength);
+
+    std::vector<float> trafosX(displaySize.x+1, 0);
+
+    for (int x = 0; x <= displaySize.x; ++x)
+        trafosX[x] = displayTrafoX(x);
+
+    std::vector<float> bandTrafosY;
+
+    for (int bandY = 0; bandY < displaySize.y; bandY += displayTileSize)
+    {
+        const int bandHeight = std::min(displayTileSize, displaySize.y - bandY);
+
+        bandTrafosY.resize(static_cast<std::size_t>(displaySize.x+1) * (bandHeight+1));
+
+        for (int y = 0; y <= bandHeight; ++y)
+            for (int x = 0; x <= displaySize.x; ++x)
+                bandTrafosY[static_cast<std::size_t>(displaySize.x+1)*y + x] = displayTrafoY(bandY + y, x);
+
+        sf::Uint8 *const bandPixels = pOutput.pixels + stride * bandY;
+
+        auto projectBand = [bandHeight, bandPixels, stride, &pOutput, &trafosX, &bandTrafosY](auto& pSphere) -> void
+        {
+            auto project = [&pSphere, bandHeight, &trafosX, &bandTrafosY](const auto& pTarget) -> void
+            {
+                projectSphereToDisplay(pSphere, bandHeight, trafosX, bandTrafosY, pTarget);
+            };
+
+            visitDisplayPixels(bandPixels, stride, pOutput.format, project);
+        };
+
+        visitPanoSphereSource(projectBand);
+    }
+
+    trackPeakMemoryUsage((trafosX.capacity() + bandTrafosY.capacity()) * sizeof(float));
+
+    return true;
+}
+
+//
+
+/*!
+ * \brief Check if the panorama scene covers the full 360 degrees horizontally.
+ *
+ * \return If the horizontal field of view is 360 degrees (within rounding).
+ */
+bool Projector::coversFullCircle() const
+{
+    return static_cast<int>(fovCentHor.x * 10000) + 1 >= static_cast<int>(2*M_PI * 10000);
+}
+
+/*!
+ * \brief Render an arbitrary projection defined by the angles of its pixel corners.
+ *
+ * Fills \p pPixels ("rgba", see getDisplayData(), of size AngleMap::size of \p pAngleMap) with the panorama sphere region
+ * covered by every pixel according to the angles of its four corners (see AngleMap), horizontally rotated by \p pOffsetPhi.
+ * If \p pMirrorVertically is set, the rows of \p pAngleMap are used in reverse order and with negated 'theta' angles,
+ * which e.g. turns a projection looking upwards into one looking downwards (such that one AngleMap serves both).
+ *
+ * The colors are interpolated over the bounding rectangle of the four corners (see interpolatePixel()), which allows for
+ * projections that are not rectilinear (e.g. cube faces around the poles). Pixels covering a pole take all 'phi' angles.
+ * Pixels outside of the field of view of the scene are black.
+ *
+ * The panorama sphere resolution is chosen for AngleMap::minPixelAngle as for the display projection (see mapPicToPanoSphere())
+ * and a temporary panorama sphere is used, if it differs from the current one (see visitPanoSphereOfSize()). This does
+ * \e not require a display size or perspective (see updateDisplaySize()) and does not change them either.
+ * Before every pixel row, only the full-width band of panorama sphere rows covered by it is fetched
+ * (see TileStore::fetchRegion()), so that tiled storage keeps its memory limit.
+ *
+ * \param pAngleMap Angles of all pixel corners.
+ * \param pOffsetPhi Horizontal rotation added to all 'phi' angles.
+ * \param pMirrorVertically Use rows of \p pAngleMap in reverse order and negate 'theta'.
+ * \param pPixels Target buffer for the projection.
+ * \return If \p pAngleMap is valid (number of corners matches its size).
+ *
+ * \throws std::runtime_error Could not create a temporary tile file (see TileStore()).
+ */
+bool Projector::renderAngleMap(const AngleMap& pAngleMap, const float pOffsetPhi, const bool pMirrorVertically, sf::Uint8 *const pPixels)
+{
+    const sf::Vector2i size = pAngleMap.size;
+
+    if (size.x <= 0 || size.y <= 0 || pAngleMap.minPixelAngle <= 0 ||
+        pAngleMap.corners.size() != static_cast<std::size_t>(size.x+1) * static_cast<std::size_t>(size.y+1))
+    {
+        return false;
+    }
+
+    //Choose panorama sphere size for the required resolution as in mapPicToPanoSphere()
+
+    sf::Vector2i sphereSize = calcFullPanoSphereSize();
+    float scaleFactor = 1;
+
+    const float over = pAngleMap.minPixelAngle * sphereSize.x / fovCentHor.x;
+
+    if (over > panoSphereRemapHystTargOvers)
+    {
+        scaleFactor = panoSphereRemapHystTargOvers / over;
+        sphereSize = calcScaledPanoSphereSize(scaleFactor);
+    }
+
+    const bool fullCircle = coversFullCircle();
+
+    auto render = [this, &pAngleMap, pOffsetPhi, pMirrorVertically, pPixels, size, sphereSize,
+                   fullCircle](auto& pSphere, const std::size_t pTempSphereSize) -> void
+    {
+        //Scale from angles to panorama sphere buffer positions (with horizontal origin at left edge of the scene)
+        const float scaleX = sphereSize.x / fovCentHor.x;
+        const float scaleY = sphereSize.y / fovCentHor.y;
+        const float offsetX = (pOffsetPhi + fovCentHor.x / 2.) * scaleX;
+        const float offsetY = sphereSize.y / 2.;
+
+        for (int y = 0; y < size.y; ++y)
+        {
+            //Corner rows of the pixel row (reversed if mirrored)
+            const int topRow = pMirrorVertically ? size.y - y : y;
+            const int bottomRow = pMirrorVertically ? size.y - y - 1 : y + 1;
+
+            const sf::Vector2f* topCorners = pAngleMap.corners.data() + static_cast<std::size_t>(size.x+1) * topRow;
+            const sf::Vector2f* bottomCorners = pAngleMap.corners.data() + static_cast<std::size_t>(size.x+1) * bottomRow;
+
+            //Fetch the full-width band of panorama sphere rows covered by the pixel row (any 'phi' angle may occur near the poles)
+            float rowMinTheta = topCorners[0].y, rowMaxTheta = topCorners[0].y;
+
+            for (int x = 0; x <= size.x; ++x)
+            {
+                rowMinTheta = std::min({rowMinTheta, topCorners[x].y, bottomCorners[x].y});
+                rowMaxTheta = std::max({rowMaxTheta, topCorners[x].y, bottomCorners[x].y});
+            }
+
+            pSphere.fetchRegion(0, static_cast<int>(std::floor((pMirrorVertically ? -rowMaxTheta : rowMinTheta) * scaleY + offsetY)),
+                                sphereSize.x - 1, static_cast<int>((pMirrorVertically ? -rowMinTheta : rowMaxTheta) * scaleY + offsetY));
+
+            for (int x = 0; x < size.x; ++x)
+            {
+                const std::array<sf::Vector2f, 4> corners = {topCorners[x], topCorners[x+1], bottomCorners[x], bottomCorners[x+1]};
+
+                //Bounding rectangle of the corners; unwrap 'phi' angles relative to the first corner
+                float minPhi = corners[0].x, maxPhi = corners[0].x;
+                float minTheta = corners[0].y, maxTheta = corners[0].y;
+
+                for (const sf::Vector2f& corner : corners)
+                {
+                    float phi = corner.x;
+
+                    if (phi - corners[0].x > M_PI)
+                        phi -= 2*M_PI;
+                    else if (phi - corners[0].x < -M_PI)
+                        phi += 2*M_PI;
+
+                    minPhi = std::min(minPhi, phi);
+                    maxPhi = std::max(maxPhi, phi);
+                    minTheta = std::min(minTheta, corner.y);
+                    maxTheta = std::max(maxTheta, corner.y);
+                }
+
+                //A pixel covering a pole covers all 'phi' angles
+                if (maxPhi - minPhi > M_PI)
+                {
+                    minPhi = corners[0].x - M_PI;
+                    maxPhi = corners[0].x + M_PI;
+                }
+
+                float tLx = minPhi * scaleX + offsetX;
+                float bRx = maxPhi * scaleX + offsetX;
+                float tLy = (pMirrorVertically ? -maxTheta : minTheta) * scaleY + offsetY;
+                float bRy = (pMirrorVertically ? -minTheta : maxTheta) * scaleY + offsetY;
+
+                sf::Uint8 *const targetPixel = pPixels + 4 * (static_cast<std::size_t>(size.x) * y + x);
+
+                targetPixel[3] = 255;
+
+                //Wrap horizontally for 360 degree panoramas (see interpolatePixel()), otherwise clip at the scene edges
+                if (fullCircle)
+                {
+                    const float shift = std::floor(tLx / sphereSize.x) * sphereSize.x;
+
+                    tLx -= shift;
+                    bRx = std::min(bRx - shift, tLx + sphereSize.x);
+                }
+                else
+                {
+                    tLx = std::max(tLx, 0.f);
+                    bRx = std::min(bRx, static_cast<float>(sphereSize.x));
+                }
+
+                tLy = std::max(tLy, 0.f);
+                bRy = std::min(bRy, static_cast<float>(sphereSize.y));
+
+                //Outside of the scene's field of view
+                if (tLx >= bRx || tLy >= bRy || tLx >= sphereSize.x || tLy >= sphereSize.y)
+                {
+                    targetPixel[0] = targetPixel[1] = targetPixel[2] = 0;
+                    continue;
+                }
+
+                interpolatePixel(pSphere, {std::ref(targetPixel[0]), std::ref(targetPixel[1]), std::ref(targetPixel[2])},
+                                 tLx, tLy, bRx, bRy);
+            }
+        }
+
+        trackPeakMemoryUsage(0, pTempSphereSize);
+    };
+
+    visitPanoSphereOfSize(sphereSize, scaleFactor, render);
+
+    return true;
+}
+
+/*!
+ * \brief Calculate the angle map of a rectilinear projection centered at the horizon.
+ *
+ * Uses the same transformations as the display projection (see staticDisplayTrafoX() and staticDisplayTrafoY())
+ * for a projection of size \p pSize with horizontal field of view \p pHFOV, looking at 'phi' = 'theta' = 0.
+ * The result can be rendered for any scene and horizontal view angle with renderAngleMap().
+ *
+ * \param pSize Size of the projection.
+ * \param pHFOV Horizontal field of view of the projection.
+ * \return Angles of all pixel corners of the projection.
+ */
+Projector::AngleMap Projector::createRectilinearAngleMap(const sf::Vector2i pSize, const float pHFOV)
+{
+    AngleMap angleMap;
+
+    angleMap.size = pSize;
+    angleMap.corners.resize(static_cast<std::size_t>(pSize.x+1) * static_cast<std::size_t>(pSize.y+1));
+
+    const float f = pSize.x / 2. / std::tan(pHFOV / 2.);
+
+    for (int y = 0; y <= pSize.y; ++y)
+        for (int x = 0; x <= pSize.x; ++x)
+            angleMap.corners[static_cast<std::size_t>(pSize.x+1)*y + x] = {staticDisplayTrafoX(x, pSize, f),
+                                                                           staticDisplayTrafoY(y, x, pSize, f)};
+
+    //Pixels cover the smallest angles at the corners (see calcLowestDisplayTrafoOversampling())
+    angleMap.minPixelAngle = std::min(angleMap.corners[1].x - angleMap.corners[0].x,
+                                      angleMap.corners[pSize.x+1].y - angleMap.corners[0].y);
+
+    return angleMap;
+}
+
+//
+
+/*!
+ * \brief Get the memory currently occupied by the different buffers.
+ *
+ * For tiled storage (see ProjectorOptions) only the currently fetched tiles are counted (see TileStore::getResidentMemory())
+ * and a memory-mapped panorama sphere cache file (see ProjectorOptions) is not counted at all, because the operating system
+ * can drop their memory at any time. The transformation caches only include the ones that are permanently kept
+ * and the ones prepared in advance (see precomputeDisplayTrafos()).
+ *
+ * \return Current memory usage.
+ */
+Projector::MemoryUsage Projector::getMemoryUsage() const
+{
+    MemoryUsage usage;
+
+    usage.picture = picTiles ? picTiles->getResidentMemory() : (pic ? 4 * static_cast<std::size_t>(pic->getSize().x) * pic->getSize().y : 0);
+    usage.panoSphere = panoSphereTiles ? panoSphereTiles->getResidentMemory() : panoSphereData.capacity();
+    usage.spherePyramid = panoSpherePyramid ? panoSpherePyramid->getMemoryUsage() : 0;
+    usage.trafoCaches = (staticDisplayTrafosX.capacity() + staticDisplayTrafosY.capacity()) * sizeof(float);
+
+    //Transformations prepared in advance (see precomputeDisplayTrafos())
+    if (precomputedDisplayTrafos.valid())
+    {
+        usage.trafoCaches += static_cast<std::size_t>(precomputedDisplaySize.x+1) * (precomputedDisplaySize.y+2) * sizeof(float);
+    }
+    usage.displayData = displayData.capacity();
+
+    usage.total = usage.picture + usage.panoSphere + usage.spherePyramid + usage.trafoCaches + usage.displayData;
+
+    return usage;
+}
+
+/*!
+ * \brief Get the maximum memory occupied by the different buffers so far.
+ *
+ * Every value is the maximum of the respective value of getMemoryUsage() since construction, also including
+ * short-lived buffers (the picture while building a SpherePyramid, the temporary transformation caches
+ * used by updateDisplayData() and the temporary buffers used by renderPoster() and renderAngleMap()).
+ * Note that MemoryUsage::total is the maximum of the \e sum of the other values at any one time
+ * and hence can be smaller than the sum of the maxima.
+ *
+ * \return Peak memory usage.
+ */
+Projector::MemoryUsage Projector::getPeakMemoryUsage() const
+{
+    return peakMemoryUsage;
+}
+
+/*!
+ * \brief Format current and peak memory usage as a human-readable table.
+ *
+ * Lists current (see getMemoryUsage()) and peak (see getPeakMemoryUsage()) memory usage of all buffers in MiB.
+ *
+ * \return Multi-line memory usage report.
+ */
+std::string Projector::getMemoryUsageReport() const
+{
+    const MemoryUsage current = getMemoryUsage();
+    const MemoryUsage peak = getPeakMemoryUsage();
+
+    auto formatLine = [](const std::string& pName, const std::size_t pCurrent, const std::size_t pPeak) -> std::string
+    {
+        char line[80];
+        std::snprintf(line, sizeof(line), "%-16s%12.1f%12.1f\n", pName.c_str(), pCurrent / 1048576., pPeak / 1048576.);
+        return line;
+    };
+
+    std::string report = "Memory usage (MiB)   current        peak\n";
+
+    report.append(formatLine("picture", current.picture, peak.picture));
+    report.append(formatLine("panorama sphere", current.panoSphere, peak.panoSphere));
+    report.append(formatLine("sphere pyramid", current.spherePyramid, peak.spherePyramid));
+    report.append(formatLine("trafo caches", current.trafoCaches, peak.trafoCaches));
+    report.append(formatLine("display data", current.displayData, peak.displayData));
+    report.append(formatLine("total", current.total, peak.total));
+
+    return report;
+}
+
+//Private
+
+/*!
+ * \brief Load the panorama picture and check its size.
+ *
+ * \throws std::runtime_error Picture loading failed (unsupported file format, file does not exist, etc.).
+ * \throws std::runtime_error Picture size does not match the cropped picture size from the scene meta data.
+ */
+void Projector::loadPicture()
+{
+    pic = std::make_unique<sf::Image>();
+
+    if (!pic->loadFromFile(fileName))
+        throw std::runtime_error("Could not load the picture \"" + fileName + "\"!");
+
+    if (pic->getSize().x != static_cast<unsigned int>(picSize.x) || pic->getSize().y != static_cast<unsigned int>(picSize.y))
+        throw std::runtime_error("Loaded picture size does not match specified cropped picture size!");
+
+    trackPeakMemoryUsage();
+}
+
+/*!
+ * \brief Memory-map panorama sphere pyramid from cache file or create it from the picture and write the cache file.
+ *
+ * Tries to load a SpherePyramid from the "PNVC file" belonging to the picture (see SpherePyramid::getCacheFileName()).
+ * The cache file is only used if it matches the picture file and scene meta data (see SpherePyramid::makeCacheKey()).
+ *
+ * Otherwise the picture is loaded (see loadPicture()) and the pyramid is built from it (see createSpherePyramid())
+ * and written to the cache file. If writing succeeds, the pyramid is memory-mapped from the new file to keep its data
+ * evictable from memory.
+ *
+ * \throws std::runtime_error Picture loading failed (see loadPicture()).
+ * \throws std::filesystem::filesystem_error Could not query picture file properties (see SpherePyramid::makeCacheKey()).
+ */
+void Projector::loadOrCreateSphereCache()
+{
+    const SpherePyramid::CacheKey cacheKey = SpherePyramid::makeCacheKey(fileName, SceneMetaData(projectionType, picUncroppedSize,
+                                                                                                 picUncroppedFOV, picCropPosTL,
+                                                                                                 picCropPosBR));
+    const std::string cacheFileName = SpherePyramid::getCacheFileName(fileName);
+
+    //Use existing cache file, if it matches
+
+    std::shared_ptr<SpherePyramid> mappedPyramid = std::make_shared<SpherePyramid>();
+
+    if (mappedPyramid->loadFromCacheFile(cacheFileName, cacheKey) && mappedPyramid->getLevelSize(0) == calcFullPanoSphereSize())
+    {
+        panoSpherePyramid = std::move(mappedPyramid);
+        return;
+    }
+
+    //Create pyramid from full resolution panorama sphere
+
+    loadPicture();
+
+    createSpherePyramid();
+
+    if (!panoSpherePyramid->saveToCacheFile(cacheFileName, cacheKey))
+    {
+        std::cerr<<"WARNING: Could not write panorama sphere cache file \"" + cacheFileName + "\"!"<<std::endl;
+        return;
+    }
+
+    //Replace in-memory pyramid by mapped file
+    if (mappedPyramid->loadFromCacheFile(cacheFileName, cacheKey))
+        panoSpherePyramid = std::move(mappedPyramid);
+}
+
+/*!
+ * \brief Build panorama sphere pyramid from the picture and release the picture.
+ *
+ * Projects the loaded picture onto a panorama sphere of full resolution (see calcFullPanoSphereSize()),
+ * from which an in-memory SpherePyramid is built. As the pyramid replaces the picture as source
+ * for mapPicToPanoSphere(), the picture is released afterwards.
+ */
+void Projector::createSpherePyramid()
+{
+    const sf::Vector2i fullSphereSize = calcFullPanoSphereSize();
+
+    std::vector<sf::Uint8> fullSphereData(4 * static_cast<std::size_t>(fullSphereSize.x) * static_cast<std::size_t>(fullSphereSize.y), 255);
+
+    FlatPixels<sf::Uint8> fullSphere(fullSphereSize, fullSphereData.data());
+    mapPicToSphereBuffer(1, fullSphere);
+
+    panoSpherePyramid = std::make_shared<const SpherePyramid>(fullSphereSize, std::move(fullSphereData));
+
+    //Both picture and pyramid are in memory at this point
+    trackPeakMemoryUsage();
+
+    //Picture not needed anymore
+    pic.reset();
+}
+
+//
+
+/*!
+ * \brief Update the peak memory usage with the current memory usage.
+ *
+ * Raises every value of the peak memory usage (see getPeakMemoryUsage()) to the according value of getMemoryUsage(),
+ * if larger. The size \p pTransientTrafoCacheSize of temporary transformation caches is added to the current value
+ * for the transformation caches (see updateDisplayData()). Likewise, the sizes of a temporary panorama sphere
+ * and of temporary display projection buffers are added (see renderPoster()).
+ *
+ * \param pTransientTrafoCacheSize Size of temporary transformation caches in bytes.
+ * \param pTransientSphereSize Size of a temporary panorama sphere in bytes.
+ * \param pTransientDisplaySize Size of temporary display projection buffers in bytes.
+ */
+void Projector::trackPeakMemoryUsage(const std::size_t pTransientTrafoCacheSize, const std::size_t pTransientSphereSize,
+                                     const std::size_t pTransientDisplaySize)
+{
+    MemoryUsage usage = getMemoryUsage();
+
+    usage.trafoCaches += pTransientTrafoCacheSize;
+    usage.panoSphere += pTransientSphereSize;
+    usage.displayData += pTransientDisplaySize;
+    usage.total += pTransientTrafoCacheSize + pTransientSphereSize + pTransientDisplaySize;
+
+    peakMemoryUsage.picture = std::max(peakMemoryUsage.picture, usage.picture);
+    peakMemoryUsage.panoSphere = std::max(peakMemoryUsage.panoSphere, usage.panoSphere);
+    peakMemoryUsage.spherePyramid = std::max(peakMemoryUsage.spherePyramid, usage.spherePyramid);
+    peakMemoryUsage.trafoCaches = std::max(peakMemoryUsage.trafoCaches, usage.trafoCaches);
+    peakMemoryUsage.displayData = std::max(peakMemoryUsage.displayData, usage.displayData);
+    peakMemoryUsage.total = std::max(peakMemoryUsage.total, usage.total);
+}
+
+/*!
+ * \brief Throw if loading was cancelled via the cancel flag.
+ *
+ * Checks the cancel flag from ProjectorOptions (if any) such that long-running
+ * panorama sphere mappings can be abandoned from another thread.
  *
- * \return Image data of display projection as flat array.
+ * \throws std::runtime_error The cancel flag is set.
  */
-const std::vector<sf::Uint8>& Projector::getDisplayData() const
+void Projector::throwIfCancelled() const
 {
-    return displayData;
+    if (cancelFlag && *cancelFlag)
+        throw std::runtime_error("Loading was cancelled.");
 }
 
-//Private
+//
 
 /*!
  * \brief Calculate 'phi' and 'theta' angle of cropped picture's top left corner.
@@ -368,11 +1653,13 @@ sf::Vector2f Projector::calcBottomRightFOV() const
  * it may be useful to cache them (see also updateStaticDisplayTrafoCache()).
  *
  * \param pX Horizontal display position.
+ * \param pDisplaySize Size of the display projection.
+ * \param pF Focal length-like parameter of the display projection (see updateDisplayFOV()).
  * \return Corresponding 'phi' angle in the centered panorama sphere.
  */
-float Projector::staticDisplayTrafoX(const int pX) const
+float Projector::staticDisplayTrafoX(const int pX, const sf::Vector2i pDisplaySize, const float pF)
 {
-    return std::atan2(static_cast<float>(pX) - static_cast<float>(displaySize.x) / 2., f);
+    return std::atan2(static_cast<float>(pX) - static_cast<float>(pDisplaySize.x) / 2., pF);
 }
 
 /*!
@@ -388,12 +1675,14 @@ float Projector::staticDisplayTrafoX(const int pX) const
  *
  * \param pY Vertical display position.
  * \param pX Horizontal display position.
+ * \param pDisplaySize Size of the display projection.
+ * \param pF Focal length-like parameter of the display projection (see updateDisplayFOV()).
  * \return Corresponding 'theta' angle in the centered panorama sphere.
  */
-float Projector::staticDisplayTrafoY(const int pY, const int pX) const
+float Projector::staticDisplayTrafoY(const int pY, const int pX, const sf::Vector2i pDisplaySize, const float pF)
 {
-    return std::atan((static_cast<float>(pY) - static_cast<float>(displaySize.y) / 2.) / f *
-                     std::sin(std::atan2(f, static_cast<float>(pX) - static_cast<float>(displaySize.x) / 2.)));
+    return std::atan((static_cast<float>(pY) - static_cast<float>(pDisplaySize.y) / 2.) / pF *
+                     std::sin(std::atan2(pF, static_cast<float>(pX) - static_cast<float>(pDisplaySize.x) / 2.)));
 }
 
 /*!
@@ -454,18 +1743,49 @@ float Projector::displayTrafoY(const int pY, const int pX) const
  *
  * An up to date cache is needed by displayTrafoX() and displayTrafoY().
  * The transformations must change when the zoom or display size change.
+ *
+ * Transformations prepared in advance for the same display size and zoom are taken over (see precomputeDisplayTrafos()).
  */
 void Projector::updateStaticDisplayTrafoCache()
 {
+    //Take over transformations prepared in advance for the same display size and focal length (see precomputeDisplayTrafos())
+    if (precomputedDisplayTrafos.valid() && precomputedDisplaySize == displaySize && precomputedF == f)
+    {
+        DisplayTrafoCache cache = precomputedDisplayTrafos.get();
+
+        staticDisplayTrafosX = std::move(cache.trafosX);
+        staticDisplayTrafosY = std::move(cache.trafosY);
+
+        return;
+    }
+
+    //Release prepared transformations that turned out not to match
+    releasePrecomputedDisplayTrafos();
+
     staticDisplayTrafosX.resize(displaySize.x+1, 0);
     staticDisplayTrafosY.resize((displaySize.x+1)*(displaySize.y+1), 0);
 
     for (int x = 0; x <= displaySize.x; ++x)
-        staticDisplayTrafosX[x] = staticDisplayTrafoX(x);
+        staticDisplayTrafosX[x] = staticDisplayTrafoX(x, displaySize, f);
 
     for (int y = 0; y <= displaySize.y; ++y)
         for (int x = 0; x <= displaySize.x; ++x)
-            staticDisplayTrafosY[(displaySize.x+1)*y + x] = staticDisplayTrafoY(y, x);
+            staticDisplayTrafosY[(displaySize.x+1)*y + x] = staticDisplayTrafoY(y, x, displaySize, f);
+}
+
+/*!
+ * \brief Discard the display projection transformations prepared in advance.
+ *
+ * Releases the transformations prepared by precomputeDisplayTrafos(), if any. A still running
+ * calculation is told to stop and only waited for until it noticed that (at most one row).
+ */
+void Projector::releasePrecomputedDisplayTrafos()
+{
+    if (!precomputedDisplayTrafos.valid())
+        return;
+
+    precomputeCancelled = true;
+    precomputedDisplayTrafos.get();
 }
 
 //
@@ -515,6 +1835,61 @@ float Projector::calcLowestDisplayTrafoOversampling() const
  * is actually wider than the total available field of view of the panorama scene.
  */
 void Projector::fitViewOffset()
+{
+    clipViewOffset(viewOffsetPhi, viewOffsetTheta, displayFOV, fovCentHor, fovTL, fovBR);
+}
+
+/*!
+ * \brief Apply the special zoom values and the lower zoom limit.
+ *
+ * If \p pZoom is -1, it is set to \p pMinZoomCentHor and \p pOffsetTheta to 0 (centered horizon).
+ * Otherwise \p pZoom is raised to \p pMinZoomNonCentHor, which also replaces the special value 0.
+ * See updateView() for the meaning of these values. Also used by PanoramaScene::fitView().
+ *
+ * \param pZoom Zoom level to adjust.
+ * \param pOffsetTheta Vertical view angle offset to adjust.
+ * \param pMinZoomCentHor Minimum possible zoom under centered horizon condition.
+ * \param pMinZoomNonCentHor Minimum possible zoom without centered horizon condition.
+ */
+void Projector::clipZoom(float& pZoom, float& pOffsetTheta, const float pMinZoomCentHor, const float pMinZoomNonCentHor)
+{
+    if (pZoom == -1)
+    {
+        //Set minimum possible zoom under centered horizon condition
+        pZoom = pMinZoomCentHor;
+
+        pOffsetTheta = 0;
+    }
+    else if (pZoom < pMinZoomNonCentHor)
+    {
+        //Constrain zoom level with lower limit to avoid margins; for 0 this is the minimum possible zoom under condition
+        //of "perfect" theta angle (that just avoids both top and bottom margins and which is figured out by clipViewOffset())
+        pZoom = pMinZoomNonCentHor;
+    }
+}
+
+/*!
+ * \brief Clip a view angle offset to stay within an available field of view.
+ *
+ * Calculates minimum/maximum 'phi' and 'theta' angles for keeping the field of view \p pViewFOV
+ * within the available field of view of the panorama scene (no margins), given by \p pFOVCentHor,
+ * \p pFOVTL and \p pFOVBR (see calcTopLeftFOV() and calcBottomRightFOV()).
+ *
+ * Clips \p pOffsetPhi and \p pOffsetTheta at these values. Also ensures 'phi' within [0, 2*pi).
+ *
+ * Additionally, centers 'phi' if the horizontal field of view \p pViewFOV is actually
+ * wider than the total available field of view of the panorama scene.
+ * See fitViewOffset(). Also used by PanoramaScene::fitView().
+ *
+ * \param pOffsetPhi Horizontal view angle offset to adjust.
+ * \param pOffsetTheta Vertical view angle offset to adjust.
+ * \param pViewFOV Horizontal and vertical field of view of the view.
+ * \param pFOVCentHor Total horizontal and vertical field of view of the panorama scene.
+ * \param pFOVTL Top left 'phi' and 'theta' angle of the panorama scene.
+ * \param pFOVBR Bottom right 'phi' and 'theta' angle of the panorama scene.
+ */
+void Projector::clipViewOffset(float& pOffsetPhi, float& pOffsetTheta, const sf::Vector2f pViewFOV, const sf::Vector2f pFOVCentHor,
+                               const sf::Vector2f pFOVTL, const sf::Vector2f pFOVBR)
 {
     //Lambda for sane, rounded comparison of two floats within 4 decimal places
     auto roundedCompareSmaller = [](float pLeft, float pRight) -> bool
@@ -522,31 +1897,31 @@ void Projector::fitViewOffset()
         return (static_cast<int>(pLeft * 10000) + 1) < static_cast<int>(pRight * 10000);
     };
 
-    //Limit horizontal view angle offset such that no point in display projection is beyond available FOV;
+    //Limit horizontal view angle offset such that no point in the view is beyond available FOV;
     //in case of a 360 degree panorama do not limit horizontal view angle offset, but keep it within [0, 2*PI)
-    if (roundedCompareSmaller(fovCentHor.x, 2*M_PI))
+    if (roundedCompareSmaller(pFOVCentHor.x, 2*M_PI))
     {
-        if (fovCentHor.x < displayFOV.x)
-            viewOffsetPhi = fovCentHor.x / 2.;  //Horizontally center the scene if display FOV is wider than scene FOV
-        else if (viewOffsetPhi < displayFOV.x / 2.)
-            viewOffsetPhi = displayFOV.x / 2.;
-        else if (viewOffsetPhi > fovCentHor.x - displayFOV.x / 2.)
-            viewOffsetPhi = fovCentHor.x - displayFOV.x / 2.;
+        if (pFOVCentHor.x < pViewFOV.x)
+            pOffsetPhi = pFOVCentHor.x / 2.;    //Horizontally center the scene if view FOV is wider than scene FOV
+        else if (pOffsetPhi < pViewFOV.x / 2.)
+            pOffsetPhi = pViewFOV.x / 2.;
+        else if (pOffsetPhi > pFOVCentHor.x - pViewFOV.x / 2.)
+            pOffsetPhi = pFOVCentHor.x - pViewFOV.x / 2.;
     }
     else
     {
-        if (viewOffsetPhi < 0)
-            viewOffsetPhi += 2*M_PI;
-        else if (viewOffsetPhi >= 2*M_PI)
-            viewOffsetPhi -= 2*M_PI;
+        pOffsetPhi = std::fmod(pOffsetPhi, static_cast<float>(2*M_PI));
+
+        if (pOffsetPhi < 0)
+            pOffsetPhi += 2*M_PI;
     }
 
-    //Also limit vertical view angle offset such that no point in display projection is beyond available FOV
+    //Also limit vertical view angle offset such that no point in the view is beyond available FOV
 
-    if (displayFOV.y / 2. - viewOffsetTheta > fovTL.y)
-        viewOffsetTheta = (displayFOV.y / 2. - fovTL.y);
-    else if (displayFOV.y / 2. + viewOffsetTheta > -fovBR.y)
-        viewOffsetTheta = -(displayFOV.y / 2. + fovBR.y);
+    if (pViewFOV.y / 2. - pOffsetTheta > pFOVTL.y)
+        pOffsetTheta = (pViewFOV.y / 2. - pFOVTL.y);
+    else if (pViewFOV.y / 2. + pOffsetTheta > -pFOVBR.y)
+        pOffsetTheta = -(pViewFOV.y / 2. + pFOVBR.y);
 }
 
 //
@@ -613,51 +1988,97 @@ void Projector::updateDisplayFOV(const bool pForceRemapSphere)
  * at the current perspective defined by zoom level and view angle offset. Pixel colors are
  * interpolated between the two buffers of arbitrary resolution via a simple area weighting
  * (see also interpolatePixel()).
+ *
+ * If the panorama sphere is held in a TileStore, only the tiles covered by the
+ * bounding box of the transformed display projection are fetched beforehand
+ * (see projectSphereToDisplay()).
+ *
+ * The display projection is calculated in tiles of 'displayTileSize' x 'displayTileSize' pixels, starting with
+ * the central tile and continuing outwards. Before every tile the projection is abandoned if cancelDisplayUpdate()
+ * was called meanwhile or if the time limit is exceeded (see setDisplayTimeLimit()). The remaining outer tiles
+ * then keep the previous display projection (see isDisplayDataComplete()). The updated tiles are recorded
+ * (see takeDirtyDisplayRects()).
  */
 void Projector::updateDisplayData()
 {
-    //Flat array of panorama sphere image data
-    const sf::Uint8* sourcePixels = panoSphereData.data();
+    const unsigned int generation = displayGeneration.load(std::memory_order_relaxed);
+    const sf::Clock clock;
+
+    displayDataComplete = false;
+
+    //Order tiles by distance of their centers from the display center (center-out)
+
+    const sf::Vector2i numTiles((displaySize.x + displayTileSize - 1) / displayTileSize, (displaySize.y + displayTileSize - 1) / displayTileSize);
+
+    std::vector<sf::Vector2i> tiles;
+    tiles.reserve(static_cast<std::size_t>(numTiles.x) * numTiles.y);
+
+    for (int ty = 0; ty < numTiles.y; ++ty)
+        for (int tx = 0; tx < numTiles.x; ++tx)
+            tiles.push_back({tx * displayTileSize, ty * displayTileSize});
+
+    auto distanceToCenter = [this](const sf::Vector2i pTile) -> int
+    {
+        const int dx = 2*pTile.x + std::min(displayTileSize, displaySize.x - pTile.x) - displaySize.x;
+        const int dy = 2*pTile.y + std::min(displayTileSize, displaySize.y - pTile.y) - displaySize.y;
+
+        return dx*dx + dy*dy;
+    };
+
+    std::stable_sort(tiles.begin(), tiles.end(), [&distanceToCenter](const sf::Vector2i pA, const sf::Vector2i pB) -> bool
+                     {
+                         return distanceToCenter(pA) < distanceToCenter(pB);
+                     });
+
+    //Reset dirty tiles after display size change (all of the display projection is new then anyway)
+    if (dirtyDisplayTiles.size() != tiles.size())
+        dirtyDisplayTiles.assign(tiles.size(), false);
 
     //Cache final projection transformation values for current perspective as they are reused for every projection pixel below
 
     std::vector<float> displayTrafosX(displaySize.x+1, 0);
-    std::vector<float> displayTrafosY((displaySize.x+1)*(displaySize.y+1), 0);
 
     for (int x = 0; x <= displaySize.x; ++x)
         displayTrafosX[x] = displayTrafoX(x);
 
-    for (int y = 0; y <= displaySize.y; ++y)
-        for (int x = 0; x <= displaySize.x; ++x)
-            displayTrafosY[(displaySize.x+1)*y + x] = displayTrafoY(y, x);
+    std::vector<float> tileTrafosX(displayTileSize+1, 0);
+    std::vector<float> tileTrafosY((displayTileSize+1)*(displayTileSize+1), 0);
 
-    //Go through every projection pixel coordinate, calculate the rectangle in the panorama sphere
-    //corresponding to the pixel's square and interpolate the pixel color as the mean color of the rectangle
-    for (int y = 0; y < displaySize.y; ++y)
+    for (const sf::Vector2i tile : tiles)
     {
-        for (int x = 0; x < displaySize.x; ++x)
+        //Newer perspective requested on another thread, so this one is outdated already
+        if (displayGeneration.load(std::memory_order_relaxed) != generation)
+            return;
+
+        //Keep outer tiles of the previous display projection if running late
+        if (displayTimeLimit != sf::Time::Zero && clock.getElapsedTime() > displayTimeLimit)
+            return;
+
+        const int tileWidth = std::min(displayTileSize, displaySize.x - tile.x);
+        const int tileHeight = std::min(displayTileSize, displaySize.y - tile.y);
+
+        tileTrafosX.assign(displayTrafosX.begin() + tile.x, displayTrafosX.begin() + tile.x + tileWidth + 1);
+
+        for (int y = 0; y <= tileHeight; ++y)
+            for (int x = 0; x <= tileWidth; ++x)
+                tileTrafosY[(tileWidth+1)*y + x] = displayTrafoY(tile.y + y, tile.x + x);
+
+        sf::Uint8 *const tilePixels = displayData.data() + 4 * (static_cast<std::size_t>(displaySize.x) * tile.y + tile.x);
+
+        auto projectDisplay = [this, tileHeight, tilePixels, &tileTrafosX, &tileTrafosY](auto& pSphere) -> void
         {
-            //Top left and bottom right corner coordinates of the projection pixel transformed to the panorama sphere
-            float tLx = displayTrafosX[x];
-            float tLy = displayTrafosY[(displaySize.x+1)*y + x];
-            float bRx = displayTrafosX[x+1];
-            float bRy = displayTrafosY[(displaySize.x+1)*(y+1) + x + 1];
+            projectSphereToDisplay(pSphere, tileHeight, tileTrafosX, tileTrafosY,
+                                   DisplayPixels<PixelFormat::RGBA>(tilePixels, 4 * static_cast<std::size_t>(displaySize.x)));
+        };
 
-            //In case of a 360 degree panorama the transformations might output values that exceed FOV of the scene;
-            //at this point only fix lower boundary to avoid negative individual values but also avoid wrong negative difference (bRx-tLx)
-            if (tLx < 0)
-                tLx += panoSphereSize.x;
-            if (bRx - tLx < 0)
-                bRx += panoSphereSize.x;
+        visitPanoSphereSource(projectDisplay);
 
-            //Interpolate current display pixel color from panorama sphere pixels covered by the transformed pixel rectangle
-            interpolatePixel(panoSphereSize, sourcePixels,
-                             {std::ref(displayData[4*(displaySize.x*y + x)]),
-                              std::ref(displayData[4*(displaySize.x*y + x) + 1]),
-                              std::ref(displayData[4*(displaySize.x*y + x) + 2])},
-                             tLx, tLy, bRx, bRy);
-        }
+        dirtyDisplayTiles[numTiles.x * (tile.y / displayTileSize) + tile.x / displayTileSize] = true;
     }
+
+    displayDataComplete = true;
+
+    trackPeakMemoryUsage((displayTrafosX.capacity() + tileTrafosX.capacity() + tileTrafosY.capacity()) * sizeof(float));
 }
 
 /*!
@@ -673,37 +2094,271 @@ void Projector::updateDisplayData()
  *
  * The pixel colors are interpolated between the two buffers of arbitrary
  * resolution via a simple area weighting (see also interpolatePixel()).
+ *
+ * If a panorama sphere pyramid is available (see loadOrCreateSphereCache() and createSpherePyramid()), it replaces
+ * the picture as source (see mapPyramidToSphereBuffer() instead of mapPicToSphereBuffer()). Without tiled storage,
+ * nothing is mapped at all then: the smallest pyramid level that still reaches the lower "oversampling" threshold
+ * is used directly as panorama sphere (see visitPanoSphereSource()) and the in-memory buffer is released.
+ * The oversampling of this level stays below the upper threshold, as the next smaller level would fall
+ * below the lower one, so that switching levels happens at the usual remapping points only.
+ *
+ * If tiled storage is enabled (see Projector()), the panorama sphere is written to a TileStore
+ * instead of the in-memory buffer, which is only re-created when the sphere size changes.
+ * Otherwise the in-memory buffer uses the configured layout (see visitPanoSphere()).
  */
 void Projector::mapPicToPanoSphere()
 {
-    //Initially set sphere width to loaded picture width (max. useful size); scale height via FOV, as sphere coordinates are simply angles
-    panoSphereSize.x = picSize.x;
-    panoSphereSize.y = static_cast<int>(picSize.x * fovCentHor.y / fovCentHor.x + 1.);
+    //Initially set sphere size to maximum useful size (see calcFullPanoSphereSize())
+    panoSphereSize = calcFullPanoSphereSize();
 
     //Define scale factor to possibly lower sphere size below
     float scaleFactor = 1;
 
+    //If finally display pixels transform to unnecessarily many sphere pixels (too high "oversampling"), reduce sphere size (or resolution)
+
+    float over = calcLowestDisplayTrafoOversampling();
+
+    if (over > panoSphereRemapHystTargOvers)
+    {
+        //Change scale factor and sphere size accordingly
+        scaleFactor = panoSphereRemapHystTargOvers / over;
+        panoSphereSize = calcScaledPanoSphereSize(scaleFactor);
+    }
+
+    //Use a pyramid level directly instead of resampling it into the panorama sphere buffer
+    if (panoSpherePyramid && tileCacheLimit == 0)
+    {
+        const sf::Vector2i minSize = (over > panoSphereRemapHystMinOvers) ?
+                                         calcScaledPanoSphereSize(panoSphereRemapHystMinOvers / over) : calcFullPanoSphereSize();
+
+        panoSphereLevel = panoSpherePyramid->selectLevel(minSize);
+        panoSphereSize = panoSpherePyramid->getLevelSize(panoSphereLevel);
+
+        std::vector<sf::Uint8>().swap(panoSphereData);
+
+        trackPeakMemoryUsage();
+
+        return;
+    }
+
+    auto mapToSphere = [this, scaleFactor](auto& pSphere) -> void
+    {
+        if (panoSpherePyramid)
+            mapPyramidToSphereBuffer(pSphere);
+        else
+            mapPicToSphereBuffer(scaleFactor, pSphere);
+    };
+
+    if (tileCacheLimit > 0)
+    {
+        if (!panoSphereTiles || panoSphereTiles->getSize() != panoSphereSize)
+        {
+            panoSphereTiles.reset();
+            panoSphereTiles = std::make_unique<TileStore>(panoSphereSize, tileCacheLimit - tileCacheLimit / 2, tileDirectory);
+        }
+    }
+    else
+    {
+        const std::size_t numChannels = (panoSphereLayout == PanoSphereLayout::RGBA) ? 4 : 3;
+        const std::size_t dataSize = numChannels * panoSphereSize.x * panoSphereSize.y;
+
+        //Old contents are overwritten anyway, so avoid copying them and over-allocating when growing the buffer
+        if (dataSize > panoSphereData.capacity())
+            std::vector<sf::Uint8>().swap(panoSphereData);
+
+        panoSphereData.resize(dataSize, 255.);
+    }
+
+    visitPanoSphere(mapToSphere);
+
+    trackPeakMemoryUsage();
+}
+
+/*!
+ * \brief Call a function with pixel access to the panorama sphere buffer in its current storage layout.
+ *
+ * Calls \p pFunction with the TileStore of the panorama sphere, if tiled storage is enabled (see Projector()),
+ * and otherwise with a pixel accessor for the in-memory panorama sphere buffer that matches the configured
+ * PanoSphereLayout (see FlatPixels and PlanarPixels). The buffer must already have the size needed for
+ * the current panorama sphere size. \p pFunction must accept all of these accessor types
+ * (e.g. a generic lambda), such that the projection code is instantiated for every layout.
+ *
+ * \param pFunction Function to call with the panorama sphere pixel accessor.
+ */
+template<typename FunctionT>
+void Projector::visitPanoSphere(FunctionT& pFunction)
+{
+    if (panoSphereTiles)
+        pFunction(*panoSphereTiles);
+    else if (panoSphereLayout == PanoSphereLayout::RGB)
+    {
+        FlatPixels<sf::Uint8, 3> sphere(panoSphereSize, panoSphereData.data());
+        pFunction(sphere);
+    }
+    else if (panoSphereLayout == PanoSphereLayout::Planar)
+    {
+        PlanarPixels<sf::Uint8> sphere(panoSphereSize, panoSphereData.data());
+        pFunction(sphere);
+    }
+    else
+    {
+        FlatPixels<sf::Uint8> sphere(panoSphereSize, panoSphereData.data());
+        pFunction(sphere);
+    }
+}
+
+/*!
+ * \brief Call a function with read access to the panorama sphere, including a directly used pyramid level.
+ *
+ * Calls \p pFunction with a read-only pixel accessor for the panorama sphere pyramid level that is used as panorama sphere
+ * (see mapPicToPanoSphere()), if any, and otherwise like visitPanoSphere(). \p pFunction must accept all of these accessor
+ * types and must not write to the panorama sphere.
+ *
+ * \param pFunction Function to call with the panorama sphere pixel accessor.
+ */
+template<typename FunctionT>
+void Projector::visitPanoSphereSource(FunctionT& pFunction)
+{
+    if (panoSphereLevel >= 0 && panoSpherePyramid)
+    {
+        const FlatPixels<const sf::Uint8> sphere(panoSphereSize, panoSpherePyramid->getLevelData(panoSphereLevel));
+        pFunction(sphere);
+    }
+    else
+        visitPanoSphere(pFunction);
+}
+
+/*!
+ * \brief Call a function with pixel access to a panorama sphere of a specific size.
+ *
+ * Calls \p pFunction with the current panorama sphere (see visitPanoSphereSource()), if it has the size \p pSphereSize.
+ * Otherwise a temporary panorama sphere of that size is mapped from the picture or the panorama sphere pyramid
+ * (see mapPicToPanoSphere()) and passed instead. The temporary sphere is held in a TileStore, if tiled storage
+ * is enabled (see Projector()), and otherwise in memory in "rgb" layout (see FlatPixels).
+ *
+ * \p pFunction must accept all pixel accessor types (see visitPanoSphereSource()) plus the memory occupied
+ * by the temporary sphere in bytes (0 if the current panorama sphere is used).
+ *
+ * \param pSphereSize Required panorama sphere size.
+ * \param pScaleFactor Scale factor of \p pSphereSize relative to calcFullPanoSphereSize() (see mapPicToSphereBuffer()).
+ * \param pFunction Function to call with the panorama sphere pixel accessor and the temporary memory usage.
+ *
+ * \throws std::runtime_error Could not create a temporary tile file (see TileStore()).
+ */
+template<typename FunctionT>
+void Projector::visitPanoSphereOfSize(const sf::Vector2i pSphereSize, const float pScaleFactor, FunctionT& pFunction)
+{
+    auto mapToSphere = [this, pScaleFactor](auto& pSphere) -> void
+    {
+        if (panoSpherePyramid)
+            mapPyramidToSphereBuffer(pSphere);
+        else
+            mapPicToSphereBuffer(pScaleFactor, pSphere);
+    };
+
+    if (pSphereSize == panoSphereSize)
+    {
+        auto callFunction = [&pFunction](auto& pSphere) -> void
+        {
+            pFunction(pSphere, 0);
+        };
+
+        visitPanoSphereSource(callFunction);
+    }
+    else if (tileCacheLimit > 0)
+    {
+        TileStore sphere(pSphereSize, tileCacheLimit - tileCacheLimit / 2, tileDirectory);
+        mapToSphere(sphere);
+
+        pFunction(sphere, sphere.getMemoryLimit());
+    }
+    else
+    {
+        std::vector<sf::Uint8> sphereData(3 * static_cast<std::size_t>(pSphereSize.x) * static_cast<std::size_t>(pSphereSize.y), 255);
+
+        FlatPixels<sf::Uint8, 3> sphere(pSphereSize, sphereData.data());
+        mapToSphere(sphere);
+
+        pFunction(sphere, sphereData.capacity());
+    }
+}
+
+//
+
+/*!
+ * \brief Calculate the panorama sphere size that matches the full picture resolution.
+ *
+ * The sphere width is set to the picture width (maximum useful size), while the height is
+ * scaled via the field of view, as the panorama sphere coordinates are simply angles.
+ *
+ * \return Panorama sphere size for a scale factor of 1 (see mapPicToSphereBuffer()).
+ */
+sf::Vector2i Projector::calcFullPanoSphereSize() const
+{
+    return {picSize.x, static_cast<int>(picSize.x * fovCentHor.y / fovCentHor.x + 1.)};
+}
+
+/*!
+ * \brief Calculate the panorama sphere size for a reduced resolution.
+ *
+ * Scales the picture width by \p pScaleFactor and derives the height via the field
+ * of view, as in calcFullPanoSphereSize() (but rounding the width up).
+ *
+ * \param pScaleFactor Scale factor of panorama sphere resolution relative to picture resolution (less than 1).
+ * \return Panorama sphere size for \p pScaleFactor (see mapPicToSphereBuffer()).
+ */
+sf::Vector2i Projector::calcScaledPanoSphereSize(const float pScaleFactor) const
+{
+    return {static_cast<int>(pScaleFactor * picSize.x + 1.), static_cast<int>(pScaleFactor * picSize.x * fovCentHor.y / fovCentHor.x + 1.)};
+}
+
+/*!
+ * \brief Project the loaded picture onto a panorama sphere buffer.
+ *
+ * Fills \p pSphere with a spherical projection of the loaded panorama picture. The used projection
+ * transformation is selected according to the scene's panorama projection type (see SceneMetaData::PanoramaProjection).
+ *
+ * The size of \p pSphere must match \p pScaleFactor times the size from calcFullPanoSphereSize().
+ * \p pSphere can be a TileStore or any other type providing the same pixel access functions (see visitPanoSphere()).
+ *
+ * The pixel colors are interpolated between the two buffers of arbitrary
+ * resolution via a simple area weighting (see also interpolatePixel()).
+ *
+ * The sphere is processed in blocks of TileStore::tileSize x TileStore::tileSize pixels. For each block the sphere
+ * tiles and the picture region covered by the transformed block are fetched (see TileStore::fetchRegion()).
+ * The cancel flag from ProjectorOptions is checked before each row of blocks.
+ *
+ * \param pScaleFactor Scale factor of panorama sphere resolution relative to picture resolution.
+ * \param pSphere Panorama sphere buffer to be filled.
+ *
+ * \throws std::runtime_error Mapping was cancelled via ProjectorOptions::cancelFlag.
+ */
+template<typename TargetT>
+void Projector::mapPicToSphereBuffer(const float pScaleFactor, TargetT& pSphere) const
+{
+    const sf::Vector2i sphereSize = pSphere.getSize();
+
     const float picHorizonY = picUncroppedSize.y / 2. - picCropPosTL.y;   //Horizon position in loaded cropped picture
     const float tanFOV2 = std::tan(picUncroppedFOV.y / 2.);
 
-    //Transformations from loaded picture to panorama sphere buffer coordinates (they depend on above scale factor and scaled sphere size)
+    //Transformations from loaded picture to panorama sphere buffer coordinates (they depend on scale factor and scaled sphere size)
 
     //Equirectangular projection (horizontal component); equivalent to central cylindrical projection
-    auto equirectToSphereTrafoX = [&scaleFactor](float pX) -> float
+    auto equirectToSphereTrafoX = [pScaleFactor](float pX) -> float
     {
-        return pX / scaleFactor;
+        return pX / pScaleFactor;
     };
 
     //Equirectangular projection (vertical component)
-    auto equirectToSphereTrafoY = [this, &scaleFactor, picHorizonY](float pY) -> float
+    auto equirectToSphereTrafoY = [pScaleFactor, sphereSize, picHorizonY](float pY) -> float
     {
-        return (pY - panoSphereSize.y / 2.) / scaleFactor + picHorizonY;
+        return (pY - sphereSize.y / 2.) / pScaleFactor + picHorizonY;
     };
 
     //Central cylindrical projection (vertical component)
-    auto cylindToSphereTrafoY = [this, &scaleFactor, picHorizonY, tanFOV2](float pY) -> float
+    auto cylindToSphereTrafoY = [this, sphereSize, picHorizonY, tanFOV2](float pY) -> float
     {
-        return std::tan((pY - panoSphereSize.y / 2.) * fovCentHor.y / panoSphereSize.y) / tanFOV2 * picUncroppedSize.y / 2. + picHorizonY;
+        return std::tan((pY - sphereSize.y / 2.) * fovCentHor.y / sphereSize.y) / tanFOV2 * picUncroppedSize.y / 2. + picHorizonY;
     };
 
     //Same x-transformation for central cylindrical and equirectangular projections
@@ -719,85 +2374,248 @@ void Projector::mapPicToPanoSphere()
             return equirectToSphereTrafoY(pY);
     };
 
-    //If finally display pixels transform to unnecessarily many sphere pixels (too high "oversampling"), reduce sphere size (or resolution)
+    //Cache transformation values as they are reused for every sphere pixel below
 
-    float over = calcLowestDisplayTrafoOversampling();
+    std::vector<float> sphereTrafosX(sphereSize.x+1, 0);
+    std::vector<float> sphereTrafosY(sphereSize.y+1, 0);
 
-    if (over > panoSphereRemapHystTargOvers)
-    {
-        //Change scale factor and sphere size accordingly (note: transformations above capture these by reference or this pointer)
+    for (int x = 0; x <= sphereSize.x; ++x)
+        sphereTrafosX[x] = sphereTrafoX(x);
+    for (int y = 0; y <= sphereSize.y; ++y)
+        sphereTrafosY[y] = sphereTrafoY(y);
 
-        scaleFactor = panoSphereRemapHystTargOvers / over;
+    auto mapBlocks = [this, &pSphere, sphereSize, &sphereTrafosX, &sphereTrafosY](auto& pSource) -> void
+    {
+        for (int blockY = 0; blockY < sphereSize.y; blockY += TileStore::tileSize)
+        {
+            throwIfCancelled();
+
+            const int blockEndY = std::min(blockY + TileStore::tileSize, sphereSize.y);
+
+            //Skip blocks that lie completely outside of the picture (see below)
+            if (sphereTrafosY[blockEndY] <= 0 || sphereTrafosY[blockY] >= picSize.y)
+                continue;
+
+            for (int blockX = 0; blockX < sphereSize.x; blockX += TileStore::tileSize)
+            {
+                const int blockEndX = std::min(blockX + TileStore::tileSize, sphereSize.x);
+
+                pSphere.fetchRegion(blockX, blockY, blockEndX - 1, blockEndY - 1, true);
+                pSource.fetchRegion(static_cast<int>(sphereTrafosX[blockX]), static_cast<int>(std::floor(sphereTrafosY[blockY])),
+                                    std::min(static_cast<int>(sphereTrafosX[blockEndX]), picSize.x - 1),
+                                    static_cast<int>(sphereTrafosY[blockEndY]));
+
+                //Go through every sphere pixel coordinate, calculate the rectangle in the picture corresponding
+                //to the pixel's square and interpolate the pixel color as the mean color of the rectangle
+                for (int y = blockY; y < blockEndY; ++y)
+                {
+                    //Top and bottom corner coordinates of the sphere pixel transformed to the loaded picture
+                    const float tLy = sphereTrafosY[y];
+                    const float bRy = sphereTrafosY[y+1];
+
+                    //Pixels might point to out of bounds part of the picture, because picture not always symmetric but sphere is (just ignore them)
+                    if (bRy <= 0 || tLy >= picSize.y)
+                        continue;
+
+                    for (int x = blockX; x < blockEndX; ++x)
+                    {
+                        //Left and right corner coordinates of the sphere pixel transformed to the loaded picture
+                        const float tLx = sphereTrafosX[x];
+                        const float bRx = sphereTrafosX[x+1];
+
+                        const auto targetPixel = pSphere.getPixel(x, y);
+
+                        //Interpolate current panorama sphere pixel color from panorama picture pixels covered by the transformed pixel rectangle
+                        interpolatePixel(pSource, {std::ref(targetPixel[0]), std::ref(targetPixel[1]), std::ref(targetPixel[2])},
+                                         tLx, tLy, bRx, bRy);
+                    }
+                }
+            }
+        }
+    };
 
-        panoSphereSize.x = static_cast<int>(scaleFactor * picSize.x + 1.);
-        panoSphereSize.y = static_cast<int>(scaleFactor * picSize.x * fovCentHor.y / fovCentHor.x + 1.);
+    if (picTiles)
+        mapBlocks(*picTiles);
+    else
+    {
+        FlatPixels<const sf::Uint8> source(picSize, pic->getPixelsPtr());
+        mapBlocks(source);
     }
+}
+
+/*!
+ * \brief Resample the panorama sphere pyramid onto a panorama sphere buffer.
+ *
+ * Fills \p pSphere from the smallest level of the panorama sphere pyramid that is at least as large as \p pSphere
+ * (see SpherePyramid::selectLevel()). As all levels and the target buffer span the same field of view, the
+ * transformation is a simple scaling. \p pSphere can be a TileStore or any other type providing the
+ * same pixel access functions (processed block-wise like in mapPicToSphereBuffer(), including the cancel flag check).
+ *
+ * The pixel colors are interpolated between the two buffers of arbitrary
+ * resolution via a simple area weighting (see also interpolatePixel()).
+ *
+ * \param pSphere Panorama sphere buffer to be filled.
+ *
+ * \throws std::runtime_error Mapping was cancelled via ProjectorOptions::cancelFlag.
+ */
+template<typename TargetT>
+void Projector::mapPyramidToSphereBuffer(TargetT& pSphere) const
+{
+    const sf::Vector2i sphereSize = pSphere.getSize();
 
-    panoSphereData.resize(4 * panoSphereSize.x * panoSphereSize.y, 255.);
+    const int level = panoSpherePyramid->selectLevel(sphereSize);
 
-    //Flat array of loaded panorama picture data
-    const sf::Uint8* sourcePixels = pic.getPixelsPtr();
+    const FlatPixels<const sf::Uint8> source(panoSpherePyramid->getLevelSize(level), panoSpherePyramid->getLevelData(level));
 
-    //Cache transformation values as they are reused for every sphere pixel below
+    //Scale factors from panorama sphere buffer to pyramid level coordinates
+    const float scaleX = static_cast<float>(source.getSize().x) / sphereSize.x;
+    const float scaleY = static_cast<float>(source.getSize().y) / sphereSize.y;
 
-    std::vector<float> sphereTrafosX(panoSphereSize.x+1, 0);
-    std::vector<float> sphereTrafosY(panoSphereSize.y+1, 0);
+    for (int blockY = 0; blockY < sphereSize.y; blockY += TileStore::tileSize)
+    {
+        throwIfCancelled();
 
-    for (int x = 0; x <= panoSphereSize.x; ++x)
-        sphereTrafosX[x] = sphereTrafoX(x);
-    for (int y = 0; y <= panoSphereSize.y; ++y)
-        sphereTrafosY[y] = sphereTrafoY(y);
+        const int blockEndY = std::min(blockY + TileStore::tileSize, sphereSize.y);
+
+        for (int blockX = 0; blockX < sphereSize.x; blockX += TileStore::tileSize)
+        {
+            const int blockEndX = std::min(blockX + TileStore::tileSize, sphereSize.x);
+
+            pSphere.fetchRegion(blockX, blockY, blockEndX - 1, blockEndY - 1, true);
+
+            //Go through every sphere pixel coordinate, calculate the rectangle in the pyramid level corresponding
+            //to the pixel's square and interpolate the pixel color as the mean color of the rectangle
+            for (int y = blockY; y < blockEndY; ++y)
+            {
+                for (int x = blockX; x < blockEndX; ++x)
+                {
+                    const auto targetPixel = pSphere.getPixel(x, y);
+
+                    interpolatePixel(source, {std::ref(targetPixel[0]), std::ref(targetPixel[1]), std::ref(targetPixel[2])},
+                                     x * scaleX, y * scaleY, (x+1) * scaleX, (y+1) * scaleY);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Project rows of a panorama sphere buffer to a display projection buffer.
+ *
+ * Fills \p pNumRows rows of the buffer \p pDisplayPixels (with a width of pTrafosX.size()-1,
+ * e.g. in the "rgba" format of getDisplayData(), see DisplayPixels) from \p pSphere using the final display projection
+ * transformations \p pTrafosX and \p pTrafosY (see displayTrafoX() and displayTrafoY()) of these rows:
+ * - 'pTrafosX[x]' for all x from 0 to the width
+ * - 'pTrafosY[(width+1) * y + x]' for all x from 0 to the width and y from 0 to \p pNumRows
+ *
+ * The rows may be a horizontal strip of a larger display projection (see renderPoster()).
+ * Before each row, only the region of \p pSphere covered by the transformed row is fetched (see TileStore::fetchRegion()),
+ * such that the fetched region stays small compared to the memory limit of a TileStore.
+ *
+ * Pixel colors are interpolated via a simple area weighting (see interpolatePixel()).
+ *
+ * \param pSphere Panorama sphere buffer (TileStore or any other type providing the same pixel access functions).
+ * \param pNumRows Number of display projection rows.
+ * \param pTrafosX Horizontal transformations to panorama sphere buffer positions.
+ * \param pTrafosY Vertical transformations to panorama sphere buffer positions.
+ * \param pDisplayPixels Target display projection buffer for \p pNumRows rows (DisplayPixels or any other type
+ *                       providing the same setPixel() function).
+ */
+template<typename SourceT, typename TargetT>
+void Projector::projectSphereToDisplay(SourceT& pSphere, const int pNumRows, const std::vector<float>& pTrafosX,
+                                       const std::vector<float>& pTrafosY, const TargetT& pDisplayPixels)
+{
+    const int width = static_cast<int>(pTrafosX.size()) - 1;
+    const int sphereWidth = pSphere.getSize().x;
 
-    //Go through every sphere pixel coordinate, calculate the rectangle in the picture corresponding
-    //to the pixel's square and interpolate the pixel color as the mean color of the rectangle
-    for (int y = 0; y < panoSphereSize.y; ++y)
+    //Go through every projection pixel coordinate, calculate the rectangle in the panorama sphere
+    //corresponding to the pixel's square and interpolate the pixel color as the mean color of the rectangle
+    for (int y = 0; y < pNumRows; ++y)
     {
-        for (int x = 0; x < panoSphereSize.x; ++x)
+        //Fetch panorama sphere region covered by the row (horizontal transformation is monotonic)
+        const auto rowTrafosY = pTrafosY.begin() + (width+1)*y;
+        const auto [minTrafoY, maxTrafoY] = std::minmax_element(rowTrafosY, rowTrafosY + 2*(width+1));
+
+        pSphere.fetchRegion(static_cast<int>(std::floor(pTrafosX.front())), static_cast<int>(std::floor(*minTrafoY)),
+                            static_cast<int>(pTrafosX.back()), static_cast<int>(*maxTrafoY));
+
+        for (int x = 0; x < width; ++x)
         {
-            //Top left and bottom right corner coordinates of the sphere pixel transformed to the loaded picture
-            float tLx = sphereTrafosX[x];
-            float tLy = sphereTrafosY[y];
-            float bRx = sphereTrafosX[x+1];
-            float bRy = sphereTrafosY[y+1];
-
-            //Pixels might point to out of bounds part of the picture, because picture not always symmetric but sphere is (just ignore them)
-            if (bRy <= 0 || tLy >= picSize.y)
-                break;
-
-            //Interpolate current panorama sphere pixel color from panorama picture pixels covered by the transformed pixel rectangle
-            interpolatePixel(picSize, sourcePixels,
-                             {std::ref(panoSphereData[4*(panoSphereSize.x*y + x)]),
-                              std::ref(panoSphereData[4*(panoSphereSize.x*y + x) + 1]),
-                              std::ref(panoSphereData[4*(panoSphereSize.x*y + x) + 2])},
-                             tLx, tLy, bRx, bRy);
+            //Top left and bottom right corner coordinates of the projection pixel transformed to the panorama sphere
+            float tLx = pTrafosX[x];
+            float tLy = pTrafosY[(width+1)*y + x];
+            float bRx = pTrafosX[x+1];
+            float bRy = pTrafosY[(width+1)*(y+1) + x + 1];
+
+            //In case of a 360 degree panorama the transformations might output values that exceed FOV of the scene;
+            //at this point only fix lower boundary to avoid negative individual values but also avoid wrong negative difference (bRx-tLx)
+            if (tLx < 0)
+                tLx += sphereWidth;
+            if (bRx - tLx < 0)
+                bRx += sphereWidth;
+
+            //Interpolate current display pixel color from panorama sphere pixels covered by the transformed pixel rectangle
+            std::array<sf::Uint8, 3> color;
+            interpolatePixel(pSphere, {std::ref(color[0]), std::ref(color[1]), std::ref(color[2])}, tLx, tLy, bRx, bRy);
+
+            pDisplayPixels.setPixel(x, y, color);
         }
     }
 }
 
+/*!
+ * \brief Project rows of an "rgba" panorama sphere to a buffer with arbitrary stride and pixel format.
+ *
+ * Same as projectSphereToDisplay() for an in-memory panorama sphere of size \p pSourceSize in the format
+ * of getDisplayData() (e.g. a SpherePyramid level, see PanoramaScene::render()) and a target buffer
+ * \p pPixels with row stride \p pStride and pixel format \p pFormat (see DisplayPixels).
+ *
+ * \param pSourceSize Panorama sphere size.
+ * \param pSourcePixels Panorama sphere data.
+ * \param pNumRows Number of display projection rows.
+ * \param pTrafosX Horizontal transformations to panorama sphere positions.
+ * \param pTrafosY Vertical transformations to panorama sphere positions.
+ * \param pPixels Target buffer for \p pNumRows rows.
+ * \param pStride Distance between the starts of two consecutive rows of \p pPixels in bytes.
+ * \param pFormat Pixel format of \p pPixels.
+ */
+void Projector::projectRGBAToBuffer(const sf::Vector2i pSourceSize, const sf::Uint8 *const pSourcePixels, const int pNumRows,
+                                    const std::vector<float>& pTrafosX, const std::vector<float>& pTrafosY,
+                                    sf::Uint8 *const pPixels, const std::size_t pStride, const PixelFormat pFormat)
+{
+    FlatPixels<const sf::Uint8> source(pSourceSize, pSourcePixels);
+
+    auto project = [&source, pNumRows, &pTrafosX, &pTrafosY](const auto& pTarget) -> void
+    {
+        projectSphereToDisplay(source, pNumRows, pTrafosX, pTrafosY, pTarget);
+    };
+
+    visitDisplayPixels(pPixels, pStride, pFormat, project);
+}
+
 //
 
 /*!
  * \brief Interpolate target pixel color from rectangle in source image by area weighting.
  *
- * The color values of pixels from \p pSourcePixels within the rectangle {{\p pTLx, \p pTLy}, {\p pBRx, \p pBRy}}
+ * The color values of pixels from \p pSource within the rectangle {{\p pTLx, \p pTLy}, {\p pBRx, \p pBRy}}
  * are averaged and the resulting color is applied to \p pTargetPixel. The color averaging is area-weighted.
  * It uses the intersection of the source pixel and rectangle areas as weights.
  *
- * The format of the source image data \p pSourcePixels must be equivalent to the format used for the data
- * returned by getDisplayData() (see there) with the source image size being \p pSourceImageSize here.
+ * The source image \p pSource can be a TileStore or any other type providing the same pixel access
+ * functions getSize() and getPixel() (the latter returning anything that gives the "rgb" values via operator[]).
  *
  * \p pTargetPixel are references to the individual {r, g, b} color values of the target pixel.
  *
- * \param pSourceImageSize Size of the source image.
- * \param pSourcePixels Source image data as flat array.
+ * \param pSource Source image.
  * \param pTargetPixel Target image pixel color as {r, g, b}.
  * \param pTLx Horizontal coordinate of source image rectangle's top left corner.
  * \param pTLy Vertical coordinate of source image rectangle's top left corner.
  * \param pBRx Horizontal coordinate of source image rectangle's bottom right corner.
  * \param pBRy Vertical coordinate of source image rectangle's bottom right corner.
  */
-void Projector::interpolatePixel(const sf::Vector2i pSourceImageSize, const sf::Uint8 *const pSourcePixels,
-                                 const std::array<std::reference_wrapper<sf::Uint8>, 3> pTargetPixel,
+template<typename SourceT>
+void Projector::interpolatePixel(const SourceT& pSource, const std::array<std::reference_wrapper<sf::Uint8>, 3> pTargetPixel,
                                  const float pTLx, const float pTLy, const float pBRx, const float pBRy)
 {
     //Coordinates of topmost and leftmost source pixels that are at least partially covered by the transformed rectangle
@@ -812,6 +2630,8 @@ void Projector::interpolatePixel(const sf::Vector2i pSourceImageSize, const sf::
     int nx = bRxi - tLxi + 1;
     int ny = bRyi - tLyi + 1;
 
+    const sf::Vector2i sourceImageSize = pSource.getSize();
+
     //Area-weighted sum of RGB color values
     float r = 0;
     float g = 0;
@@ -825,7 +2645,7 @@ void Projector::interpolatePixel(const sf::Vector2i pSourceImageSize, const sf::
     for (int iy = 0; iy < ny; ++iy)
     {
         //Vertical bounds check (pixels might be out of bounds due to rounding effects, just ignore them)
-        if (tLyi+iy < 0 || tLyi+iy >= pSourceImageSize.y)
+        if (tLyi+iy < 0 || tLyi+iy >= sourceImageSize.y)
             continue;
 
         //Calculate height of intersection of pixel and rectangle
@@ -840,9 +2660,9 @@ void Projector::interpolatePixel(const sf::Vector2i pSourceImageSize, const sf::
             //Horizontal bounds check (pixels out of bounds only relevant for 360 degree panoramas, so just add full width offset)
             int wrap = 0;
             if (tLxi+ix < 0)
-                wrap = pSourceImageSize.x;
-            else if (tLxi+ix >= pSourceImageSize.x)
-                wrap = -pSourceImageSize.x;
+                wrap = sourceImageSize.x;
+            else if (tLxi+ix >= sourceImageSize.x)
+                wrap = -sourceImageSize.x;
 
             //Calculate width of intersection of pixel and rectangle
             float xWeight = 1;
@@ -856,9 +2676,11 @@ void Projector::interpolatePixel(const sf::Vector2i pSourceImageSize, const sf::
 
             totalWeight += weight;
 
-            r += weight * pSourcePixels[4*(pSourceImageSize.x*(tLyi+iy) + tLxi+ix + wrap)];
-            g += weight * pSourcePixels[4*(pSourceImageSize.x*(tLyi+iy) + tLxi+ix + wrap) + 1];
-            b += weight * pSourcePixels[4*(pSourceImageSize.x*(tLyi+iy) + tLxi+ix + wrap) + 2];
+            const auto sourcePixel = pSource.getPixel(tLxi+ix + wrap, tLyi+iy);
+
+            r += weight * sourcePixel[0];
+            g += weight * sourcePixel[1];
+            b += weight * sourcePixel[2];
         }
     }
 
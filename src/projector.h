@@ -24,16 +24,87 @@
 #define SPNV_PROJECTOR_H
 
 #include "scenemetadata.h"
+#include "spherepyramid.h"
+#include "tilestore.h"
 
 #include <SFML/Config.hpp>
 #include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Time.hpp>
 #include <SFML/System/Vector2.hpp>
 
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
+class PanoramaScene;
+
+/*!
+ * \brief Storage layout of the in-memory panorama sphere buffer of a Projector.
+ *
+ * See ProjectorOptions::sphereLayout.
+ */
+enum class PanoSphereLayout : std::uint8_t
+{
+    RGBA,       ///< Interleaved "rgba" values (same format as Projector::getDisplayData(), alpha unused).
+    RGB,        ///< Interleaved "rgb" values (no alpha channel, 25% less memory).
+    Planar      ///< Separate continuous planes of "r", "g" and "b" values (no alpha channel, 25% less memory).
+};
+
+/*!
+ * \brief Pixel format of caller-provided render target buffers.
+ *
+ * See OutputBuffer.
+ */
+enum class PixelFormat : std::uint8_t
+{
+    RGBA,       ///< Four bytes per pixel in "rgba" order (same format as Projector::getDisplayData(), alpha set to 255).
+    BGRA,       ///< Four bytes per pixel in "bgra" order (alpha set to 255).
+    RGB,        ///< Three bytes per pixel in "rgb" order.
+    Gray        ///< One byte per pixel with the luma of the "rgb" values (ITU-R BT.601 weights).
+};
+
+/*!
+ * \brief Caller-provided target buffer of a rendered view.
+ *
+ * The buffer must hold 'size.y' rows of 'stride' bytes each (the last row only needs the used bytes). Rows may be
+ * padded (e.g. for mapped GPU staging buffers), but the padding bytes and the rows themselves must not overlap.
+ *
+ * See Projector::renderInto() and PanoramaScene::render().
+ */
+struct OutputBuffer
+{
+    sf::Uint8* pixels = nullptr;                ///< Start of the first row.
+    sf::Vector2u size;                          ///< Size of the rendered view.
+    std::size_t stride = 0;                     ///< Distance between the starts of two rows in bytes (0 for continuous rows).
+    PixelFormat format = PixelFormat::RGBA;     ///< Pixel format.
+};
+
+/*!
+ * \brief Optional settings for picture loading and panorama sphere storage of a Projector.
+ *
+ * See Projector().
+ */
+struct ProjectorOptions
+{
+    bool useSphereCache = false;    ///< Load the panorama sphere from a matching "PNVC file" or create it (see SpherePyramid).
+    std::size_t tileCacheLimit = 0; ///< \brief Keep picture and panorama sphere in tiled temporary files with this total memory
+                                    ///  limit in bytes instead of in memory (0 for disabled; see TileStore).
+    std::string tileDirectory;      ///< Directory for the tiled temporary files on a disk (empty for the directory of the picture).
+    bool releasePicture = false;    ///< \brief Build the panorama sphere pyramid in memory, release the picture afterwards and project
+                                    ///  directly from the pyramid levels (see SpherePyramid).
+    bool reportMemoryUsage = false; ///< Print a memory usage report of the Projector before deleting it (see Projector::getMemoryUsageReport()).
+    PanoSphereLayout sphereLayout = PanoSphereLayout::RGBA;     ///< Storage layout of the in-memory panorama sphere buffer.
+    std::shared_ptr<const std::atomic<bool>> cancelFlag;        ///< \brief Abandon picture loading and panorama sphere mapping
+                                                                ///  when set from another thread (may be nullptr).
+};
+
 /*!
  * \brief Panorama picture loading and projection onto virtual camera for varying perspectives.
  *
@@ -43,6 +114,14 @@
  * can be used, for instance, to display the current perspective on a screen or save it as a snapshot.
  * This rectilinear projection is a 2-dim. image and its size must be set via updateDisplaySize().
  *
+ * Optionally (see ProjectorOptions), the full resolution panorama sphere can be stored as a SpherePyramid in a cache
+ * file next to the picture, which makes subsequent loading of the same panorama scene independent of the picture size.
+ * Also optionally, picture and panorama sphere can be kept out of memory in tiled temporary files (see TileStore),
+ * of which only the tiles touched by the current perspective are fetched into a memory-limited cache.
+ * Or the picture can be released after building an in-memory SpherePyramid from it, whose levels are then projected
+ * directly without a separate panorama sphere buffer. The resulting memory usage of the different buffers can be
+ * queried via getMemoryUsage() and getPeakMemoryUsage().
+ *
  * The current perspective (view angle and zoom) can be set using updateView() (which will also
  * update the projection data) and can be queried via getOffsetPhi(), getOffsetTheta() and getZoom().
  * The function centerHorizon() automatically changes perspective such that the horizon line will be centered.
@@ -62,12 +141,48 @@
  */
 class Projector
 {
+    friend class PanoramaScene;     //Uses the display projection transformations for its stateless rendering
+
+public:
+    /*!
+     * \brief Memory occupied by the different buffers of a Projector.
+     *
+     * All values are in bytes. See getMemoryUsage() and getPeakMemoryUsage().
+     */
+    struct MemoryUsage
+    {
+        std::size_t picture = 0;        ///< Loaded picture (or its fetched tiles).
+        std::size_t panoSphere = 0;     ///< Panorama sphere buffer (or its fetched tiles).
+        std::size_t spherePyramid = 0;  ///< In-memory panorama sphere pyramid (without memory-mapped cache file).
+        std::size_t trafoCaches = 0;    ///< Display projection transformation caches.
+        std::size_t displayData = 0;    ///< Display projection buffer.
+        std::size_t total = 0;          ///< Sum of all of the above.
+    };
+
+    /*!
+     * \brief Panorama sphere angles of all pixel corners of an arbitrary projection.
+     *
+     * The angles are relative to the center of the panorama scene: 'phi' (x) is the horizontal angle (positive to
+     * the right) and 'theta' (y) the vertical angle (positive downwards, 0 at the horizon), both in radians.
+     * See renderAngleMap() and createRectilinearAngleMap().
+     */
+    struct AngleMap
+    {
+        sf::Vector2i size;                  ///< Size of the projection in pixels.
+        std::vector<sf::Vector2f> corners;  ///< Angles of all (size.x+1)*(size.y+1) pixel corners, row by row.
+        float minPixelAngle = 0;            ///< Smallest angle covered by a pixel (determines the needed panorama sphere resolution).
+    };
+
 public:
-    Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData);   ///< Constructor.
+    Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData,
+              const ProjectorOptions& pOptions = ProjectorOptions());                ///< Constructor.
+    ~Projector();                                                                   ///< Destructor.
 
 public:
     void updateDisplaySize(sf::Vector2u pDisplaySize,
                            bool pForceAdjustResolution = false);        ///< Adjust buffers and transformations for a changed display size.
+    void precomputeDisplayTrafos(sf::Vector2u pDisplaySize);            ///< \brief Prepare the display projection transformations
+                                                                        ///  for an upcoming display size on a background thread.
     void updateView(float pZoom, float pOffsetPhi, float pOffsetTheta,
                     bool pForceAdjustResolution = false);               ///< Change the current perspective of the display projection.
     void centerHorizon(bool pForceAdjustResolution = false);            ///< Vertically center the horizon line.
@@ -83,14 +198,56 @@ public:
     sf::Vector2f getViewAngle(sf::Vector2i pDisplayPosition) const; ///< Get angle pointed to by specific pixel in the display projection.
     //
     const std::vector<sf::Uint8>& getDisplayData() const;   ///< Get the display projection of the panorama sphere for current perspective.
+    std::vector<sf::IntRect> takeDirtyDisplayRects();       ///< Get the regions of the display projection updated since the last call.
+    bool isDisplayDataComplete() const;                     ///< Check if the last display projection update was finished.
+    void cancelDisplayUpdate();                             ///< Abandon a display projection update that is running on another thread.
+    void setDisplayTimeLimit(sf::Time pTimeLimit);          ///< Set a deadline for display projection updates (partial frames).
+    //
+    std::unique_ptr<Projector> createPreview(int pMaxWidth) const;  ///< Create a coarse copy of the panorama scene for quickly showing a first preview.
+    std::unique_ptr<Projector> createSharedCopy() const;            ///< \brief Create an independent Projector for the same panorama scene
+                                                                    ///  that shares the panorama sphere pyramid.
+    std::shared_ptr<const SpherePyramid> getSpherePyramid() const;  ///< Get the full resolution panorama sphere pyramid.
+    std::shared_ptr<const PanoramaScene> createScene() const;       ///< \brief Create an immutable panorama scene for concurrent rendering
+                                                                    ///  that shares the panorama sphere pyramid.
+    //
+    bool renderPoster(sf::Vector2u pPosterSize,
+                      const std::function<bool(const sf::Uint8*, unsigned int)>& pWriteRows);  ///< \brief Render the current perspective
+                                                                                                ///  at an arbitrary size in horizontal strips.
+    bool savePoster(const std::string& pFileName, sf::Vector2u pPosterSize);   ///< \brief Render the current perspective at an arbitrary size
+                                                                                ///  and save it as PNG file.
+    bool renderInto(const OutputBuffer& pOutput);                               ///< Render the current perspective into a caller-provided buffer.
+    //
+    bool coversFullCircle() const;                                  ///< Check if the panorama scene covers the full 360 degrees horizontally.
+    bool renderAngleMap(const AngleMap& pAngleMap, float pOffsetPhi, bool pMirrorVertically,
+                        sf::Uint8* pPixels);                        ///< Render an arbitrary projection defined by the angles of its pixel corners.
+    static AngleMap createRectilinearAngleMap(sf::Vector2i pSize, float pHFOV);     ///< \brief Calculate the angle map of a rectilinear
+                                                                                    ///  projection centered at the horizon.
+    //
+    MemoryUsage getMemoryUsage() const;                 ///< Get the memory currently occupied by the different buffers.
+    MemoryUsage getPeakMemoryUsage() const;             ///< Get the maximum memory occupied by the different buffers so far.
+    std::string getMemoryUsageReport() const;           ///< Format current and peak memory usage as a human-readable table.
 
 private:
+    Projector(const std::string& pFileName, const SceneMetaData& pSceneMetaData,
+              std::unique_ptr<sf::Image> pPicture);         ///< Construct from an already loaded picture.
+    //
+    void loadPicture();                                     ///< Load the panorama picture and check its size.
+    void loadOrCreateSphereCache();                         ///< \brief Memory-map panorama sphere pyramid from cache file
+                                                            ///  or create it from the picture and write the cache file.
+    void createSpherePyramid();                             ///< Build panorama sphere pyramid from the picture and release the picture.
+    //
+    void trackPeakMemoryUsage(std::size_t pTransientTrafoCacheSize = 0, std::size_t pTransientSphereSize = 0,
+                              std::size_t pTransientDisplaySize = 0);     ///< Update the peak memory usage with the current memory usage.
+    void throwIfCancelled() const;                          ///< Throw if loading was cancelled via the cancel flag.
+    //
     sf::Vector2f calcTopLeftFOV() const;                    ///< Calculate 'phi' and 'theta' angle of cropped picture's top left corner.
     sf::Vector2f calcBottomRightFOV() const;                ///< Calculate 'phi' and 'theta' angle of cropped picture's bottom right corner.
     //
-    float staticDisplayTrafoX(int pX) const;                ///< \brief Calculate panorama sphere 'phi' angle pointed to by a pixel
+    static float staticDisplayTrafoX(int pX, sf::Vector2i pDisplaySize,
+                                     float pF);             ///< \brief Calculate panorama sphere 'phi' angle pointed to by a pixel
                                                             ///  in the display projection (without added variable view angle offset).
-    float staticDisplayTrafoY(int pY, int pX) const;        ///< \brief Calculate panorama sphere 'theta' angle pointed to by a pixel
+    static float staticDisplayTrafoY(int pY, int pX, sf::Vector2i pDisplaySize,
+                                     float pF);             ///< \brief Calculate panorama sphere 'theta' angle pointed to by a pixel
                                                             ///  in the display projection (without added variable view angle offset).
     float displayTrafoX(int pX) const;                      ///< \brief Calculate horizontal position in the panorama sphere buffer that
                                                             ///  corresponds to a pixel in the display projection (with view angle offset).
@@ -99,24 +256,73 @@ private:
     //
     void updateStaticDisplayTrafoCache();                   ///< \brief Re-calculate cache of display projection to panorama sphere angle
                                                             ///  transformations used by displayTrafoX() and displayTrafoY().
+    void releasePrecomputedDisplayTrafos();                 ///< Discard the display projection transformations prepared in advance.
     //
     float calcLowestDisplayTrafoOversampling() const;       ///< \brief Calculate smallest ratio of delta(panorama sphere pixels) vs.
                                                             ///  delta(display projection pixels) of all positions for both directions.
     //
     void fitViewOffset();                                   ///< Clip view angle offset as necessary to stay within available field of view.
+    static void clipZoom(float& pZoom, float& pOffsetTheta, float pMinZoomCentHor,
+                         float pMinZoomNonCentHor);         ///< Apply the special zoom values and the lower zoom limit.
+    static void clipViewOffset(float& pOffsetPhi, float& pOffsetTheta, sf::Vector2f pViewFOV, sf::Vector2f pFOVCentHor,
+                               sf::Vector2f pFOVTL, sf::Vector2f pFOVBR);   ///< \brief Clip a view angle offset to stay within
+                                                                            ///  an available field of view.
     //
     void updateDisplayFOV(bool pForceRemapSphere = false);  ///< Adjust parameters and transformations after display size or zoom change.
     //
     void updateDisplayData();                               ///< Project current panorama sphere perspective to display projection buffer.
     void mapPicToPanoSphere();                              ///< Project the loaded picture onto the panorama sphere.
+    template<typename FunctionT>
+    void visitPanoSphere(FunctionT& pFunction);             ///< \brief Call a function with pixel access to the panorama sphere
+                                                            ///  buffer in its current storage layout.
+    template<typename FunctionT>
+    void visitPanoSphereSource(FunctionT& pFunction);       ///< \brief Call a function with read access to the panorama sphere,
+                                                            ///  including a directly used pyramid level.
+    template<typename FunctionT>
+    void visitPanoSphereOfSize(sf::Vector2i pSphereSize, float pScaleFactor,
+                               FunctionT& pFunction);       ///< Call a function with pixel access to a panorama sphere of a specific size.
+    //
+    sf::Vector2i calcFullPanoSphereSize() const;            ///< Calculate the panorama sphere size that matches the full picture resolution.
+    sf::Vector2i calcScaledPanoSphereSize(float pScaleFactor) const;    ///< Calculate the panorama sphere size for a reduced resolution.
+    template<typename TargetT>
+    void mapPicToSphereBuffer(float pScaleFactor, TargetT& pSphere) const;  ///< Project the loaded picture onto a panorama sphere buffer.
+    template<typename TargetT>
+    void mapPyramidToSphereBuffer(TargetT& pSphere) const;  ///< Resample the panorama sphere pyramid onto a panorama sphere buffer.
     //
-    void interpolatePixel(sf::Vector2i pSourceImageSize, const sf::Uint8 *const pSourcePixels,
-                          std::array<std::reference_wrapper<sf::Uint8>, 3> pTargetPixel,
-                          float pTLx, float pTLy, float pBRx, float pBRy);      ///< \brief Interpolate target pixel color from
-                                                                                ///  rectangle in source image by area weighting.
+    template<typename SourceT, typename TargetT>
+    static void projectSphereToDisplay(SourceT& pSphere, int pNumRows, const std::vector<float>& pTrafosX,
+                                       const std::vector<float>& pTrafosY,
+                                       const TargetT& pDisplayPixels);  ///< \brief Project rows of a panorama sphere buffer
+                                                                        ///  to a display projection buffer.
+    static void projectRGBAToBuffer(sf::Vector2i pSourceSize, const sf::Uint8* pSourcePixels, int pNumRows,
+                                    const std::vector<float>& pTrafosX, const std::vector<float>& pTrafosY,
+                                    sf::Uint8* pPixels, std::size_t pStride,
+                                    PixelFormat pFormat);               ///< \brief Project rows of an "rgba" panorama sphere
+                                                                        ///  to a buffer with arbitrary stride and pixel format.
+    template<typename SourceT>
+    static void interpolatePixel(const SourceT& pSource,
+                                 std::array<std::reference_wrapper<sf::Uint8>, 3> pTargetPixel,
+                                 float pTLx, float pTLy, float pBRx, float pBRy);   ///< \brief Interpolate target pixel color from
+                                                                                    ///  rectangle in source image by area weighting.
+
+private:
+    /*!
+     * \brief View angle-independent display projection transformations for a specific display size and focal length.
+     *
+     * See updateStaticDisplayTrafoCache() and precomputeDisplayTrafos().
+     */
+    struct DisplayTrafoCache
+    {
+        std::vector<float> trafosX;     ///< Horizontal transformations (see staticDisplayTrafoX()).
+        std::vector<float> trafosY;     ///< Vertical transformations (see staticDisplayTrafoY()).
+    };
+
+private:
+    static constexpr int displayTileSize = 64;              ///< Width and height of the display projection tiles (see updateDisplayData()).
 
 private:
-    sf::Image pic;                                          //Loaded panorama picture
+    std::unique_ptr<sf::Image> pic;                         //Loaded panorama picture (nullptr if not loaded or released)
+    std::unique_ptr<TileStore> picTiles;                    //Out-of-core copy of the picture replacing 'pic' (if enabled)
     //
     const std::string fileName;                             //File name of the panorama picture
     //
@@ -147,17 +353,39 @@ private:
     sf::Vector2i displaySize;                   //Target size for the rectilinear display projection
     sf::Vector2f displayFOV;                    //Field of view covered by projection (depends on 'displaySize' aspect ratio and 'zoom')
     std::vector<sf::Uint8> displayData;         //Data buffer for display projection
+    std::atomic<bool> displayDataComplete;      //Display projection was not abandoned (see cancelDisplayUpdate())
+    std::atomic<unsigned int> displayGeneration;    //Incremented to abandon a running display projection update
+    sf::Time displayTimeLimit;                  //Maximum duration of a display projection update (zero for no limit)
+    std::vector<bool> dirtyDisplayTiles;        //Tiles of the display projection updated since the last takeDirtyDisplayRects()
     //
     std::vector<float> staticDisplayTrafosX;    //Cache for view angle-indep. part of horizontal trafo from display pos. to pano. sphere
     std::vector<float> staticDisplayTrafosY;    //Cache for view angle-indep. part of vertical trafo from display pos. to pano. sphere
     //
+    std::atomic<bool> precomputeCancelled;      //Let the calculation of 'precomputedDisplayTrafos' stop early (result is discarded)
+    std::future<DisplayTrafoCache> precomputedDisplayTrafos;    //Transformations being prepared for an upcoming display size
+    sf::Vector2i precomputedDisplaySize;        //Display size of 'precomputedDisplayTrafos'
+    float precomputedF;                         //Focal length-like parameter 'f' of 'precomputedDisplayTrafos'
+    //
     sf::Vector2i panoSphereSize;                //Image size of the panorama sphere
     std::vector<sf::Uint8> panoSphereData;      //Data buffer for the panorama sphere
+    std::unique_ptr<TileStore> panoSphereTiles; //Out-of-core data buffer for the panorama sphere replacing 'panoSphereData' (if enabled)
+    //
+    std::size_t tileCacheLimit;                 //Total memory limit for fetched tiles of 'picTiles' and 'panoSphereTiles' (0 if disabled)
+    std::string tileDirectory;                  //Directory for the temporary files of 'picTiles' and 'panoSphereTiles'
+    //
+    std::shared_ptr<const std::atomic<bool>> cancelFlag;    //Abandons picture loading and panorama sphere mapping when set (may be nullptr)
+    //
+    PanoSphereLayout panoSphereLayout;          //Storage layout of 'panoSphereData'
+    //
+    std::shared_ptr<const SpherePyramid> panoSpherePyramid; //Multi-resolution panorama sphere replacing 'pic' as source (if available)
+    int panoSphereLevel;                        //Level of 'panoSpherePyramid' used directly instead of 'panoSphereData' (-1 if none)
     //
     const float panoSphereRemapHystMinOvers;    //Min. projection oversampling thresh. (increase pano. sphere resolution when zoom in more)
     const float panoSphereRemapHystTargOvers;   //Target projection oversampling (try reach this value when adjusting pano. sphere resol.)
     const float panoSphereRemapHystMaxOvers;    //Max. projection oversampling thresh. (decrease pano. sphere resolution when zoom out more)
     float panoSphereRemapHystMaxF;      //Max. f beyond which oversampl. cannot be restored by pano. sphere re-calc. (limited picture res.)
+    //
+    MemoryUsage peakMemoryUsage;        //Maximum memory usage of every buffer (and of their sum) so far
 };
 
 #endif // SPNV_PROJECTOR_H
@@ -0,0 +1,1100 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "renderservice.h"
+
+#include "pngwriter.h"
+#include "scenemetadata.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+/*!
+ * \brief Send a complete buffer over a socket.
+ *
+ * \param pSocket Connected socket.
+ * \param pData Data to send.
+ * \param pLength Length of \p pData.
+ * \return If all data were sent.
+ */
+bool sendAll(const int pSocket, const void *const pData, const std::size_t pLength)
+{
+    const char* data = static_cast<const char*>(pData);
+    std::size_t remaining = pLength;
+
+    while (remaining > 0)
+    {
+        const ssize_t numSent = send(pSocket, data, remaining, MSG_NOSIGNAL);
+
+        if (numSent < 0 && errno == EINTR)
+            continue;
+        else if (numSent <= 0)
+            return false;
+
+        data += numSent;
+        remaining -= static_cast<std::size_t>(numSent);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Create a ready future holding a failed response.
+ *
+ * \tparam ResponseT Response type.
+ * \param pErrorMessage Reason of failure.
+ * \return Future with the response.
+ */
+template<typename ResponseT>
+std::future<ResponseT> makeErrorResponse(const std::string& pErrorMessage)
+{
+    std::promise<ResponseT> promise;
+
+    ResponseT response;
+    response.errorMessage = pErrorMessage;
+
+    promise.set_value(std::move(response));
+
+    return promise.get_future();
+}
+
+} // namespace
+
+/*!
+ * \brief Constructor.
+ *
+ * Sets up an empty scene cache. Use preloadScene() to load panorama scenes in advance and run() to serve requests.
+ *
+ * Clients can request the preloaded scenes and, if \p pSceneRoot is not empty, any picture within the directory
+ * \p pSceneRoot or its subdirectories (after resolving symbolic links). Other pictures are refused, so that clients
+ * can neither read arbitrary files nor create cache files (see ProjectorOptions::useSphereCache) elsewhere.
+ *
+ * Since the worker threads share the panorama sphere of each scene, the picture is always released after building the
+ * panorama sphere pyramid, unless the pyramid is loaded from a cache file anyway (see ProjectorOptions::useSphereCache).
+ *
+ * The scenes loaded on request are evicted as soon as their total panorama sphere data size (see PanoramaScene::getDataSize())
+ * exceeds \p pMaxCacheSize, except for the most recently loaded one.
+ *
+ * \param pMaxCacheSize Maximum total size of the panorama scenes loaded on request in bytes.
+ * \param pSceneRoot Directory of the pictures that can be loaded on request (empty for preloaded scenes only).
+ * \param pProjectorOptions Settings for loading the panorama scenes (see ProjectorOptions).
+ * \param pNumThreads Number of worker threads (0 for number of CPU cores).
+ *
+ * \throws std::filesystem::filesystem_error \p pSceneRoot does not exist.
+ */
+RenderService::RenderService(const std::size_t pMaxCacheSize, const std::string& pSceneRoot,
+                             const ProjectorOptions& pProjectorOptions, const unsigned int pNumThreads) :
+    maxCacheSize(pMaxCacheSize),
+    sceneRoot(pSceneRoot.empty() ? std::filesystem::path() : std::filesystem::canonical(pSceneRoot)),
+    projectorOptions(pProjectorOptions),
+    numThreads(pNumThreads != 0 ? pNumThreads : std::max(1u, std::thread::hardware_concurrency())),
+    cacheMutex(),
+    cachedScenes(),
+    sceneUseOrder(),
+    cacheSize(0),
+    preloadedScenes(),
+    numSceneLoads(0),
+    queueMutex(),
+    jobsAvailable(),
+    jobs(),
+    stopping(false),
+    pendingBytes(0),
+    numServedRequests(0),
+    numFailedRequests(0)
+{
+    if (!projectorOptions.useSphereCache)
+        projectorOptions.releasePicture = true;
+
+    projectorOptions.reportMemoryUsage = false;
+}
+
+//Public
+
+/*!
+ * \brief Load a panorama scene into the cache before serving requests.
+ *
+ * Loads the panorama scene of \p pPicFileName (see getScene()), such that the first requests for it are answered
+ * quickly. Clients can request preloaded scenes in any case and they are never evicted from the cache.
+ *
+ * \param pPicFileName Panorama picture file name.
+ * \return If successful.
+ */
+bool RenderService::preloadScene(const std::string& pPicFileName)
+{
+    std::string errorMessage;
+
+    if (!getScene(pPicFileName, errorMessage, true))
+    {
+        std::cerr<<"ERROR: Could not load panorama scene \"" + pPicFileName + "\"!"<<std::endl;
+        std::cerr<<errorMessage<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Serve render requests on a Unix domain socket until terminated.
+ *
+ * Creates a Unix domain stream socket at \p pSocketPath (a stale socket file of a no longer running service is replaced)
+ * and starts the worker threads (see processRequests()). Every connecting client is then served on its own thread (see
+ * serveConnection()), with up to 'maxConnections' simultaneous clients. Further clients get an error response.
+ *
+ * The service runs until it receives SIGINT, SIGTERM or SIGHUP, which are blocked for all threads of the service and
+ * handled via signalfd. It then disconnects all clients, finishes the queued requests and removes the socket file again.
+ *
+ * \param pSocketPath File name of the socket.
+ * \return If the socket could be set up.
+ */
+bool RenderService::run(const std::string& pSocketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (pSocketPath.empty() || pSocketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr<<"ERROR: Invalid socket path \"" + pSocketPath + "\"!"<<std::endl;
+        return false;
+    }
+
+    std::memcpy(address.sun_path, pSocketPath.c_str(), pSocketPath.size() + 1);
+
+    //Block termination signals (inherited by all threads started below) and receive them via signalfd instead
+    sigset_t signals, oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+
+    const int signalFD = signalfd(-1, &signals, SFD_CLOEXEC);
+    const int listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    auto cleanUp = [&signalFD, &listenSocket, &oldSignals]() -> void
+    {
+        if (listenSocket >= 0)
+            close(listenSocket);
+        if (signalFD >= 0)
+            close(signalFD);
+
+        pthread_sigmask(SIG_SETMASK, &oldSignals, nullptr);
+    };
+
+    if (signalFD < 0 || listenSocket < 0)
+    {
+        std::cerr<<"ERROR: Could not create socket!"<<std::endl;
+        std::cerr<<std::strerror(errno)<<std::endl;
+        cleanUp();
+        return false;
+    }
+
+    //Replace a left-over socket file if no service is listening on it anymore
+    struct stat fileStatus = {};
+
+    if (lstat(pSocketPath.c_str(), &fileStatus) == 0 && S_ISSOCK(fileStatus.st_mode))
+    {
+        const int testSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (testSocket >= 0 && connect(testSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+                && errno == ECONNREFUSED)
+        {
+            unlink(pSocketPath.c_str());
+        }
+
+        if (testSocket >= 0)
+            close(testSocket);
+    }
+
+    if (bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listenSocket, static_cast<int>(maxConnections)) != 0)
+    {
+        std::cerr<<"ERROR: Could not listen on socket \"" + pSocketPath + "\"!"<<std::endl;
+        std::cerr<<std::strerror(errno)<<std::endl;
+        cleanUp();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = false;
+    }
+
+    std::vector<std::thread> workers;
+
+    for (unsigned int i = 0; i < numThreads; ++i)
+        workers.emplace_back(&RenderService::processRequests, this);
+
+    std::cout<<"Serving render requests on \""<<pSocketPath<<"\" using "<<numThreads<<" thread(s)."<<std::endl;
+
+    //Connected clients
+    struct Connection
+    {
+        int socket;                             //Connected socket (closed after joining 'thread')
+        std::thread thread;                     //Thread serving the client
+        std::atomic<bool> finished {false};     //Client disconnected and 'thread' can be joined
+    };
+
+    std::list<Connection> connections;
+
+    //Join the threads of disconnected clients
+    auto removeFinishedConnections = [&connections](const bool pAll) -> void
+    {
+        for (auto it = connections.begin(); it != connections.end();)
+        {
+            if (!pAll && !it->finished)
+            {
+                ++it;
+                continue;
+            }
+
+            shutdown(it->socket, SHUT_RDWR);
+            it->thread.join();
+            close(it->socket);
+
+            it = connections.erase(it);
+        }
+    };
+
+    while (true)
+    {
+        std::array<pollfd, 2> pollFDs = {pollfd{signalFD, POLLIN, 0}, pollfd{listenSocket, POLLIN, 0}};
+
+        if (poll(pollFDs.data(), pollFDs.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr<<"ERROR: Could not wait for connections!"<<std::endl;
+            std::cerr<<std::strerror(errno)<<std::endl;
+            break;
+        }
+
+        //Consume the signal, such that it is not delivered when restoring the signal mask
+        if (pollFDs[0].revents != 0)
+        {
+            signalfd_siginfo signalInfo = {};
+
+            if (read(signalFD, &signalInfo, sizeof(signalInfo)) == sizeof(signalInfo))
+                std::cout<<"Received signal "<<signalInfo.ssi_signo<<", stopping render service."<<std::endl;
+
+            break;
+        }
+
+        if (pollFDs[1].revents == 0)
+            continue;
+
+        const int clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+
+        if (clientSocket < 0)
+            continue;
+
+        removeFinishedConnections(false);
+
+        if (connections.size() >= maxConnections)
+        {
+            const std::string errorLine = "ERROR Too many connections.\n";
+            sendAll(clientSocket, errorLine.data(), errorLine.size());
+            close(clientSocket);
+            continue;
+        }
+
+        Connection& connection = connections.emplace_back();
+        connection.socket = clientSocket;
+        connection.thread = std::thread([this, &connection]() -> void
+                                        {
+                                            serveConnection(connection.socket);
+                                            connection.finished = true;
+                                        });
+    }
+
+    //Disconnect all clients, then let the workers finish the queued requests
+
+    removeFinishedConnections(true);
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+
+    jobsAvailable.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    unlink(pSocketPath.c_str());
+
+    cleanUp();
+
+    std::cout<<"Rendered "<<numServedRequests<<" view(s), "<<numFailedRequests<<" request(s) failed."<<std::endl;
+
+    return true;
+}
+
+//
+
+/*!
+ * \brief Parse a request line of the protocol.
+ *
+ * See RenderService for the request format. A trailing carriage return is ignored.
+ *
+ * \param pLine Request line (without line break).
+ * \param pRequest Target for the parsed request.
+ * \param pErrorMessage Target for the reason of failure.
+ * \return If \p pLine is a valid request.
+ */
+bool RenderService::parseRequest(const std::string& pLine, Request& pRequest, std::string& pErrorMessage)
+{
+    std::istringstream lineStream(pLine);
+
+    std::string command, substrFOV, substrFormat;
+    int w = 0, h = 0;
+
+    if (!(lineStream>>command) || command != "RENDER")
+    {
+        pErrorMessage = "Unknown command.";
+        return false;
+    }
+
+    Request request;
+
+    if (!(lineStream>>w>>h>>request.phi>>request.theta>>substrFOV>>substrFormat) || w <= 0 || h <= 0 ||
+            static_cast<std::size_t>(w) * static_cast<std::size_t>(h) > maxViewPixels)
+    {
+        pErrorMessage = "Invalid view.";
+        return false;
+    }
+
+    request.size = {static_cast<unsigned int>(w), static_cast<unsigned int>(h)};
+
+    if (!BatchRenderer::parseFOV(substrFOV, request.fovType, request.fov))
+    {
+        pErrorMessage = "Invalid field of view.";
+        return false;
+    }
+
+    if (substrFormat == "png")
+        request.format = OutputFormat::PNG;
+    else if (substrFormat == "rgba")
+        request.format = OutputFormat::Raw;
+    else
+    {
+        pErrorMessage = "Invalid format.";
+        return false;
+    }
+
+    //Rest of the line (after one separating space) is the picture file name
+    std::getline(lineStream, request.picFileName);
+
+    if (!request.picFileName.empty() && request.picFileName.front() == ' ')
+        request.picFileName.erase(0, 1);
+    if (!request.picFileName.empty() && request.picFileName.back() == '\r')
+        request.picFileName.pop_back();
+
+    if (request.picFileName.empty())
+    {
+        pErrorMessage = "Missing picture file name.";
+        return false;
+    }
+
+    pRequest = std::move(request);
+
+    return true;
+}
+
+//Private
+
+/*!
+ * \brief Get a panorama scene from the cache or load it.
+ *
+ * Looks up the panorama scene of \p pPicFileName (by canonical file name) in the cache and marks it as most recently used.
+ * If it is not cached yet or if the picture or the matching PNV file was modified since loading it, the scene is
+ * (re-)loaded (see loadScene()) and the least recently used scenes are evicted from the cache as necessary (see evictScenes()).
+ *
+ * Unless \p pPreload is set, only preloaded scenes and pictures within the scene root directory
+ * are available (see RenderService()); \p pPreload marks the scene as preloaded instead.
+ *
+ * A scene is loaded only once: concurrent requests for a scene that is still being loaded wait for it.
+ *
+ * \param pPicFileName Panorama picture file name.
+ * \param pErrorMessage Target for the reason of failure.
+ * \param pPreload Load the scene in advance (see preloadScene()).
+ * \return The panorama scene or null if it could not be loaded.
+ */
+std::shared_ptr<const PanoramaScene> RenderService::getScene(const std::string& pPicFileName, std::string& pErrorMessage,
+                                                             const bool pPreload)
+{
+    std::string key, pnvFileName;
+    std::filesystem::file_time_type picWriteTime, pnvWriteTime;
+
+    //Do not tell clients which files exist outside of the allowed ones
+    const std::string unavailableMessage = pPreload ? "Could not find picture or matching PNV file." : "Panorama scene not available.";
+
+    try
+    {
+        std::filesystem::path path = std::filesystem::canonical(pPicFileName);
+        key = path.string();
+
+        {
+            const std::lock_guard<std::mutex> lock(cacheMutex);
+
+            if (pPreload)
+                preloadedScenes.insert(key);
+            else if (preloadedScenes.count(key) == 0 && !isInSceneRoot(path))
+            {
+                pErrorMessage = unavailableMessage;
+                return nullptr;
+            }
+        }
+
+        picWriteTime = std::filesystem::last_write_time(path);
+
+        path.replace_extension("pnv");
+        pnvFileName = path.string();
+        pnvWriteTime = std::filesystem::last_write_time(path);
+    }
+    catch (const std::exception&)
+    {
+        pErrorMessage = unavailableMessage;
+        return nullptr;
+    }
+
+    std::promise<std::shared_ptr<const PanoramaScene>> loadingScene;
+    std::uint64_t loadNumber = 0;
+
+    std::unique_lock<std::mutex> lock(cacheMutex);
+
+    auto it = cachedScenes.find(key);
+
+    if (it != cachedScenes.end() && it->second.picWriteTime == picWriteTime && it->second.pnvWriteTime == pnvWriteTime)
+    {
+        sceneUseOrder.splice(sceneUseOrder.begin(), sceneUseOrder, it->second.usePosition);
+
+        std::shared_future<std::shared_ptr<const PanoramaScene>> scene = it->second.scene;
+
+        lock.unlock();
+
+        if (!scene.get())
+            pErrorMessage = "Could not load panorama scene.";
+
+        return scene.get();
+    }
+
+    //Replace outdated scene
+    if (it != cachedScenes.end())
+    {
+        cacheSize -= it->second.dataSize;
+        sceneUseOrder.erase(it->second.usePosition);
+        cachedScenes.erase(it);
+    }
+
+    loadNumber = ++numSceneLoads;
+
+    sceneUseOrder.push_front(key);
+    cachedScenes[key] = CachedScene{loadingScene.get_future().share(), picWriteTime, pnvWriteTime, loadNumber, sceneUseOrder.begin(), 0};
+
+    lock.unlock();
+
+    //Load outside of lock, such that other scenes can be used meanwhile
+    std::shared_ptr<const PanoramaScene> scene;
+
+    try
+    {
+        scene = loadScene(pPicFileName, pnvFileName);
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr<<"ERROR: Could not load panorama scene \"" + pPicFileName + "\"!"<<std::endl;
+        std::cerr<<exc.what()<<std::endl;
+    }
+
+    loadingScene.set_value(scene);
+
+    lock.lock();
+
+    it = cachedScenes.find(key);
+
+    //Scene might have been replaced meanwhile
+    if (it == cachedScenes.end() || it->second.loadNumber != loadNumber)
+    {
+        if (!scene)
+            pErrorMessage = "Could not load panorama scene.";
+
+        return scene;
+    }
+
+    if (scene)
+    {
+        //Account for the loaded scene and evict least recently used scenes (still used ones stay alive until their requests are done)
+        if (preloadedScenes.count(key) == 0)
+        {
+            it->second.dataSize = scene->getDataSize();
+            cacheSize += it->second.dataSize;
+        }
+
+        evictScenes(key);
+    }
+    else
+    {
+        //Do not keep failed scenes, so they can be retried
+        sceneUseOrder.erase(it->second.usePosition);
+        cachedScenes.erase(it);
+
+        pErrorMessage = "Could not load panorama scene.";
+    }
+
+    return scene;
+}
+
+/*!
+ * \brief Check if a picture may be loaded on request.
+ *
+ * \param pPicPath Canonical picture file name.
+ * \return If a scene root directory is set and contains \p pPicPath (see RenderService()).
+ */
+bool RenderService::isInSceneRoot(const std::filesystem::path& pPicPath) const
+{
+    if (sceneRoot.empty())
+        return false;
+
+    return std::mismatch(sceneRoot.begin(), sceneRoot.end(), pPicPath.begin(), pPicPath.end()).first == sceneRoot.end();
+}
+
+/*!
+ * \brief Evict scenes until the cache size limit is met.
+ *
+ * Removes the least recently used scenes loaded on request from the cache until their total size is within the limit
+ * (see RenderService()). Preloaded scenes, scenes still being loaded and the scene \p pKeepKey are kept.
+ * Evicted scenes that are still being rendered stay valid until their requests are done.
+ *
+ * Must be called with 'cacheMutex' locked.
+ *
+ * \param pKeepKey Cache key of the scene to keep in any case.
+ */
+void RenderService::evictScenes(const std::string& pKeepKey)
+{
+    for (auto it = sceneUseOrder.end(); cacheSize > maxCacheSize && it != sceneUseOrder.begin();)
+    {
+        --it;
+
+        auto sceneIt = cachedScenes.find(*it);
+
+        if (*it == pKeepKey || sceneIt->second.dataSize == 0)
+            continue;
+
+        cacheSize -= sceneIt->second.dataSize;
+        cachedScenes.erase(sceneIt);
+
+        it = sceneUseOrder.erase(it);
+    }
+}
+
+/*!
+ * \brief Load a panorama scene.
+ *
+ * Loads the meta data from \p pPNVFileName (see SceneMetaData::loadFromPNVFile()) and the picture \p pPicFileName
+ * with a Projector (see Projector()) and creates the panorama scene from it (see Projector::createScene()).
+ *
+ * \param pPicFileName Panorama picture file name.
+ * \param pPNVFileName Matching PNV file name.
+ * \return The panorama scene or null if the PNV file could not be loaded.
+ *
+ * \throws std::runtime_error Panorama scene has no panorama sphere pyramid.
+ * \throws std::exception Any exception from Projector().
+ */
+std::shared_ptr<const PanoramaScene> RenderService::loadScene(const std::string& pPicFileName, const std::string& pPNVFileName) const
+{
+    SceneMetaData metaData;
+
+    if (!metaData.loadFromPNVFile(pPNVFileName))
+        return nullptr;
+
+    Projector projector(pPicFileName, metaData, projectorOptions);
+
+    std::shared_ptr<const PanoramaScene> scene = projector.createScene();
+
+    if (!scene)
+        throw std::runtime_error("Panorama sphere pyramid is not available.");
+
+    return scene;
+}
+
+/*!
+ * \brief Render the views of requests.
+ *
+ * Renders the perspectives of \p pRequests with \p pScene and converts them to the requested formats. The perspectives
+ * are adjusted as necessary to avoid margins (see PanoramaScene::fitView()). Views of equal size and zoom level (e.g.
+ * thumbnails of different parts of the scene) are rendered together, sharing their transformations (see
+ * PanoramaScene::renderBatch()). This happens on the calling thread only, since the workers already run in parallel.
+ *
+ * \param pScene Panorama scene of the requests.
+ * \param pRequests Requests to render.
+ * \return Rendered views in the order of \p pRequests.
+ */
+std::vector<RenderService::Response> RenderService::renderRequests(const PanoramaScene& pScene, const std::vector<const Request*>& pRequests)
+{
+    const float degToRad = static_cast<float>(M_PI) / 180.f;
+
+    std::vector<Response> responses(pRequests.size());
+    std::vector<std::vector<sf::Uint8>> pixels(pRequests.size());
+
+    //Requested zoom levels
+    std::vector<float> zooms;
+
+    for (const Request* request : pRequests)
+    {
+        if (request->fovType == BatchRenderer::FOVType::Horizontal)
+            zooms.push_back(pScene.getRequiredZoomFromHFOV(request->fov * degToRad, request->size));
+        else if (request->fovType == BatchRenderer::FOVType::Vertical)
+            zooms.push_back(pScene.getRequiredZoomFromVFOV(request->fov * degToRad));
+        else
+            zooms.push_back(request->fov);
+    }
+
+    //Render each group of views with equal size and zoom level at once
+    std::vector<bool> rendered(pRequests.size(), false);
+
+    for (std::size_t i = 0; i < pRequests.size(); ++i)
+    {
+        if (rendered[i])
+            continue;
+
+        const sf::Vector2u size = pRequests[i]->size;
+
+        std::vector<std::size_t> group;
+        std::vector<sf::Vector2f> offsets;
+        std::vector<PanoramaScene::OutputBuffer> outputs;
+
+        for (std::size_t j = i; j < pRequests.size(); ++j)
+        {
+            if (rendered[j] || pRequests[j]->size != size || zooms[j] != zooms[i])
+                continue;
+
+            const sf::Vector2f offset(pRequests[j]->phi * degToRad, pRequests[j]->theta * degToRad);
+
+            pixels[j].resize(4 * static_cast<std::size_t>(size.x) * size.y);
+
+            responses[j].size = size;
+            responses[j].view = pScene.fitView(PanoramaScene::ViewState{zooms[j], offset.x, offset.y}, size);
+
+            group.push_back(j);
+            offsets.push_back(offset);
+            outputs.push_back(PanoramaScene::OutputBuffer{pixels[j].data(), size});
+
+            rendered[j] = true;
+        }
+
+        if (!pScene.renderBatch(zooms[i], offsets, outputs, 1))
+            for (const std::size_t j : group)
+                responses[j].errorMessage = "Could not render view.";
+    }
+
+    //Convert to requested formats
+    for (std::size_t i = 0; i < pRequests.size(); ++i)
+    {
+        if (!responses[i].errorMessage.empty())
+            continue;
+
+        if (pRequests[i]->format == OutputFormat::Raw)
+        {
+            responses[i].data = std::move(pixels[i]);
+            continue;
+        }
+
+        PngWriter writer;
+
+        if (!writer.open(responses[i].data, responses[i].size) || !writer.writeRows(pixels[i].data(), responses[i].size.y) ||
+                !writer.close())
+        {
+            responses[i].errorMessage = "Could not encode PNG file.";
+        }
+
+        pixels[i] = std::vector<sf::Uint8>();
+    }
+
+    return responses;
+}
+
+//
+
+/*!
+ * \brief Queue a request for the worker threads.
+ *
+ * \param pRequest Request to render.
+ * \return Future for the response.
+ */
+std::future<RenderService::Response> RenderService::submitRequest(Request&& pRequest)
+{
+    std::unique_ptr<Job> job = std::make_unique<Job>();
+    job->request = std::move(pRequest);
+
+    std::future<Response> response = job->response.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        jobs.push_back(std::move(job));
+    }
+
+    jobsAvailable.notify_one();
+
+    return response;
+}
+
+/*!
+ * \brief Render queued requests until the service stops.
+ *
+ * Takes the oldest queued request together with further queued requests for the same picture (in total a share of
+ * 1/'numThreads' of them, but at most 'maxBatchSize'), gets their panorama scene once (see getScene()) and renders them
+ * (see renderRequests()).
+ * Returns when the service is stopping and the queue is empty.
+ */
+void RenderService::processRequests()
+{
+    std::vector<std::unique_ptr<Job>> batch;
+
+    while (true)
+    {
+        batch.clear();
+
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            jobsAvailable.wait(lock, [this]() { return !jobs.empty() || stopping; });
+
+            if (jobs.empty())
+                return;
+
+            const std::string picFileName = jobs.front()->request.picFileName;
+
+            auto isSameScene = [&picFileName](const std::unique_ptr<Job>& pJob) -> bool
+            {
+                return pJob->request.picFileName == picFileName;
+            };
+
+            const std::size_t numSameScene = static_cast<std::size_t>(std::count_if(jobs.begin(), jobs.end(), isSameScene));
+            const std::size_t batchSize = std::min((numSameScene + numThreads - 1) / numThreads, maxBatchSize);
+
+            for (auto it = jobs.begin(); it != jobs.end() && batch.size() < batchSize;)
+            {
+                if (isSameScene(*it))
+                {
+                    batch.push_back(std::move(*it));
+                    it = jobs.erase(it);
+                }
+                else
+                    ++it;
+            }
+
+            //Let other workers take the remaining jobs
+            if (!jobs.empty())
+                jobsAvailable.notify_one();
+        }
+
+        std::string errorMessage;
+        const std::shared_ptr<const PanoramaScene> scene = getScene(batch.front()->request.picFileName, errorMessage);
+
+        std::vector<Response> responses;
+
+        if (scene)
+        {
+            std::vector<const Request*> requests;
+
+            for (const std::unique_ptr<Job>& job : batch)
+                requests.push_back(&job->request);
+
+            try
+            {
+                responses = renderRequests(*scene, requests);
+            }
+            catch (const std::exception& exc)
+            {
+                errorMessage = "Could not render view: " + std::string(exc.what());
+            }
+        }
+
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            Response response;
+
+            if (responses.empty())
+                response.errorMessage = errorMessage;
+            else
+                response = std::move(responses[i]);
+
+            if (response.errorMessage.empty())
+                ++numServedRequests;
+            else
+                ++numFailedRequests;
+
+            batch[i]->response.set_value(std::move(response));
+        }
+    }
+}
+
+/*!
+ * \brief Receive the requests of a client and send the responses.
+ *
+ * Reads request lines from \p pSocket until the client disconnects (or the socket is shut down) and submits each
+ * complete request to the workers right away (see submitRequest()), such that pipelined requests are rendered in parallel.
+ * The responses are sent in request order by a separate thread as soon as they are ready, so reading further requests
+ * never waits for rendering. Unanswered requests are accepted up to a total view size of 'maxClientPendingBytes'
+ * (as "rgba" pixels, which also bounds a PNG file); reading then pauses until responses have been sent. A request
+ * that would exceed 'maxPendingBytes' for all connections together is answered with an error instead, such that
+ * clients not reading their responses cannot stall the others. Invalid requests and too long lines are answered
+ * with an error; after a too long line the connection is closed.
+ *
+ * \param pSocket Connected socket (not closed by this function).
+ */
+void RenderService::serveConnection(const int pSocket)
+{
+    //Response not sent yet and the size of its view counted towards 'pendingBytes'
+    struct PendingResponse
+    {
+        std::future<Response> response;
+        std::size_t viewBytes;
+    };
+
+    std::mutex pendingMutex;
+    std::condition_variable pendingChanged;
+    std::deque<PendingResponse> pending;            //Responses not sent yet, in request order
+    std::size_t clientPendingBytes = 0;             //Total 'PendingResponse::viewBytes' of 'pending'
+
+    bool receiving = true;      //Further requests may still be added to 'pending'
+    bool sending = true;        //Responses can still be sent (false after the client disconnected)
+
+    //Send responses in request order
+    std::thread sender([this, pSocket, &pendingMutex, &pendingChanged, &pending, &clientPendingBytes, &receiving, &sending]() -> void
+    {
+        while (true)
+        {
+            std::future<Response> future;
+            std::size_t viewBytes = 0;
+
+            {
+                std::unique_lock<std::mutex> lock(pendingMutex);
+                pendingChanged.wait(lock, [&pending, &receiving]() { return !pending.empty() || !receiving; });
+
+                if (pending.empty())
+                    return;
+
+                future = std::move(pending.front().response);
+                viewBytes = pending.front().viewBytes;
+            }
+
+            //Wait for the response even if the client disconnected, since the job refers to nothing of this connection
+            const Response response = future.get();
+
+            bool stillSending = false;
+
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                pending.pop_front();
+                stillSending = sending;
+            }
+
+            pendingChanged.notify_all();
+
+            //Release the view size only after sending, as the response data are held until then
+            auto releaseViewBytes = [this, &pendingMutex, &pendingChanged, &clientPendingBytes, viewBytes]() -> void
+            {
+                pendingBytes -= viewBytes;
+
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    clientPendingBytes -= viewBytes;
+                }
+
+                pendingChanged.notify_all();
+            };
+
+            if (!stillSending)
+            {
+                releaseViewBytes();
+                continue;
+            }
+
+            std::string headLine;
+
+            if (response.errorMessage.empty())
+            {
+                const float radToDeg = 180.f / static_cast<float>(M_PI);
+
+                std::ostringstream headStream;
+                headStream<<"OK "<<response.data.size()<<" "<<response.size.x<<" "<<response.size.y<<" "
+                          <<response.view.offsetPhi * radToDeg<<" "<<response.view.offsetTheta * radToDeg<<" "
+                          <<response.view.zoom<<"\n";
+
+                headLine = headStream.str();
+            }
+            else
+                headLine = "ERROR " + response.errorMessage + "\n";
+
+            if (!sendAll(pSocket, headLine.data(), headLine.size()) ||
+                    (response.errorMessage.empty() && !sendAll(pSocket, response.data.data(), response.data.size())))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    sending = false;
+                }
+
+                pendingChanged.notify_all();
+            }
+
+            releaseViewBytes();
+        }
+    });
+
+    //Wait until the client's pending views leave room for \p pViewBytes (see 'maxClientPendingBytes') and reserve them;
+    //returns false if the client cannot receive responses anymore
+    auto reserveViewBytes = [&pendingMutex, &pendingChanged, &clientPendingBytes, &sending](const std::size_t pViewBytes) -> bool
+    {
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            pendingChanged.wait(lock, [&clientPendingBytes, &sending, pViewBytes]()
+                                      { return clientPendingBytes + pViewBytes <= maxClientPendingBytes || !sending; });
+
+            if (!sending)
+                return false;
+
+            clientPendingBytes += pViewBytes;
+        }
+
+        return true;
+    };
+
+    //Add a response to be sent together with the view size reserved for it (see 'reserveViewBytes');
+    //returns false if the client cannot receive responses anymore
+    auto addResponse = [&pendingMutex, &pendingChanged, &pending, &sending](std::future<Response>&& pResponse,
+                                                                             const std::size_t pViewBytes) -> bool
+    {
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+
+            //The sender releases the reserved size of the response
+            pending.push_back({std::move(pResponse), pViewBytes});
+
+            if (!sending)
+                return false;
+        }
+
+        pendingChanged.notify_all();
+
+        return true;
+    };
+
+    std::string received;
+    std::vector<char> chunk(65536);
+
+    bool open = true;
+
+    while (open)
+    {
+        const ssize_t numReceived = recv(pSocket, chunk.data(), chunk.size(), 0);
+
+        if (numReceived < 0 && errno == EINTR)
+            continue;
+        else if (numReceived <= 0)
+            break;
+
+        received.append(chunk.data(), static_cast<std::size_t>(numReceived));
+
+        //Submit all complete requests
+        std::size_t lineStart = 0;
+
+        for (std::size_t lineEnd = received.find('\n'); open && lineEnd != std::string::npos; lineEnd = received.find('\n', lineStart))
+        {
+            Request request;
+            std::string errorMessage;
+
+            if (parseRequest(received.substr(lineStart, lineEnd - lineStart), request, errorMessage))
+            {
+                const std::size_t viewBytes = 4 * static_cast<std::size_t>(request.size.x) * request.size.y;
+
+                open = reserveViewBytes(viewBytes);
+
+                if (!open)
+                    break;
+
+                //Refuse instead of waiting for the views of all clients, since other clients might not read their responses
+                if (pendingBytes.fetch_add(viewBytes) + viewBytes > maxPendingBytes)
+                {
+                    pendingBytes -= viewBytes;
+
+                    {
+                        std::lock_guard<std::mutex> lock(pendingMutex);
+                        clientPendingBytes -= viewBytes;
+                    }
+
+                    ++numFailedRequests;
+                    open = addResponse(makeErrorResponse<Response>("Service busy."), 0);
+                }
+                else
+                    open = addResponse(submitRequest(std::move(request)), viewBytes);
+            }
+            else
+            {
+                ++numFailedRequests;
+                open = addResponse(makeErrorResponse<Response>(errorMessage), 0);
+            }
+
+            lineStart = lineEnd + 1;
+        }
+
+        received.erase(0, lineStart);
+
+        if (open && received.size() > maxRequestLength)
+        {
+            addResponse(makeErrorResponse<Response>("Request too long."), 0);
+            open = false;
+        }
+    }
+
+    //Let the sender finish the pending responses
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        receiving = false;
+    }
+
+    pendingChanged.notify_all();
+
+    sender.join();
+}
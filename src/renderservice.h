@@ -0,0 +1,203 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_RENDERSERVICE_H
+#define SPNV_RENDERSERVICE_H
+
+#include "batchrenderer.h"
+#include "panoramascene.h"
+#include "projector.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Local daemon rendering panorama scene perspectives on request over a Unix domain socket.
+ *
+ * Listens on a Unix domain stream socket (see run()) and answers render requests of local clients with the rendered
+ * view as PNG file or as raw "rgba" pixels, without starting a new process and loading the panorama scene per request.
+ *
+ * Protocol: a client sends one request per line and receives one response per request, in the same order. A request reads
+ *
+ * "RENDER" + " " + WIDTH + " " + HEIGHT + " " + PHI + " " + THETA + " " + FOV + " " + FORMAT + " " + PICTURE_FILE
+ *
+ * with WIDTH, HEIGHT, PHI, THETA and FOV as in a "view file" (see BatchRenderer::loadViewsFromFile()), FORMAT being "png"
+ * or "rgba" and PICTURE_FILE being the panorama picture (may contain spaces; its meta data are loaded from the matching
+ * PNV file). Clients can only request the preloaded panorama scenes (see preloadScene()) and, if a scene root directory
+ * was set (see RenderService()), the pictures within that directory tree. A successful response is a line
+ *
+ * "OK" + " " + BYTES + " " + WIDTH + " " + HEIGHT + " " + PHI + " " + THETA + " " + ZOOM
+ *
+ * followed by BYTES bytes of the PNG file or of the "rgba" pixels (continuous rows), where PHI, THETA (in degrees) and ZOOM
+ * describe the actually rendered perspective (see PanoramaScene::fitView()). A failed request is answered with a line
+ * "ERROR" + " " + MESSAGE. Lines end with "\n". Requests may be pipelined, i.e. sent before reading previous responses.
+ * Pipelined requests are accepted until their views (counted as "rgba" pixels) reach 'maxClientPendingBytes' per client;
+ * reading further requests then pauses until responses have been sent. If the views of all clients would exceed
+ * 'maxPendingBytes', the request is answered with an error instead.
+ *
+ * Requests are rendered by a pool of worker threads. Queued requests for the same panorama scene are taken in batches,
+ * such that the scene is looked up once per batch while the batches of a scene are still spread over all workers.
+ * Views of equal size and zoom level within a batch are rendered together (see PanoramaScene::renderBatch()).
+ * Loaded panorama scenes (see PanoramaScene) are kept in a cache with least recently used eviction, which is limited by the
+ * size of the scenes' panorama sphere data (preloaded scenes are always kept and do not count towards the limit).
+ * Scenes are reloaded when the picture or PNV file was modified. Every scene is loaded only once, even if several
+ * workers request it concurrently, and a scene evicted while still being rendered stays valid until it is done.
+ */
+class RenderService
+{
+public:
+    /*!
+     * \brief Format of a rendered view in the response.
+     */
+    enum class OutputFormat : std::uint8_t
+    {
+        PNG,    ///< PNG file.
+        Raw     ///< Uncompressed "rgba" pixels, row by row.
+    };
+
+    /*!
+     * \brief A single render request.
+     */
+    struct Request
+    {
+        std::string picFileName;            ///< Panorama picture file name.
+        sf::Vector2u size;                  ///< Size of the rendered view.
+        float phi = 0;                      ///< Horizontal view angle offset in degrees.
+        float theta = 0;                    ///< Vertical view angle offset in degrees.
+        BatchRenderer::FOVType fovType = BatchRenderer::FOVType::Zoom;  ///< Meaning of 'fov'.
+        float fov = 0;                      ///< Zoom level or field of view.
+        OutputFormat format = OutputFormat::PNG;                        ///< Format of the rendered view.
+    };
+
+public:
+    RenderService(std::size_t pMaxCacheSize, const std::string& pSceneRoot = "",
+                  const ProjectorOptions& pProjectorOptions = ProjectorOptions(),
+                  unsigned int pNumThreads = 0);                    ///< Constructor.
+    RenderService(const RenderService&) = delete;                   ///< Deleted copy constructor.
+    //
+    RenderService& operator=(const RenderService&) = delete;        ///< Deleted copy assignment operator.
+    //
+    bool preloadScene(const std::string& pPicFileName);             ///< Load a panorama scene into the cache before serving requests.
+    bool run(const std::string& pSocketPath);                       ///< Serve render requests on a Unix domain socket until terminated.
+    //
+    static bool parseRequest(const std::string& pLine, Request& pRequest,
+                             std::string& pErrorMessage);           ///< Parse a request line of the protocol.
+
+private:
+    /*!
+     * \brief Result of a render request.
+     */
+    struct Response
+    {
+        std::string errorMessage;           //Reason of failure (empty if successful)
+        sf::Vector2u size;                  //Size of the rendered view
+        PanoramaScene::ViewState view;      //Actually rendered perspective
+        std::vector<sf::Uint8> data;        //PNG file or "rgba" pixels
+    };
+
+    /*!
+     * \brief Queued render request.
+     */
+    struct Job
+    {
+        Request request;                    //Request to render
+        std::promise<Response> response;    //Result for the waiting connection
+    };
+
+    /*!
+     * \brief Cache entry of a (possibly still loading) panorama scene.
+     */
+    struct CachedScene
+    {
+        std::shared_future<std::shared_ptr<const PanoramaScene>> scene;     //Loaded scene (null if loading failed)
+        std::filesystem::file_time_type picWriteTime;                       //Modification time of the picture when loaded
+        std::filesystem::file_time_type pnvWriteTime;                       //Modification time of the PNV file when loaded
+        std::uint64_t loadNumber;                                           //Identifies the loading of the scene
+        std::list<std::string>::iterator usePosition;                       //Position in the least recently used order
+        std::size_t dataSize;                                               //Size of the scene data (0 while loading or if preloaded)
+    };
+
+private:
+    std::shared_ptr<const PanoramaScene> getScene(const std::string& pPicFileName, std::string& pErrorMessage,
+                                                  bool pPreload = false);           ///< Get a panorama scene from the cache or load it.
+    bool isInSceneRoot(const std::filesystem::path& pPicPath) const;                ///< Check if a picture may be loaded on request.
+    void evictScenes(const std::string& pKeepKey);                                  ///< Evict scenes until the cache size limit is met.
+    std::shared_ptr<const PanoramaScene> loadScene(const std::string& pPicFileName,
+                                                   const std::string& pPNVFileName) const;  ///< Load a panorama scene.
+    static std::vector<Response> renderRequests(const PanoramaScene& pScene,
+                                                const std::vector<const Request*>& pRequests);  ///< Render the views of requests.
+    //
+    std::future<Response> submitRequest(Request&& pRequest);        ///< Queue a request for the worker threads.
+    void processRequests();                                         ///< Render queued requests until the service stops.
+    void serveConnection(int pSocket);                              ///< Receive the requests of a client and send the responses.
+
+private:
+    static constexpr std::size_t maxViewPixels = 4096 * 4096;       ///< Maximum size of a rendered view.
+    static constexpr std::size_t maxRequestLength = 8192;           ///< Maximum length of a request line.
+    static constexpr std::size_t maxConnections = 64;               ///< Maximum number of simultaneously connected clients.
+    static constexpr std::size_t maxBatchSize = 16;                 ///< Maximum number of requests rendered together by a worker.
+    static constexpr std::size_t maxClientPendingBytes = std::size_t(256) << 20;    ///< \brief Maximum size of the views of a client
+                                                                                    ///  waiting for their responses.
+    static constexpr std::size_t maxPendingBytes = std::size_t(1024) << 20;         ///< \brief Maximum size of the views of all clients
+                                                                                    ///  waiting for their responses.
+
+private:
+    const std::size_t maxCacheSize;                     //Maximum size of the panorama scenes loaded on request in bytes
+    const std::filesystem::path sceneRoot;              //Canonical directory of the pictures loadable on request (empty for none)
+    ProjectorOptions projectorOptions;                  //Settings for loading the panorama scenes
+    const unsigned int numThreads;                      //Number of worker threads
+    //
+    std::mutex cacheMutex;                              //Protects 'cachedScenes', 'sceneUseOrder', 'cacheSize', 'preloadedScenes'
+                                                        //and 'numSceneLoads'
+    std::map<std::string, CachedScene> cachedScenes;    //Loaded panorama scenes by canonical picture file name
+    std::list<std::string> sceneUseOrder;               //Keys of 'cachedScenes' from most to least recently used
+    std::size_t cacheSize;                              //Total 'CachedScene::dataSize' of 'cachedScenes'
+    std::set<std::string> preloadedScenes;              //Keys of the preloaded scenes (never evicted)
+    std::uint64_t numSceneLoads;                        //Number of started scene loadings
+    //
+    std::mutex queueMutex;                              //Protects 'jobs' and 'stopping'
+    std::condition_variable jobsAvailable;              //Signals new jobs or stopping to the worker threads
+    std::deque<std::unique_ptr<Job>> jobs;              //Queued render requests
+    bool stopping;                                      //Worker threads shall exit when the queue is empty
+    //
+    std::atomic<std::size_t> pendingBytes;              //Size of the views of all clients waiting for their responses
+    //
+    std::atomic<std::size_t> numServedRequests;         //Number of successfully rendered requests
+    std::atomic<std::size_t> numFailedRequests;         //Number of failed requests
+};
+
+#endif // SPNV_RENDERSERVICE_H
@@ -0,0 +1,261 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "sharedframeoutput.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Shared memory atomics must be lock-free.");
+
+namespace
+{
+
+/*!
+ * \brief Get the current time of a clock in nanoseconds.
+ *
+ * \param pClock Clock ID (e.g. CLOCK_MONOTONIC).
+ * \return Current time.
+ */
+std::int64_t getClockTimeNs(const clockid_t pClock)
+{
+    timespec time = {};
+    clock_gettime(pClock, &time);
+
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+} // namespace
+
+/*!
+ * \brief Constructor.
+ *
+ * Creates the POSIX shared memory object \p pName (a leading "/" is added if missing) with
+ * three slots for frames of up to \p pMaxSize and initializes its Header (see SharedFrameOutput).
+ *
+ * The object is created exclusively: if it already exists, e.g. because another instance publishes to it,
+ * the constructor fails instead of truncating the buffer under its producer and consumers. A stale object
+ * left by a crashed process must be removed manually (e.g. from "/dev/shm").
+ *
+ * \param pName Name of the shared memory object.
+ * \param pMaxSize Maximum frame size.
+ *
+ * \throws std::invalid_argument Empty maximum frame size.
+ * \throws std::runtime_error Shared memory object already exists.
+ * \throws std::runtime_error Could not create or map the shared memory object.
+ */
+SharedFrameOutput::SharedFrameOutput(const std::string& pName, const sf::Vector2u pMaxSize) :
+    name(pName.find('/') == 0 ? pName : "/" + pName),
+    maxSize(pMaxSize),
+    mapping(nullptr),
+    mappingLength(0),
+    header(nullptr),
+    backSlot(0),
+    numFrames(0)
+{
+    if (maxSize.x == 0 || maxSize.y == 0)
+        throw std::invalid_argument("Invalid maximum frame size!");
+
+    //Page-aligned pixel data for every slot
+    const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+    const std::size_t dataOffset = (sizeof(Header) + pageSize - 1) / pageSize * pageSize;
+    const std::size_t slotCapacity = (4 * static_cast<std::size_t>(maxSize.x) * maxSize.y + pageSize - 1) / pageSize * pageSize;
+
+    mappingLength = dataOffset + numSlots * slotCapacity;
+
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if (fd < 0 && errno == EEXIST)
+        throw std::runtime_error("Shared memory object \"" + name + "\" already exists (used by another instance?)!");
+    else if (fd < 0)
+        throw std::runtime_error("Could not create shared memory object \"" + name + "\"!");
+
+    if (ftruncate(fd, static_cast<off_t>(mappingLength)) != 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not resize shared memory object \"" + name + "\"!");
+    }
+
+    mapping = mmap(nullptr, mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not map shared memory object \"" + name + "\"!");
+    }
+
+    header = new (mapping) Header();
+
+    header->numSlots = numSlots;
+    header->bytesPerPixel = 4;
+    header->maxWidth = maxSize.x;
+    header->maxHeight = maxSize.y;
+    header->slotCapacity = slotCapacity;
+    header->dataOffset = dataOffset;
+
+    //Producer starts with slot 0, slot 1 is the "middle" slot and the consumer starts with slot 2
+    backSlot = 0;
+    header->middleSlot.store(1);
+    header->frameCounter.store(0);
+    header->closed.store(0);
+
+    //Publish the layout last, so a consumer that sees the magic value also sees a complete header
+    header->version = versionValue;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = magicValue;
+}
+
+/*!
+ * \brief Destructor.
+ *
+ * Marks the output as closed (see Header::closed), wakes all waiting consumers and removes the shared memory
+ * object. Consumers that still have it mapped can finish reading their current frame.
+ */
+SharedFrameOutput::~SharedFrameOutput()
+{
+    header->closed.store(1, std::memory_order_release);
+    header->frameCounter.fetch_add(1, std::memory_order_release);
+
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&header->frameCounter), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+
+    munmap(mapping, mappingLength);
+    shm_unlink(name.c_str());
+}
+
+//Public
+
+/*!
+ * \brief Get the name of the shared memory object.
+ *
+ * \return Name (with leading "/").
+ */
+const std::string& SharedFrameOutput::getName() const
+{
+    return name;
+}
+
+/*!
+ * \brief Get the maximum frame size.
+ *
+ * \return Maximum frame size.
+ */
+sf::Vector2u SharedFrameOutput::getMaxSize() const
+{
+    return maxSize;
+}
+
+//
+
+/*!
+ * \brief Get the pixel buffer of the slot for the next frame.
+ *
+ * The next frame can be rendered directly into this buffer (e.g. via PanoramaScene::render()) and then be
+ * published via publish(sf::Vector2u, const FrameInfo&). The buffer holds Header::slotCapacity bytes
+ * and changes after every call to publish().
+ *
+ * \return Pixel buffer of the current back slot.
+ */
+sf::Uint8* SharedFrameOutput::getBackBuffer()
+{
+    return static_cast<sf::Uint8*>(mapping) + header->dataOffset + backSlot * header->slotCapacity;
+}
+
+/*!
+ * \brief Publish the frame written to the back buffer.
+ *
+ * Stores \p pInfo (with frame number, size and publish times filled in) for the back slot, exchanges the back slot
+ * with the "middle" slot, increments the frame counter and wakes waiting consumers (see SharedFrameOutput).
+ *
+ * \param pSize Size of the frame in the back buffer (see getBackBuffer()).
+ * \param pInfo Perspective and render time of the frame.
+ * \return If \p pSize is valid (not empty and not larger than getMaxSize()).
+ */
+bool SharedFrameOutput::publish(const sf::Vector2u pSize, const FrameInfo& pInfo)
+{
+    if (pSize.x == 0 || pSize.y == 0 || pSize.x > maxSize.x || pSize.y > maxSize.y)
+        return false;
+
+    FrameInfo& info = header->slots[backSlot];
+
+    info = pInfo;
+    info.frameNumber = ++numFrames;
+    info.width = pSize.x;
+    info.height = pSize.y;
+    info.reserved = 0;
+    info.publishTimeNs = getMonotonicTimeNs();
+    info.wallClockTimeNs = getClockTimeNs(CLOCK_REALTIME);
+
+    //Hand the finished slot over and continue with the previous "middle" slot
+    backSlot = header->middleSlot.exchange(backSlot | newFrameFlag, std::memory_order_acq_rel) & slotIndexMask;
+
+    header->frameCounter.fetch_add(1, std::memory_order_release);
+
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&header->frameCounter), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+
+    return true;
+}
+
+/*!
+ * \brief Copy a frame to the back buffer and publish it.
+ *
+ * Same as publish(sf::Vector2u, const FrameInfo&) after copying \p pPixels to the back buffer (see getBackBuffer()).
+ *
+ * \param pPixels Frame pixels in the format of Projector::getDisplayData().
+ * \param pSize Frame size.
+ * \param pInfo Perspective and render time of the frame.
+ * \return If \p pSize is valid (not empty and not larger than getMaxSize()).
+ */
+bool SharedFrameOutput::publish(const sf::Uint8 *const pPixels, const sf::Vector2u pSize, const FrameInfo& pInfo)
+{
+    if (pSize.x == 0 || pSize.y == 0 || pSize.x > maxSize.x || pSize.y > maxSize.y)
+        return false;
+
+    std::memcpy(getBackBuffer(), pPixels, 4 * static_cast<std::size_t>(pSize.x) * pSize.y);
+
+    return publish(pSize, pInfo);
+}
+
+//
+
+/*!
+ * \brief Get the current CLOCK_MONOTONIC time in nanoseconds (see FrameInfo).
+ *
+ * \return Current time.
+ */
+std::int64_t SharedFrameOutput::getMonotonicTimeNs()
+{
+    return getClockTimeNs(CLOCK_MONOTONIC);
+}
@@ -0,0 +1,129 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_SHAREDFRAMEOUTPUT_H
+#define SPNV_SHAREDFRAMEOUTPUT_H
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*!
+ * \brief Hand rendered frames to another local process via a POSIX shared memory triple buffer.
+ *
+ * Creates a shared memory object (see shm_open()) that holds a Header followed by three frame slots. The producer
+ * (this class) writes every new frame into its current back slot and publishes it (see publish()) by exchanging the
+ * back slot with the shared "middle" slot index and incrementing the frame counter, which also wakes consumers waiting
+ * on it via futex. A consumer owns the third ("front") slot and can always read the latest complete frame without
+ * blocking the producer and without the producer overwriting the frame being read. Frames that are not fetched in
+ * time are dropped (only the latest one is kept), so a slow consumer never slows down the rendering.
+ *
+ * Consumer protocol (all atomics are lock-free 32 bit integers in the shared memory, see Header):
+ * 1. Map the shared memory object, check Header::magic and Header::version and set its front slot index to 2.
+ * 2. Wait until Header::frameCounter differs from the last seen value (e.g. via FUTEX_WAIT without FUTEX_PRIVATE_FLAG).
+ * 3. If Header::middleSlot has 'newFrameFlag' set, exchange it with the front slot index (without the flag) and keep
+ *    the result (with the flag cleared) as new front slot index. Then read Header::slots and the pixel data of the
+ *    front slot, which starts at Header::dataOffset + front * Header::slotCapacity.
+ * 4. Stop when Header::closed is non-zero (the producer also wakes all waiting consumers then).
+ *
+ * The pixel data of every frame use the "rgba" format of Projector::getDisplayData() with continuous rows.
+ */
+class SharedFrameOutput
+{
+public:
+    static constexpr std::uint32_t magicValue = 0x564E5053;     ///< Value of Header::magic ("SPNV" in little endian byte order).
+    static constexpr std::uint32_t versionValue = 1;            ///< Value of Header::version (changed for incompatible layouts).
+    static constexpr std::uint32_t numSlots = 3;                ///< Number of frame slots (triple buffer).
+    static constexpr std::uint32_t newFrameFlag = 0x4;          ///< Flag in Header::middleSlot marking a not yet fetched frame.
+    static constexpr std::uint32_t slotIndexMask = 0x3;         ///< Mask for the slot index in Header::middleSlot.
+
+    /*!
+     * \brief Frame information stored alongside the pixel data of every slot.
+     */
+    struct FrameInfo
+    {
+        std::uint64_t frameNumber = 0;      ///< Number of the frame (counting from 1; set by publish()).
+        std::uint32_t width = 0;            ///< Frame width (set by publish()).
+        std::uint32_t height = 0;           ///< Frame height (set by publish()).
+        float zoom = 0;                     ///< Zoom level of the perspective (see Projector::getZoom()).
+        float offsetPhi = 0;                ///< Horizontal view angle offset in radians (see Projector::getOffsetPhi()).
+        float offsetTheta = 0;              ///< Vertical view angle offset in radians (see Projector::getOffsetTheta()).
+        std::uint32_t reserved = 0;         ///< Padding (zero).
+        std::int64_t renderTimeNs = 0;      ///< Time when rendering of the frame was finished (CLOCK_MONOTONIC, 0 if unknown).
+        std::int64_t publishTimeNs = 0;     ///< Time when the frame was published (CLOCK_MONOTONIC; set by publish()).
+        std::int64_t wallClockTimeNs = 0;   ///< Time when the frame was published (CLOCK_REALTIME; set by publish()).
+    };
+
+    /*!
+     * \brief Layout of the beginning of the shared memory object.
+     */
+    struct Header
+    {
+        std::uint32_t magic;                        ///< Always 'magicValue'.
+        std::uint32_t version;                      ///< Always 'versionValue'.
+        std::uint32_t numSlots;                     ///< Always 'numSlots'.
+        std::uint32_t bytesPerPixel;                ///< Always 4 ("rgba").
+        std::uint32_t maxWidth;                     ///< Maximum frame width.
+        std::uint32_t maxHeight;                    ///< Maximum frame height.
+        std::uint64_t slotCapacity;                 ///< Size of every slot's pixel data in bytes (distance between slots).
+        std::uint64_t dataOffset;                   ///< Offset of the first slot's pixel data from the start of the object.
+        std::atomic<std::uint32_t> middleSlot;      ///< Index of the shared "middle" slot (plus 'newFrameFlag' if not fetched yet).
+        std::atomic<std::uint32_t> frameCounter;    ///< Number of published frames (futex word).
+        std::atomic<std::uint32_t> closed;          ///< Non-zero after the producer stopped.
+        std::uint32_t reserved;                     ///< Padding (zero).
+        FrameInfo slots[SharedFrameOutput::numSlots];   ///< Frame information of every slot.
+    };
+
+public:
+    SharedFrameOutput(const std::string& pName, sf::Vector2u pMaxSize);     ///< Constructor.
+    SharedFrameOutput(const SharedFrameOutput&) = delete;                   ///< Deleted copy constructor.
+    ~SharedFrameOutput();                                                   ///< Destructor.
+    //
+    SharedFrameOutput& operator=(const SharedFrameOutput&) = delete;        ///< Deleted copy assignment operator.
+    //
+    const std::string& getName() const;                                     ///< Get the name of the shared memory object.
+    sf::Vector2u getMaxSize() const;                                        ///< Get the maximum frame size.
+    //
+    sf::Uint8* getBackBuffer();                                             ///< Get the pixel buffer of the slot for the next frame.
+    bool publish(sf::Vector2u pSize, const FrameInfo& pInfo);               ///< Publish the frame written to the back buffer.
+    bool publish(const sf::Uint8* pPixels, sf::Vector2u pSize,
+                 const FrameInfo& pInfo);                                   ///< Copy a frame to the back buffer and publish it.
+    //
+    static std::int64_t getMonotonicTimeNs();               ///< Get the current CLOCK_MONOTONIC time in nanoseconds (see FrameInfo).
+
+private:
+    const std::string name;             //Name of the shared memory object
+    const sf::Vector2u maxSize;         //Maximum frame size
+    //
+    void* mapping;                      //Start of the mapped shared memory object
+    std::size_t mappingLength;          //Length of the mapped shared memory object
+    Header* header;                     //Header at start of 'mapping'
+    //
+    std::uint32_t backSlot;             //Slot owned by the producer, to which the next frame is written
+    std::uint64_t numFrames;            //Number of published frames
+};
+
+#endif // SPNV_SHAREDFRAMEOUTPUT_H
@@ -0,0 +1,588 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "spherepyramid.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+constexpr char cacheFileSignature[16] = "SPNVSphereCache";  //Signature at the start of every "PNVC file"
+constexpr std::uint32_t cacheFileVersion = 2;               //Version of the "PNVC file" format
+constexpr std::size_t cacheFileAlignment = 4096;            //Alignment of level data within the file (page size)
+
+constexpr int minLevelWidth = 256;                          //Do not add further levels below this panorama sphere width
+
+//Header at the start of every "PNVC file"
+struct CacheFileHeader
+{
+    char signature[16];
+    std::uint32_t version;
+    std::uint32_t numLevels;
+    std::uint64_t picFileSize;
+    std::int64_t picModificationTime;
+    std::int32_t projectionType;
+    std::int32_t uncroppedSize[2];
+    float uncroppedFOV[2];
+    std::int32_t cropPosTL[2];
+    std::int32_t cropPosBR[2];
+};
+
+//Level table entry (follows the header, one per level)
+struct CacheFileLevel
+{
+    std::int32_t width;
+    std::int32_t height;
+    std::uint64_t offset;
+};
+
+//Round up to next multiple of 'cacheFileAlignment'
+std::size_t alignCacheFileOffset(const std::size_t pOffset)
+{
+    return (pOffset + cacheFileAlignment - 1) / cacheFileAlignment * cacheFileAlignment;
+}
+
+//Write all of 'pSize' bytes to file descriptor 'pFd' (returns false on error)
+bool writeAll(const int pFd, const void *const pData, std::size_t pSize)
+{
+    const char* data = static_cast<const char*>(pData);
+
+    while (pSize > 0)
+    {
+        const ssize_t numWritten = write(pFd, data, pSize);
+
+        if (numWritten < 0 && errno == EINTR)
+            continue;
+        else if (numWritten <= 0)
+            return false;
+
+        data += numWritten;
+        pSize -= static_cast<std::size_t>(numWritten);
+    }
+
+    return true;
+}
+
+} // namespace
+
+/*!
+ * \brief Construct an empty pyramid (for loading from file later).
+ *
+ * The pyramid has no levels. Use loadFromCacheFile() to load a pyramid from file.
+ */
+SpherePyramid::SpherePyramid() :
+    levelSizes(),
+    levelData(),
+    //
+    ownedData(),
+    //
+    mappedData(nullptr),
+    mappedLength(0)
+{
+}
+
+/*!
+ * \brief Construct the pyramid from a full resolution sphere.
+ *
+ * Takes the panorama sphere \p pBaseData of size \p pBaseSize (see Projector) as level 0. Each further level
+ * is obtained from the previous one by averaging blocks of 2x2 pixels (halving the size, rounded up as for Deep Zoom
+ * levels, see DeepZoomExporter), until the width would drop below 256 pixels. Because the panorama sphere coordinates are plain angles, every
+ * level spans the same field of view and is related to the others by a simple scale factor.
+ *
+ * \param pBaseSize Size of the full resolution panorama sphere.
+ * \param pBaseData Data of the full resolution panorama sphere ("rgba", see Projector::getDisplayData()).
+ *
+ * \throws std::invalid_argument Size of \p pBaseData does not match \p pBaseSize.
+ */
+SpherePyramid::SpherePyramid(const sf::Vector2i pBaseSize, std::vector<sf::Uint8>&& pBaseData) :
+    SpherePyramid()
+{
+    if (pBaseData.size() != 4 * static_cast<std::size_t>(pBaseSize.x) * static_cast<std::size_t>(pBaseSize.y))
+        throw std::invalid_argument("Panorama sphere data do not match panorama sphere size!");
+
+    levelSizes.push_back(pBaseSize);
+    ownedData.push_back(std::move(pBaseData));
+
+    while ((levelSizes.back().x + 1) / 2 >= minLevelWidth && levelSizes.back().y >= 2)
+    {
+        const sf::Vector2i sourceSize = levelSizes.back();
+        const sf::Vector2i targetSize((sourceSize.x + 1) / 2, (sourceSize.y + 1) / 2);
+
+        std::vector<sf::Uint8> targetData(4 * static_cast<std::size_t>(targetSize.x) * static_cast<std::size_t>(targetSize.y));
+
+        downsampleBox2x2(sourceSize, ownedData.back().data(), targetSize, targetData.data(), 0, targetSize.y);
+
+        levelSizes.push_back(targetSize);
+        ownedData.push_back(std::move(targetData));
+    }
+
+    for (const std::vector<sf::Uint8>& data : ownedData)
+        levelData.push_back(data.data());
+}
+
+/*!
+ * \brief Destructor.
+ *
+ * Unmaps a possibly memory-mapped cache file.
+ */
+SpherePyramid::~SpherePyramid()
+{
+    unmapCacheFile();
+}
+
+//Public
+
+/*!
+ * \brief Get the number of resolution levels.
+ *
+ * \return Number of levels (0 for an empty pyramid).
+ */
+int SpherePyramid::getNumLevels() const
+{
+    return static_cast<int>(levelSizes.size());
+}
+
+/*!
+ * \brief Get the panorama sphere size of a level.
+ *
+ * \param pLevel Level index (0 is full resolution).
+ * \return Size of level \p pLevel.
+ */
+sf::Vector2i SpherePyramid::getLevelSize(const int pLevel) const
+{
+    return levelSizes.at(pLevel);
+}
+
+/*!
+ * \brief Get the panorama sphere data of a level.
+ *
+ * The data format is the same as for Projector::getDisplayData().
+ *
+ * \param pLevel Level index (0 is full resolution).
+ * \return Flat array of panorama sphere data of level \p pLevel.
+ */
+const sf::Uint8* SpherePyramid::getLevelData(const int pLevel) const
+{
+    return levelData.at(pLevel);
+}
+
+/*!
+ * \brief Find the smallest level that is at least as large as a given size.
+ *
+ * Deriving a panorama sphere of size \p pMinSize from the returned level only requires downsampling.
+ * If even level 0 is smaller than \p pMinSize, level 0 is returned.
+ *
+ * \param pMinSize Minimum required panorama sphere size.
+ * \return Index of the smallest sufficiently large level (or -1 for an empty pyramid).
+ */
+int SpherePyramid::selectLevel(const sf::Vector2i pMinSize) const
+{
+    int level = 0;
+
+    while (level + 1 < getNumLevels() && levelSizes[level+1].x >= pMinSize.x && levelSizes[level+1].y >= pMinSize.y)
+        ++level;
+
+    return levelSizes.empty() ? -1 : level;
+}
+
+/*!
+ * \brief Get the memory occupied by level data held in memory.
+ *
+ * Only counts level data of a pyramid built in memory (see SpherePyramid(sf::Vector2i, std::vector<sf::Uint8>&&)).
+ * Data memory-mapped from a cache file are not counted, as they can be evicted from memory at any time.
+ *
+ * \return Size of in-memory level data in bytes.
+ */
+std::size_t SpherePyramid::getMemoryUsage() const
+{
+    std::size_t bytes = 0;
+
+    for (const std::vector<sf::Uint8>& data : ownedData)
+        bytes += data.size();
+
+    return bytes;
+}
+
+//
+
+/*!
+ * \brief Memory-map the pyramid from a "PNVC file".
+ *
+ * Opens the file \p pFileName (see saveToCacheFile() for the file format) and checks that its cache key
+ * matches \p pKey. If so, the whole file is memory-mapped (read-only) and the levels point directly into
+ * the mapped file, such that level data are only paged in from disk when they are actually accessed.
+ *
+ * Previous contents of the pyramid are discarded.
+ *
+ * \param pFileName File name of the "PNVC file".
+ * \param pKey Expected cache key of the picture file and panorama scene.
+ * \return If successful (file exists, is valid and matches \p pKey).
+ */
+bool SpherePyramid::loadFromCacheFile(const std::string& pFileName, const CacheKey& pKey)
+{
+    levelSizes.clear();
+    levelData.clear();
+    ownedData.clear();
+    unmapCacheFile();
+
+    int fd = open(pFileName.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+
+    if (fstat(fd, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) < sizeof(CacheFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const std::size_t fileLength = static_cast<std::size_t>(fileStat.st_size);
+
+    void* data = mmap(nullptr, fileLength, PROT_READ, MAP_SHARED, fd, 0);
+
+    //Mapping stays valid after closing the file descriptor
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr<<"ERROR: Could not memory-map file \"" + pFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    mappedData = data;
+    mappedLength = fileLength;
+
+    const sf::Uint8* fileData = static_cast<const sf::Uint8*>(mappedData);
+
+    CacheFileHeader header{};
+    std::memcpy(&header, fileData, sizeof(CacheFileHeader));
+
+    //Check signature, version and cache key
+
+    bool keyMatches = (std::memcmp(header.signature, cacheFileSignature, sizeof(cacheFileSignature)) == 0 &&
+                       header.version == cacheFileVersion &&
+                       header.picFileSize == pKey.picFileSize &&
+                       header.picModificationTime == pKey.picModificationTime &&
+                       header.projectionType == static_cast<std::int32_t>(pKey.projectionType) &&
+                       header.uncroppedSize[0] == pKey.uncroppedSize.x && header.uncroppedSize[1] == pKey.uncroppedSize.y &&
+                       header.uncroppedFOV[0] == pKey.uncroppedFOV.x && header.uncroppedFOV[1] == pKey.uncroppedFOV.y &&
+                       header.cropPosTL[0] == pKey.cropPosTL.x && header.cropPosTL[1] == pKey.cropPosTL.y &&
+                       header.cropPosBR[0] == pKey.cropPosBR.x && header.cropPosBR[1] == pKey.cropPosBR.y);
+
+    if (!keyMatches || header.numLevels == 0 ||
+            fileLength < sizeof(CacheFileHeader) + header.numLevels * sizeof(CacheFileLevel))
+    {
+        unmapCacheFile();
+        return false;
+    }
+
+    //Read level table and check that all levels are within the file
+
+    for (std::uint32_t i = 0; i < header.numLevels; ++i)
+    {
+        CacheFileLevel level;
+        std::memcpy(&level, fileData + sizeof(CacheFileHeader) + i * sizeof(CacheFileLevel), sizeof(CacheFileLevel));
+
+        const std::size_t levelLength = 4 * static_cast<std::size_t>(level.width) * static_cast<std::size_t>(level.height);
+
+        if (level.width <= 0 || level.height <= 0 || level.offset > fileLength || fileLength - level.offset < levelLength)
+        {
+            levelSizes.clear();
+            levelData.clear();
+            unmapCacheFile();
+            return false;
+        }
+
+        levelSizes.push_back({level.width, level.height});
+        levelData.push_back(fileData + level.offset);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write the pyramid to a "PNVC file".
+ *
+ * Writes the pyramid to a "PNVC file" of the following custom binary format (native byte order):
+ *
+ * - Header: signature "SPNVSphereCache\0", format version, number of levels and the values of \p pKey.
+ * - Level table: width, height and file offset of each level.
+ * - Level data: raw "rgba" panorama sphere data of each level (see getLevelData()),
+ *   each starting at a multiple of 4096 bytes so that it can be memory-mapped efficiently.
+ *
+ * The pyramid can be loaded from such a file via loadFromCacheFile().
+ *
+ * The file is first written to a unique temporary file in the same directory, flushed to disk and then renamed
+ * to \p pFileName. Hence a crash or a concurrently running instance never leaves a truncated or mixed file
+ * behind, and pyramids memory-mapped from a previous version of the file stay valid.
+ *
+ * \param pFileName File name of the "PNVC file".
+ * \param pKey Cache key of the picture file and panorama scene.
+ * \return If successful.
+ */
+bool SpherePyramid::saveToCacheFile(const std::string& pFileName, const CacheKey& pKey) const
+{
+    if (levelSizes.empty())
+        return false;
+
+    CacheFileHeader header{};
+
+    std::memcpy(header.signature, cacheFileSignature, sizeof(cacheFileSignature));
+    header.version = cacheFileVersion;
+    header.numLevels = static_cast<std::uint32_t>(levelSizes.size());
+    header.picFileSize = pKey.picFileSize;
+    header.picModificationTime = pKey.picModificationTime;
+    header.projectionType = static_cast<std::int32_t>(pKey.projectionType);
+    header.uncroppedSize[0] = pKey.uncroppedSize.x;
+    header.uncroppedSize[1] = pKey.uncroppedSize.y;
+    header.uncroppedFOV[0] = pKey.uncroppedFOV.x;
+    header.uncroppedFOV[1] = pKey.uncroppedFOV.y;
+    header.cropPosTL[0] = pKey.cropPosTL.x;
+    header.cropPosTL[1] = pKey.cropPosTL.y;
+    header.cropPosBR[0] = pKey.cropPosBR.x;
+    header.cropPosBR[1] = pKey.cropPosBR.y;
+
+    //Assign aligned file offsets to the levels
+
+    std::vector<CacheFileLevel> levels;
+
+    std::size_t offset = alignCacheFileOffset(sizeof(CacheFileHeader) + levelSizes.size() * sizeof(CacheFileLevel));
+
+    for (const sf::Vector2i& size : levelSizes)
+    {
+        levels.push_back({size.x, size.y, offset});
+
+        offset = alignCacheFileOffset(offset + 4 * static_cast<std::size_t>(size.x) * static_cast<std::size_t>(size.y));
+    }
+
+    std::string tempFileName = pFileName + ".XXXXXX";
+
+    const int fd = mkstemp(tempFileName.data());
+
+    if (fd < 0)
+    {
+        std::cerr<<"ERROR: Could not create temporary file for \"" + pFileName + "\"!"<<std::endl;
+        return false;
+    }
+
+    //Same permissions as a newly created file with the usual umask (mkstemp() restricts them to the owner)
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    bool success = writeAll(fd, &header, sizeof(CacheFileHeader)) &&
+                   writeAll(fd, levels.data(), levels.size() * sizeof(CacheFileLevel));
+
+    const std::vector<char> padding(cacheFileAlignment, 0);
+
+    std::size_t position = sizeof(CacheFileHeader) + levels.size() * sizeof(CacheFileLevel);
+
+    for (std::size_t i = 0; success && i < levels.size(); ++i)
+    {
+        const std::size_t levelLength = 4 * static_cast<std::size_t>(levels[i].width) * static_cast<std::size_t>(levels[i].height);
+
+        success = writeAll(fd, padding.data(), levels[i].offset - position) && writeAll(fd, levelData[i], levelLength);
+
+        position = levels[i].offset + levelLength;
+    }
+
+    //Make sure the data are on disk before the file becomes visible under its final name
+    success = success && fsync(fd) == 0;
+    success = (close(fd) == 0) && success;
+
+    if (success && std::rename(tempFileName.c_str(), pFileName.c_str()) == 0)
+        return true;
+
+    std::cerr<<"ERROR: Could not write to file \"" + pFileName + "\"!"<<std::endl;
+
+    unlink(tempFileName.c_str());
+
+    return false;
+}
+
+//
+
+/*!
+ * \brief Assemble the cache key for a picture file.
+ *
+ * Combines size and last modification time of the picture file \p pPicFileName
+ * with the panorama scene meta data \p pSceneMetaData (see CacheKey).
+ *
+ * \param pPicFileName File name of the panorama picture.
+ * \param pSceneMetaData Meta data for the panorama scene shown in \p pPicFileName.
+ * \return Cache key for \p pPicFileName and \p pSceneMetaData.
+ *
+ * \throws std::filesystem::filesystem_error Could not query size or modification time of \p pPicFileName.
+ */
+SpherePyramid::CacheKey SpherePyramid::makeCacheKey(const std::string& pPicFileName, const SceneMetaData& pSceneMetaData)
+{
+    CacheKey key;
+
+    key.picFileSize = std::filesystem::file_size(pPicFileName);
+    key.picModificationTime = std::filesystem::last_write_time(pPicFileName).time_since_epoch().count();
+    key.projectionType = pSceneMetaData.getProjectionType();
+    key.uncroppedSize = pSceneMetaData.getUncroppedSize();
+    key.uncroppedFOV = pSceneMetaData.getUncroppedFOV();
+    key.cropPosTL = pSceneMetaData.getCropPosTL();
+    key.cropPosBR = pSceneMetaData.getCropPosBR();
+
+    return key;
+}
+
+/*!
+ * \brief Get the "PNVC file" name matching a picture file name.
+ *
+ * The cache file name is the picture file name with its extension replaced by ".pnvc".
+ *
+ * \param pPicFileName File name of the panorama picture.
+ * \return File name of the matching "PNVC file".
+ */
+std::string SpherePyramid::getCacheFileName(const std::string& pPicFileName)
+{
+    std::filesystem::path tPath(pPicFileName);
+    tPath.replace_extension("pnvc");
+
+    return tPath.string();
+}
+
+/*!
+ * \brief Reduce an "rgba" image to half its size by averaging blocks of 2x2 pixels.
+ *
+ * Averages (with rounding) every block of 2x2 pixels of \p pSourcePixels to a single pixel of \p pTargetPixels.
+ * \p pTargetSize may be the halved source size either rounded down or rounded up (as used for the pyramid
+ * levels); in the latter case the last column or row of an odd-sized source is averaged with itself.
+ *
+ * Only target rows from \p pBeginRow to \p pEndRow (exclusive) are computed, such that the work can be split
+ * over several threads. All four channels are averaged. Where SSE2 is available, four target pixels are
+ * computed at once with the same result as the plain implementation.
+ *
+ * \param pSourceSize Size of the source image.
+ * \param pSourcePixels Source image data ("rgba", see Projector::getDisplayData()).
+ * \param pTargetSize Size of the target image (halved source size, rounded down or up).
+ * \param pTargetPixels Target image data ("rgba").
+ * \param pBeginRow First target row to compute.
+ * \param pEndRow Target row after the last one to compute.
+ */
+void SpherePyramid::downsampleBox2x2(const sf::Vector2i pSourceSize, const sf::Uint8 *const pSourcePixels,
+                                     const sf::Vector2i pTargetSize, sf::Uint8 *const pTargetPixels,
+                                     const int pBeginRow, const int pEndRow)
+{
+    const std::size_t sourceStride = 4 * static_cast<std::size_t>(pSourceSize.x);
+
+    //Number of target pixels that have two source columns (all but a possible last one for odd source width)
+    const int numFullPairs = std::min(pTargetSize.x, pSourceSize.x / 2);
+
+    for (int y = pBeginRow; y < pEndRow; ++y)
+    {
+        const sf::Uint8* row0 = pSourcePixels + sourceStride * 2 * y;
+        const sf::Uint8* row1 = (2*y + 1 < pSourceSize.y) ? row0 + sourceStride : row0;
+
+        sf::Uint8* target = pTargetPixels + 4 * static_cast<std::size_t>(pTargetSize.x) * y;
+
+        int i = 0;
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        //Four target pixels from eight source pixels of both rows each
+        for (; i + 16 <= 4 * numFullPairs; i += 16)
+        {
+            const __m128i r0a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2*i));
+            const __m128i r0b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2*i + 16));
+            const __m128i r1a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2*i));
+            const __m128i r1b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2*i + 16));
+
+            //Vertical sums as 16 bit values (two source pixels per register)
+            const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(r0a, zero), _mm_unpacklo_epi8(r1a, zero));
+            const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(r0a, zero), _mm_unpackhi_epi8(r1a, zero));
+            const __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(r0b, zero), _mm_unpacklo_epi8(r1b, zero));
+            const __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(r0b, zero), _mm_unpackhi_epi8(r1b, zero));
+
+            //Horizontal sums of neighboring source pixels end up in the lower halves
+            const __m128i t01 = _mm_add_epi16(s01, _mm_srli_si128(s01, 8));
+            const __m128i t23 = _mm_add_epi16(s23, _mm_srli_si128(s23, 8));
+            const __m128i t45 = _mm_add_epi16(s45, _mm_srli_si128(s45, 8));
+            const __m128i t67 = _mm_add_epi16(s67, _mm_srli_si128(s67, 8));
+
+            //Rounded averages of the four target pixels, packed back to 8 bit
+            const __m128i avgA = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(t01, t23), two), 2);
+            const __m128i avgB = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(t45, t67), two), 2);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), _mm_packus_epi16(avgA, avgB));
+        }
+#endif
+
+        for (; i < 4 * numFullPairs; ++i)
+        {
+            int c = i % 4;
+            int x = 2 * (i / 4);
+
+            target[i] = (row0[4*x + c] + row0[4*(x+1) + c] + row1[4*x + c] + row1[4*(x+1) + c] + 2) / 4;
+        }
+
+        //Last column of odd source width (only if target size rounded up)
+        for (; i < 4 * pTargetSize.x; ++i)
+        {
+            int c = i % 4;
+            int x = 2 * (i / 4);
+
+            target[i] = (2 * row0[4*x + c] + 2 * row1[4*x + c] + 2) / 4;
+        }
+    }
+}
+
+//Private
+
+/*!
+ * \brief Release a memory-mapped cache file.
+ *
+ * Does nothing if no file is mapped.
+ */
+void SpherePyramid::unmapCacheFile()
+{
+    if (mappedData == nullptr)
+        return;
+
+    munmap(mappedData, mappedLength);
+
+    mappedData = nullptr;
+    mappedLength = 0;
+}
@@ -0,0 +1,105 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_SPHEREPYRAMID_H
+#define SPNV_SPHEREPYRAMID_H
+
+#include "scenemetadata.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Multi-resolution panorama sphere that can be stored in and memory-mapped from a cache file.
+ *
+ * Holds a full resolution panorama sphere (see Projector) as level 0 and successively halved versions of it (rounded up) as
+ * further levels (see SpherePyramid(sf::Vector2i, std::vector<sf::Uint8>&&)). Every level uses the same "rgba"
+ * data format as Projector::getDisplayData() and spans the same field of view, such that a panorama sphere of
+ * arbitrary size can be quickly derived from the smallest level that is still at least as large (see selectLevel()).
+ *
+ * The pyramid can be written to a "PNVC file" (see saveToCacheFile()) and loaded again from such a file
+ * (see loadFromCacheFile()), in which case the level data are memory-mapped instead of being read into memory.
+ * The cache file is bound to a specific picture file and its panorama scene by a CacheKey (see makeCacheKey()).
+ */
+class SpherePyramid
+{
+public:
+    /*!
+     * \brief Identification of the picture file and panorama scene that a cache file belongs to.
+     *
+     * A cache file is only accepted by loadFromCacheFile() if all of these values match.
+     */
+    struct CacheKey
+    {
+        std::uint64_t picFileSize;                          ///< Size of the picture file in bytes.
+        std::int64_t picModificationTime;                   ///< Last modification time of the picture file (file clock ticks).
+        SceneMetaData::PanoramaProjection projectionType;   ///< Panorama projection type of the scene.
+        sf::Vector2i uncroppedSize;                         ///< Size of the uncropped panorama picture.
+        sf::Vector2f uncroppedFOV;                          ///< Field of view of the uncropped panorama picture.
+        sf::Vector2i cropPosTL;                             ///< Position of the crop rectangle's top left corner.
+        sf::Vector2i cropPosBR;                             ///< Position of the crop rectangle's bottom right corner.
+    };
+
+public:
+    SpherePyramid();                                                        ///< Construct an empty pyramid (for loading from file later).
+    SpherePyramid(sf::Vector2i pBaseSize, std::vector<sf::Uint8>&& pBaseData);  ///< Construct the pyramid from a full resolution sphere.
+    SpherePyramid(const SpherePyramid&) = delete;                           ///< Deleted copy constructor.
+    ~SpherePyramid();                                                       ///< Destructor.
+    //
+    SpherePyramid& operator=(const SpherePyramid&) = delete;                ///< Deleted copy assignment operator.
+    //
+    int getNumLevels() const;                                   ///< Get the number of resolution levels.
+    sf::Vector2i getLevelSize(int pLevel) const;                ///< Get the panorama sphere size of a level.
+    const sf::Uint8* getLevelData(int pLevel) const;            ///< Get the panorama sphere data of a level.
+    int selectLevel(sf::Vector2i pMinSize) const;               ///< Find the smallest level that is at least as large as a given size.
+    std::size_t getMemoryUsage() const;                         ///< Get the memory occupied by level data held in memory.
+    //
+    bool loadFromCacheFile(const std::string& pFileName, const CacheKey& pKey);         ///< Memory-map the pyramid from a "PNVC file".
+    bool saveToCacheFile(const std::string& pFileName, const CacheKey& pKey) const;     ///< Write the pyramid to a "PNVC file".
+    //
+    static CacheKey makeCacheKey(const std::string& pPicFileName, const SceneMetaData& pSceneMetaData);   ///< \brief Assemble the cache
+                                                                                                            ///  key for a picture file.
+    static std::string getCacheFileName(const std::string& pPicFileName);   ///< Get the "PNVC file" name matching a picture file name.
+    //
+    static void downsampleBox2x2(sf::Vector2i pSourceSize, const sf::Uint8* pSourcePixels, sf::Vector2i pTargetSize,
+                                 sf::Uint8* pTargetPixels, int pBeginRow, int pEndRow); ///< \brief Reduce an "rgba" image to half its
+                                                                                        ///  size by averaging blocks of 2x2 pixels.
+
+private:
+    void unmapCacheFile();                                      ///< Release a memory-mapped cache file.
+
+private:
+    std::vector<sf::Vector2i> levelSizes;           //Panorama sphere sizes of all levels
+    std::vector<const sf::Uint8*> levelData;        //Panorama sphere data of all levels (pointing into 'ownedData' or 'mappedData')
+    //
+    std::vector<std::vector<sf::Uint8>> ownedData;  //Level data buffers, if pyramid was built in memory
+    //
+    void* mappedData;                               //Start of memory-mapped cache file, if pyramid was loaded from file
+    std::size_t mappedLength;                       //Length of memory-mapped cache file
+};
+
+#endif // SPNV_SPHEREPYRAMID_H
@@ -0,0 +1,309 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#include "tilestore.h"
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+/*!
+ * \brief Constructor.
+ *
+ * Creates a temporary file in the directory \p pDirectory and sizes it to hold an image of size \p pSize in tiles of
+ * tileSize x tileSize pixels (partially covered tiles at the right and bottom edges are stored completely). The file
+ * is removed from the file system right away and only kept alive by its open file descriptor and the memory mapping
+ * of its data, so it disappears automatically when the TileStore is destroyed.
+ *
+ * \p pDirectory must be located on a disk: on a file system in memory (such as "tmpfs", which often holds "/tmp")
+ * the tile data cannot be dropped from memory at all, which is hence warned about.
+ *
+ * The memory occupied by tiles fetched via fetchRegion() is limited to \p pMemoryLimit,
+ * but at least one tile will always be kept.
+ *
+ * \param pSize Image size in pixels.
+ * \param pMemoryLimit Maximum memory for fetched tiles in bytes.
+ * \param pDirectory Directory for the temporary file.
+ *
+ * \throws std::runtime_error Creating, sizing or memory-mapping the temporary file failed.
+ */
+TileStore::TileStore(const sf::Vector2i pSize, const std::size_t pMemoryLimit, const std::string& pDirectory) :
+    size(pSize),
+    numTiles({(pSize.x + tileSize - 1) / tileSize, (pSize.y + tileSize - 1) / tileSize}),
+    //
+    fileDescriptor(-1),
+    data(nullptr),
+    dataLength(4 * static_cast<std::size_t>(numTiles.x) * static_cast<std::size_t>(numTiles.y) * tileSize * tileSize),
+    //
+    memoryLimit(pMemoryLimit),
+    maxResidentTiles(std::max<std::size_t>(1, pMemoryLimit / (4 * tileSize * tileSize))),
+    //
+    lruMutex(),
+    lruTiles(),
+    lruPositions(static_cast<std::size_t>(numTiles.x) * static_cast<std::size_t>(numTiles.y)),
+    tileResident(static_cast<std::size_t>(numTiles.x) * static_cast<std::size_t>(numTiles.y), false),
+    tileDirty(static_cast<std::size_t>(numTiles.x) * static_cast<std::size_t>(numTiles.y), false)
+{
+    if (dataLength == 0)
+        throw std::runtime_error("Cannot create tile store for empty image!");
+
+    std::string fileNameTemplate = (std::filesystem::path(pDirectory) / "spnv-tiles-XXXXXX").string();
+
+    const int fd = mkstemp(fileNameTemplate.data());
+
+    if (fd < 0)
+        throw std::runtime_error("Could not create temporary tile store file in \"" + pDirectory + "\"!");
+
+    //File only needs to exist as long as it is open
+    unlink(fileNameTemplate.c_str());
+
+    //Dropped tiles would stay in memory anyway
+    struct statfs fileSystem = {};
+
+    if (fstatfs(fd, &fileSystem) == 0 && fileSystem.f_type == TMPFS_MAGIC)
+        std::cerr<<"WARNING: Tile store directory \"" + pDirectory + "\" is in memory, tile memory limit has no effect!"<<std::endl;
+
+    if (ftruncate(fd, static_cast<off_t>(dataLength)) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not resize temporary tile store file!");
+    }
+
+    void* mapping = mmap(nullptr, dataLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("Could not memory-map temporary tile store file!");
+    }
+
+    //File descriptor kept for dropping evicted tiles from the page cache (see dropTiles())
+    fileDescriptor = fd;
+    data = static_cast<sf::Uint8*>(mapping);
+}
+
+/*!
+ * \brief Destructor.
+ *
+ * Unmaps and closes (and thereby deletes) the temporary file.
+ */
+TileStore::~TileStore()
+{
+    munmap(data, dataLength);
+    close(fileDescriptor);
+}
+
+//Public
+
+/*!
+ * \brief Get the image size.
+ *
+ * \return Image size in pixels.
+ */
+sf::Vector2i TileStore::getSize() const
+{
+    return size;
+}
+
+/*!
+ * \brief Get the memory limit for fetched tiles.
+ *
+ * \return Maximum memory for fetched tiles in bytes.
+ */
+std::size_t TileStore::getMemoryLimit() const
+{
+    return memoryLimit;
+}
+
+/*!
+ * \brief Get the memory currently occupied by fetched tiles.
+ *
+ * \return Memory of currently fetched tiles in bytes.
+ */
+std::size_t TileStore::getResidentMemory() const
+{
+    const std::lock_guard<std::mutex> lock(lruMutex);
+
+    return lruTiles.size() * 4 * tileSize * tileSize;
+}
+
+//
+
+/*!
+ * \brief Make the tiles covering an image region resident and evict least recently used tiles beyond memory limit.
+ *
+ * Marks all tiles that intersect the pixel rectangle from {\p pLeft, \p pTop} to {\p pRight, \p pBottom} (inclusive)
+ * as most recently used and advises the operating system to read them in. Horizontal positions outside of the image
+ * are wrapped around (as needed for 360 degree panorama spheres), while vertical positions are clipped.
+ *
+ * Before fetching each tile that is not resident yet, least recently used tiles are evicted such that the memory limit
+ * (see TileStore()) is never exceeded (see evictTiles()). A region larger than the limit hence only keeps its most
+ * recently fetched tiles, so callers should fetch small regions (e.g. row by row) right before accessing them.
+ * The evicted tiles are dropped from memory after releasing the lock (see dropTiles()), such that other threads
+ * do not wait for it. Dropped tiles keep their data in the backing file.
+ *
+ * Set \p pForWriting if pixels of the region will be changed, such that the tiles are written back when dropped.
+ *
+ * This function is thread-safe.
+ *
+ * \param pLeft Left edge of the region.
+ * \param pTop Top edge of the region.
+ * \param pRight Right edge of the region.
+ * \param pBottom Bottom edge of the region.
+ * \param pForWriting Pixels of the region will be changed.
+ */
+void TileStore::fetchRegion(const int pLeft, const int pTop, const int pRight, const int pBottom, const bool pForWriting)
+{
+    const int tileTop = std::max(0, pTop) / tileSize;
+    const int tileBottom = std::min(size.y - 1, pBottom) / tileSize;
+
+    //Floor division also for negative positions (wrapped around below)
+    const int tileLeft = (pLeft >= 0 ? pLeft : pLeft - tileSize + 1) / tileSize;
+    const int tileRight = std::min(tileLeft + numTiles.x - 1, (pRight >= 0 ? pRight : pRight - tileSize + 1) / tileSize);
+
+    std::vector<EvictedTile> evictedTiles;
+
+    std::unique_lock<std::mutex> lock(lruMutex);
+
+    for (int ty = tileTop; ty <= tileBottom; ++ty)
+    {
+        for (int tx = tileLeft; tx <= tileRight; ++tx)
+        {
+            const int tileIdx = numTiles.x * ty + ((tx % numTiles.x) + numTiles.x) % numTiles.x;
+
+            //Move tile to the front of the LRU list or add it there (and ask for read-ahead)
+            if (tileResident[tileIdx])
+                lruTiles.erase(lruPositions[tileIdx]);
+            else
+            {
+                evictTiles(maxResidentTiles - 1, evictedTiles);
+
+                madvise(data + 4 * static_cast<std::size_t>(tileIdx) * tileSize * tileSize,
+                        4 * tileSize * tileSize, MADV_WILLNEED);
+
+                tileResident[tileIdx] = true;
+            }
+
+            if (pForWriting)
+                tileDirty[tileIdx] = true;
+
+            lruTiles.push_front(tileIdx);
+            lruPositions[tileIdx] = lruTiles.begin();
+        }
+    }
+
+    lock.unlock();
+
+    dropTiles(evictedTiles);
+}
+
+/*!
+ * \brief Copy a flat "rgba" image of same size into the tiles.
+ *
+ * Copies \p pPixels (same format as Projector::getDisplayData() with size getSize()) into the
+ * tiles, one tile at a time, fetching each tile before (see fetchRegion()).
+ *
+ * \param pPixels Flat image data.
+ */
+void TileStore::loadFromPixels(const sf::Uint8 *const pPixels)
+{
+    for (int tileY = 0; tileY < size.y; tileY += tileSize)
+    {
+        const int tileEndY = std::min(tileY + tileSize, size.y);
+
+        for (int x = 0; x < size.x; x += tileSize)
+        {
+            const int rowLength = std::min(tileSize, size.x - x);
+
+            fetchRegion(x, tileY, x + rowLength - 1, tileEndY - 1, true);
+
+            for (int y = tileY; y < tileEndY; ++y)
+                std::memcpy(getPixel(x, y), pPixels + 4 * (static_cast<std::size_t>(size.x) * y + x), 4 * rowLength);
+        }
+    }
+}
+
+//Private
+
+/*!
+ * \brief Remove least recently used tiles from the LRU list until within a tile count.
+ *
+ * Removes tiles from the end of the LRU list until at most \p pMaxCount tiles are fetched and appends them to
+ * \p pEvictedTiles, which must then be dropped from memory via dropTiles() (without holding the lock).
+ *
+ * Must be called with 'lruMutex' locked.
+ *
+ * \param pMaxCount Maximum number of fetched tiles to keep.
+ * \param pEvictedTiles Target for the removed tiles.
+ */
+void TileStore::evictTiles(const std::size_t pMaxCount, std::vector<EvictedTile>& pEvictedTiles)
+{
+    while (lruTiles.size() > pMaxCount)
+    {
+        const int tileIdx = lruTiles.back();
+
+        pEvictedTiles.push_back({tileIdx, tileDirty[tileIdx]});
+
+        tileResident[tileIdx] = false;
+        tileDirty[tileIdx] = false;
+        lruTiles.pop_back();
+    }
+}
+
+/*!
+ * \brief Write back evicted tiles and drop them from memory.
+ *
+ * Schedules the write-back of the data of every dirty tile in \p pTiles (without waiting for it) and advises the
+ * operating system to drop the tiles both from the memory mapping and from the page cache (a shared file mapping
+ * alone keeps them in the page cache). Tiles that were only read are dropped right away.
+ *
+ * Because the tile data are backed by a shared file mapping, the dropped data remain in the file and are
+ * transparently read in again on the next access, even if a tile is fetched again meanwhile by another thread.
+ *
+ * Does not need 'lruMutex' to be locked.
+ *
+ * \param pTiles Tiles removed from the LRU list by evictTiles().
+ */
+void TileStore::dropTiles(const std::vector<EvictedTile>& pTiles) const
+{
+    constexpr std::size_t tileBytes = 4 * tileSize * tileSize;
+
+    for (const EvictedTile& tile : pTiles)
+    {
+        const std::size_t offset = tileBytes * static_cast<std::size_t>(tile.index);
+
+        if (tile.dirty)
+            msync(data + offset, tileBytes, MS_ASYNC);
+
+        madvise(data + offset, tileBytes, MADV_DONTNEED);
+        posix_fadvise(fileDescriptor, static_cast<off_t>(offset), static_cast<off_t>(tileBytes), POSIX_FADV_DONTNEED);
+    }
+}
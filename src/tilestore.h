@@ -0,0 +1,135 @@
+/*
+////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of SPNV, a simple panorama viewer for Hugin panoramas.
+//  Copyright (C) 2022, 2025 M. Frohne
+//
+//  SPNV is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as published
+//  by the Free Software Foundation, either version 3 of the License,
+//  or (at your option) any later version.
+//
+//  SPNV is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with SPNV. If not, see <https://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+#ifndef SPNV_TILESTORE_H
+#define SPNV_TILESTORE_H
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Out-of-core "rgba" image split into square tiles and backed by a memory-mapped file.
+ *
+ * Stores an image of arbitrary size in tiles of tileSize x tileSize pixels, each occupying a contiguous
+ * block of a temporary file (see TileStore()). The file is memory-mapped, such that pixels can be
+ * accessed directly via getPixel(), while the operating system pages tile data in and out as needed.
+ *
+ * To keep the memory usage bounded, users announce the image regions they are about to access via fetchRegion().
+ * The fetched tiles are tracked in a least recently used (LRU) list and, before fetching another tile, tiles beyond
+ * a configurable memory limit are dropped from memory and from the page cache (their data remain in the file). Tiles
+ * fetched for writing are written back first. Accessing pixels outside of fetched regions is still valid but is not
+ * accounted for by the memory limit. Regions can be fetched from several threads concurrently.
+ *
+ * The data format per pixel is the same as for Projector::getDisplayData().
+ */
+class TileStore
+{
+public:
+    static constexpr int tileSize = 256;    ///< Width and height of a tile in pixels.
+
+public:
+    TileStore(sf::Vector2i pSize, std::size_t pMemoryLimit, const std::string& pDirectory);  ///< Constructor.
+    TileStore(const TileStore&) = delete;                       ///< Deleted copy constructor.
+    ~TileStore();                                               ///< Destructor.
+    //
+    TileStore& operator=(const TileStore&) = delete;            ///< Deleted copy assignment operator.
+    //
+    sf::Vector2i getSize() const;                               ///< Get the image size.
+    std::size_t getMemoryLimit() const;                         ///< Get the memory limit for fetched tiles.
+    std::size_t getResidentMemory() const;                      ///< Get the memory currently occupied by fetched tiles.
+    //
+    inline const sf::Uint8* getPixel(int pX, int pY) const;     ///< Get read access to the color values of a pixel.
+    inline sf::Uint8* getPixel(int pX, int pY);                 ///< Get write access to the color values of a pixel.
+    //
+    void fetchRegion(int pLeft, int pTop, int pRight, int pBottom,
+                     bool pForWriting = false);                         ///< \brief Make the tiles covering an image region resident
+                                                                        ///  and evict least recently used tiles beyond memory limit.
+    void loadFromPixels(const sf::Uint8* pPixels);                      ///< Copy a flat "rgba" image of same size into the tiles.
+
+private:
+    /*!
+     * \brief Tile removed from the LRU list, which still needs to be dropped from memory (see dropTiles()).
+     */
+    struct EvictedTile
+    {
+        int index;      ///< Index of the tile.
+        bool dirty;     ///< Tile was fetched for writing since it was last dropped.
+    };
+
+private:
+    void evictTiles(std::size_t pMaxCount, std::vector<EvictedTile>& pEvictedTiles);  ///< \brief Remove least recently used tiles
+                                                                                    ///  from the LRU list until within a tile count.
+    void dropTiles(const std::vector<EvictedTile>& pTiles) const;   ///< Write back evicted tiles and drop them from memory.
+
+private:
+    const sf::Vector2i size;                //Image size in pixels
+    const sf::Vector2i numTiles;            //Number of tiles in horizontal and vertical direction
+    //
+    int fileDescriptor;                     //Backing file of the tile data
+    sf::Uint8* data;                        //Start of memory-mapped tile data
+    std::size_t dataLength;                 //Length of memory-mapped tile data
+    //
+    const std::size_t memoryLimit;          //Maximum memory for fetched tiles
+    const std::size_t maxResidentTiles;     //Maximum number of fetched tiles derived from 'memoryLimit'
+    //
+    mutable std::mutex lruMutex;                        //Protects 'lruTiles', 'lruPositions', 'tileResident' and 'tileDirty'
+    std::list<int> lruTiles;                            //Fetched tiles, most recently used first
+    std::vector<std::list<int>::iterator> lruPositions; //Position of every tile in 'lruTiles' (if fetched)
+    std::vector<bool> tileResident;                     //Whether every tile is currently fetched
+    std::vector<bool> tileDirty;                        //Whether every tile was fetched for writing since it was last dropped
+};
+
+/*!
+ * \brief Get read access to the color values of a pixel.
+ *
+ * \param pX Horizontal pixel position within [0, getSize().x).
+ * \param pY Vertical pixel position within [0, getSize().y).
+ * \return Pointer to the four "rgba" values of the pixel.
+ */
+inline const sf::Uint8* TileStore::getPixel(const int pX, const int pY) const
+{
+    const std::size_t tileIdx = static_cast<std::size_t>(numTiles.x) * (pY / tileSize) + pX / tileSize;
+
+    return data + 4 * (tileIdx * tileSize * tileSize + (pY % tileSize) * tileSize + pX % tileSize);
+}
+
+/*!
+ * \brief Get write access to the color values of a pixel.
+ *
+ * \param pX Horizontal pixel position within [0, getSize().x).
+ * \param pY Vertical pixel position within [0, getSize().y).
+ * \return Pointer to the four "rgba" values of the pixel.
+ */
+inline sf::Uint8* TileStore::getPixel(const int pX, const int pY)
+{
+    const std::size_t tileIdx = static_cast<std::size_t>(numTiles.x) * (pY / tileSize) + pX / tileSize;
+
+    return data + 4 * (tileIdx * tileSize * tileSize + (pY % tileSize) * tileSize + pX % tileSize);
+}
+
+#endif // SPNV_TILESTORE_H